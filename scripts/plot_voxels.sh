@@ -1,7 +1,8 @@
 #!/bin/sh
 
 usage(){
-  echo "Usage: $0 -f <voxels.dat> [-d=2|-d=3] [-l v] [-u v] [-e ext] [-H] [-p] [-g gnuplot-commands]"
+  echo "Usage: $0 -f <voxels.dat|voxels.bin> [-L layer] [-d=2|-d=3] [-l v] [-u v] [-e ext] [-H] [-p] [-g gnuplot-commands]"
+  echo "       -L Layer to plot from a binary voxel log (converted with voxels2dat)"
   echo "       -d Plot as 3d or projected map (2d)"
   echo "       -p Keep the graph interactive"
   echo "       -e Output file type (if not interactive)"
@@ -10,6 +11,7 @@ usage(){
 }
 
 file=""
+layer=""
 dim=2
 ext="png"
 persist=""
@@ -23,7 +25,7 @@ X="x"
 # A POSIX variable
 OPTIND=1         # Reset in case getopts has been used previously in the shell.
 
-while getopts "h?f:d:l:u:e:g:pH" opt; do
+while getopts "h?f:L:d:l:u:e:g:pH" opt; do
   case "$opt" in
   h|\?)
       usage
@@ -31,6 +33,8 @@ while getopts "h?f:d:l:u:e:g:pH" opt; do
       ;;
   f)  file=$OPTARG
       ;;
+  L)  layer=$OPTARG
+      ;;
   d)  dim=$OPTARG
       ;;
   e)  ext=$OPTARG
@@ -56,6 +60,29 @@ then
   exit 1
 fi
 
+if [ "$(head -c 8 $file)" = "REUSVOX1" ]
+then
+  if [ -z "$layer" ]
+  then
+    echo "'$file' is a binary voxel log: a layer must be provided (-L)"
+    usage
+    exit 3
+  fi
+
+  converter=${BUILD_DIR:-./build_release}/voxels2dat
+  if [ ! -x "$converter" ]
+  then
+    echo "Unable to find voxel log converter at '$converter'. Set BUILD_DIR?"
+    exit 4
+  fi
+  bin=$file
+  file=$(dirname $bin)/$layer.dat
+  if [ ! -f "$file" -o "$bin" -nt "$file" ]
+  then
+    $converter -f $bin -l $layer || exit 5
+  fi
+fi
+
 if [ "$dim" -lt 2 -o "$dim" -gt 3 ]
 then
   echo "Wrong dimension. '$dim' is neither 2 nor 3"
@@ -82,6 +82,47 @@ public:
   }
 };
 
+/// One column of values per enumeration field (structure of arrays)
+template <typename E, typename T = double>
+class enumcolumns {
+public:
+  using EU = EnumUtils<E>;
+  using U = typename EU::underlying_t;
+  static constexpr size_t S = EU::size();
+  using Column = std::vector<T>;
+
+private:
+  std::array<Column, S> columns;
+  size_t rows = 0;
+
+public:
+  /// Sets the number of rows of every column
+  void resize (size_t n) {
+    for (Column &c: columns)  c.resize(n);
+    rows = n;
+  }
+
+  size_t size (void) const {
+    return rows;
+  }
+
+  Column& operator[] (E e) {
+    return columns[EU::toUnderlying(e)];
+  }
+
+  const Column& operator[] (E e) const {
+    return columns[EU::toUnderlying(e)];
+  }
+
+  Column& operator[] (U i) {
+    return columns[i];
+  }
+
+  const Column& operator[] (U i) const {
+    return columns[i];
+  }
+};
+
 template <typename T, typename F, size_t... Is>
 static auto make_array (F f, std::index_sequence<Is...>)
   -> std::array<T, sizeof...(Is)> {
@@ -120,6 +161,20 @@ using Inputs = std::array<double, A>;
 } // end of namespace functions
 
 using FuncID = functions::ID;
+
+namespace bytecode {
+
+/// Operations of the compiled evaluator (one per function)
+enum class Op : unsigned char {
+  rand,
+  mone, zero, one,
+  id, abs, sq, sqrt, exp, sin, cos, tan, tanh, asin, acos,
+  step, inv, rond, flor, ceil,
+  del, gt, lt, eq, hgss,
+  add, mult, min, max
+};
+
+} // end of namespace bytecode
 } // end of namespace cgp
 
 namespace config {
@@ -203,11 +258,36 @@ class CGP {
   using UsedNodes = std::map<NodeID, uint>;
   UsedNodes usedNodes; /// Maps into node id into data
 
+  /// Straight-line version of the active nodes (see compile())
+  using Slot = uint16_t;
+  static_assert(I+N <= std::numeric_limits<Slot>::max(),
+                "Too many nodes for the bytecode slots");
+
+  struct Instruction {
+    bytecode::Op op;
+    unsigned char arity;
+    Slot node;  ///< Index in nodes (for error messages)
+    Slot out;   ///< Index in persistentData
+    std::array<Slot, A> in; ///< Indices in persistentData (first arity ones)
+  };
+  using Program = std::vector<Instruction>;
+  Program program;
+
+  std::array<Slot, O> outputSlots {};  ///< Indices in persistentData
+
+  /// Number of rows processed at once by the batch evaluation
+  static constexpr uint BLOCK = 64;
+
+  /// Scratch space for the batch evaluation: one block per slot, plus one
+  /// of zeros (for unused operands)
+  std::vector<double> batchData;
+
   using FunctionsMap = std::map<FuncID, Function>;
   static const FunctionsMap functionsMap; // Stateless functions
   FunctionsMap localFunctionsMap;   // Context-dependent (e.g. rand)
   
   static const std::map<FuncID, uint> arities;
+  static const std::map<FuncID, bytecode::Op> opcodes;
 
   struct LatexFormatter {
     using Formatter = std::function<void(std::ostream&)>;
@@ -222,6 +302,9 @@ public:
   using Inputs = utils::enumarray<IEnum, double>;
   using Outputs = utils::enumarray<OEnum, double>;
 
+  using InputColumns = utils::enumcolumns<IEnum, double>;
+  using OutputColumns = utils::enumcolumns<OEnum, double>;
+
   CGP (void) {
     for (Node &n: nodes) {
       n.fid = functions::FID("UINT");
@@ -234,6 +317,7 @@ public:
   CGP (const CGP &that)
     : nodes(that.nodes), outputConnections(that.outputConnections),
       persistentData(that.persistentData), usedNodes(that.usedNodes),
+      program(that.program), outputSlots(that.outputSlots),
       ldice(that.ldice) {
 
     updateReferences();
@@ -276,19 +360,155 @@ public:
     }
 
     persistentData.resize(I+usedNodes.size(), 0);
+    compile();
   }
 
+  /// Runs the compiled active graph (see prepare())
   void evaluate (const Inputs &inputs, Outputs &outputs) {
     std::copy(inputs.begin(), inputs.end(), persistentData.begin());
+    checkInputs(inputs);
+
+    double *data = persistentData.data();
+    std::array<double, A> localInputs;
+    for (const Instruction &i: program) {
+      for (uint j=0; j<i.arity; j++)  localInputs[j] = data[i.in[j]];
+      double &v = data[i.out];
+      v = execute(i.op, localInputs);
+
+      if (checkBounds && (v < -1 || 1 < v))
+        utils::doThrow<std::logic_error>(
+          "Out-of-bounds value: ", nodes[i.node].fid, "(", localInputs, ") = ",
+          v);
+    }
+
+    for (uint o=0; o<O; o++) {
+      if (isActiveOutput(o))
+        outputs[o] = utils::clip(-1., data[outputSlots[o]], 1.);
+      else
+        outputs[o] = 0;
+    }
+
+#ifndef NDEBUG
+    for (double d: persistentData)  assert(!isnan(d));
+#endif
+  }
+
+  /// Evaluates every row of \p inputs into the corresponding row of
+  /// \p outputs, running each instruction over blocks of rows.
+  /// Gives the same outputs (and final state) as calling evaluate() on each
+  /// row in order. Inactive inputs are ignored (zero)
+  void evaluate (const InputColumns &inputs, OutputColumns &outputs) {
+    const uint n = inputs.size();
+    outputs.resize(n);
+
+    Batch batch;
+    beginBatch(n, batch);
+    evaluateRows(inputs, outputs, 0, n, batch, batchData);
+    endBatch(batch);
+  }
+
+  /// State of a batch evaluation split into row ranges (see evaluateRows())
+  struct Batch {
+    std::vector<double> randoms;  ///< Values of the rand nodes (row-major)
+    Data state;                   ///< Slots of the last row
+  };
+
+  /// Prepares the evaluation of \p rows rows by drawing their random values
+  /// (in the same order as row-wise evaluations)
+  void beginBatch (uint rows, Batch &batch) {
+    batch.randoms.clear();
+    batch.state.clear();
+    if (!stateful())  return;
+    for (uint r=0; r<rows; r++)
+      for (const Instruction &i: program)
+        if (i.op == bytecode::Op::rand) batch.randoms.push_back(ldice(-1., 1.));
+  }
+
+  /// Evaluates rows [\p begin, \p end[ of \p inputs into \p outputs (already
+  /// sized). Leaves the CGP untouched so that disjoint ranges of the same
+  /// batch can be evaluated concurrently (each with its own \p scratch)
+  void evaluateRows (const InputColumns &inputs, OutputColumns &outputs,
+                     uint begin, uint end, Batch &batch,
+                     std::vector<double> &scratch) const {
+    const uint n = inputs.size();
+    const uint randoms = n > 0 ? batch.randoms.size() / n : 0;
+
+    const uint slots = I + usedNodes.size();
+    scratch.resize((slots + 1) * BLOCK);
+    const auto column = [&scratch] (uint s) {
+      return scratch.data() + s*BLOCK;
+    };
+    const double *zeros = column(slots);
+    std::fill_n(column(slots), BLOCK, 0.);
+
+    for (uint b=begin; b<end; b+=BLOCK) {
+      const uint m = std::min(BLOCK, end-b);
 
-    if (checkBounds) {
       for (uint i=0; i<I; i++) {
-        if (inputs[i] < -1 || 1 < inputs[i])
-          utils::doThrow<std::logic_error>(
-            "Out-of-bounds value ", inputs[i], " for input ",
-            IUtils::getName(i));
+        double *c = column(i);
+        if (isActiveInput(i))
+              std::copy_n(inputs[i].begin()+b, m, c);
+        else  std::fill_n(c, m, 0.);
+      }
+      for (uint r=0; r<m; r++)  checkInputs(inputs, b+r);
+
+      uint k = 0;
+      for (const Instruction &i: program) {
+        double *out = column(i.out);
+        if (i.op == bytecode::Op::rand) {
+          for (uint r=0; r<m; r++)  out[r] = batch.randoms[(b+r)*randoms + k];
+          k++;
+        }
+
+        std::array<const double*, A> in;
+        for (uint j=0; j<A; j++)
+          in[j] = (j < i.arity) ? column(i.in[j]) : zeros;
+        execute(i.op, in, out, m);
+
+        if (checkBounds)
+          for (uint r=0; r<m; r++)
+            if (out[r] < -1 || 1 < out[r]) {
+              std::array<double, A> localInputs;
+              for (uint j=0; j<A; j++)  localInputs[j] = in[j][r];
+              utils::doThrow<std::logic_error>(
+                "Out-of-bounds value: ", nodes[i.node].fid, "(", localInputs,
+                ") = ", out[r]);
+            }
+      }
+
+      for (uint o=0; o<O; o++) {
+        auto it = outputs[o].begin()+b;
+        if (isActiveOutput(o)) {
+          const double *c = column(outputSlots[o]);
+          for (uint r=0; r<m; r++)  it[r] = utils::clip(-1., c[r], 1.);
+        } else
+          std::fill_n(it, m, 0.);
+      }
+
+#ifndef NDEBUG
+      for (uint s=0; s<slots; s++)
+        for (uint r=0; r<m; r++)  assert(!isnan(column(s)[r]));
+#endif
+
+      // Only the range holding the last row provides the final state
+      if (b+m == n) {
+        batch.state.resize(slots);
+        for (uint s=0; s<slots; s++)  batch.state[s] = column(s)[m-1];
       }
     }
+  }
+
+  /// Leaves the persistent data as the row-wise evaluation would
+  void endBatch (const Batch &batch) {
+    if (batch.state.empty())  return;
+    std::copy(batch.state.begin(), batch.state.end(), persistentData.begin());
+  }
+
+  /// Reference implementation of evaluate(), walking the graph and calling
+  /// each node through its function object
+  void evaluateReference (const Inputs &inputs, Outputs &outputs) {
+    std::copy(inputs.begin(), inputs.end(), persistentData.begin());
+    checkInputs(inputs);
 
     std::array<double, A> localInputs;
     for (const auto &p: usedNodes) {
@@ -451,6 +671,63 @@ public:
     return oss.str();
   }
 
+  /// Writes the active graph as a straight-line C++ function \p name, for
+  /// ahead-of-time specialization of a fixed controller.
+  /// The function takes the raw inputs and outputs as arrays (and a dice
+  /// if the graph uses rand) and gives the same outputs as evaluate() (albeit
+  /// without bound checks). The generated code requires this header
+  void toCpp (std::ostream &os, const std::string &name) const {
+    using functions::operator<<;
+
+    const auto slot = [] (Slot s) {
+      std::ostringstream oss;
+      if (s < I)  oss << "inputs[" << s << "]";
+      else        oss << "d" << s;
+      return oss.str();
+    };
+
+    os << "// Generated by cgp::CGP<" << I << ", " << N << ", " << O << ", "
+       << A << ">::toCpp\n";
+    if (stateful()) os << "template <typename Dice>\n";
+    os << "inline void " << name << " (const std::array<double, " << I
+       << "> &inputs,\n" << std::string(name.size()+14, ' ')
+       << "std::array<double, " << O << "> &outputs";
+    if (stateful()) os << ", Dice &dice";
+    os << ") {\n"
+          "  using namespace cgp::functions;\n";
+
+    for (const Instruction &i: program) {
+      const FuncID &fid = nodes[i.node].fid;
+      os << "  const double " << slot(i.out) << " = ";
+      if (i.op == bytecode::Op::rand) {
+        os << "dice(-1., 1.);";
+
+      } else {
+        switch (int(arities.at(fid))) {
+        case 0:   os << "oary";   break;
+        case 1:   os << "unary";  break;
+        case 2:   os << "binary"; break;
+        default:  os << "nary";   break;
+        }
+        os << "::" << toString(fid) << "<" << A << ">({";
+        for (uint j=0; j<A; j++)
+          os << (j > 0 ? ", " : " ") << (j < i.arity ? slot(i.in[j]) : "0.");
+        os << " });";
+      }
+      os << " // " << fid << "\n";
+    }
+
+    for (uint o=0; o<O; o++) {
+      os << "  outputs[" << o << "] = ";
+      if (isActiveOutput(o))
+        os << "utils::clip(-1., " << slot(outputSlots[o]) << ", 1.);";
+      else
+        os << "0;";
+      os << " // " << OUtils::getName(o, false) << "\n";
+    }
+    os << "}\n";
+  }
+
   enum DotOptions {
     DEFAULT = 0,
     FULL = 1<<1,
@@ -641,6 +918,7 @@ public:
     cgp.usedNodes = j[i++].get<UsedNodes>();
 
     cgp.registerLocalFunctions();
+    cgp.compile();
   }
 
 private:
@@ -703,9 +981,74 @@ private:
     swap(lhs.outputConnections, rhs.outputConnections);
     swap(lhs.persistentData, rhs.persistentData);
     swap(lhs.usedNodes, rhs.usedNodes);
+    swap(lhs.program, rhs.program);
+    swap(lhs.outputSlots, rhs.outputSlots);
     swap(lhs.ldice, rhs.ldice);
   }
 
+  /// Lowers the active nodes (see prepare()) into a flat instruction array
+  /// whose operands directly index persistentData
+  void compile (void) {
+    const auto slot = [this] (Connection c) {
+      return Slot(isInput(c) ? uint(c) : usedNodes.at(toNodeID(c)));
+    };
+
+    program.clear();
+    program.reserve(usedNodes.size());
+    for (const auto &p: usedNodes) {
+      const Node &n = nodes[p.first];
+      Instruction i;
+      i.op = opcodes.at(n.fid);
+      i.arity = arity(n);
+      i.node = p.first;
+      i.out = p.second;
+      i.in.fill(0);
+      for (uint j=0; j<i.arity; j++)  i.in[j] = slot(n.connections[j]);
+      program.push_back(i);
+    }
+
+    for (uint o=0; o<O; o++)
+      outputSlots[o] = isActiveOutput(o) ? slot(outputConnections[o]) : 0;
+  }
+
+  /// Applies \p op to \p inputs with the exact same code as the function
+  /// objects
+  double execute (bytecode::Op op, const functions::Inputs<A> &inputs);
+
+  /// Applies \p op to the first \p n rows of columns \p inputs into \p out
+  /// (rand values are drawn beforehand, see beginBatch())
+  static void execute (bytecode::Op op,
+                       const std::array<const double*, A> &inputs,
+                       double *out, uint n);
+
+  /// Whether the program uses context-dependent functions
+  bool stateful (void) const {
+    for (const Instruction &i: program)
+      if (i.op == bytecode::Op::rand) return true;
+    return false;
+  }
+
+  static void checkInputs (const Inputs &inputs) {
+    if (!checkBounds) return;
+    for (uint i=0; i<I; i++) {
+      if (inputs[i] < -1 || 1 < inputs[i])
+        utils::doThrow<std::logic_error>(
+          "Out-of-bounds value ", inputs[i], " for input ",
+          IUtils::getName(i));
+    }
+  }
+
+  static void checkInputs (const InputColumns &inputs, uint r) {
+    if (!checkBounds) return;
+    for (uint i=0; i<I; i++) {
+      if (!isActiveInput(i))  continue;
+      double v = inputs[i][r];
+      if (v < -1 || 1 < v)
+        utils::doThrow<std::logic_error>(
+          "Out-of-bounds value ", v, " for input ", IUtils::getName(i));
+    }
+  }
+
   void updateReferences (void) {
     registerLocalFunctions();
     for (Node &n: nodes) {
@@ -1009,6 +1352,127 @@ const std::map<FuncID, uint> CGP<IE,N,OE,A>::arities {
 #undef AR
 };
 
+template <typename IE, uint N, typename OE, uint A>
+const std::map<FuncID, bytecode::Op> CGP<IE,N,OE,A>::opcodes {
+#define OP(X) std::make_pair(functions::FID(#X), bytecode::Op::X)
+  OP(rand),
+  OP(mone), OP(zero), OP(one),
+  OP(id),   OP(abs),  OP(sq),   OP(sqrt), OP(exp),
+  OP(sin),  OP(cos),  OP(tan),  OP(tanh), OP(asin),  OP(acos),
+  OP(step), OP(inv),  OP(rond), OP(flor), OP(ceil),
+  OP(del),  OP(gt),   OP(lt),   OP(eq),   OP(hgss),
+  OP(add),  OP(mult), OP(min),  OP(max)
+#undef OP
+};
+
+template <typename IE, uint N, typename OE, uint A>
+double CGP<IE,N,OE,A>::execute (bytecode::Op op,
+                                const functions::Inputs<A> &inputs) {
+  using bytecode::Op;
+  switch (op) {
+#define CASE(ARITY, X) case Op::X: return functions::ARITY::X<A>(inputs);
+  case Op::rand:  return ldice(-1., 1.);
+  CASE(oary, mone)  CASE(oary, zero)  CASE(oary, one)
+  CASE(unary, id)   CASE(unary, abs)  CASE(unary, sq)   CASE(unary, sqrt)
+  CASE(unary, exp)  CASE(unary, sin)  CASE(unary, cos)  CASE(unary, tan)
+  CASE(unary, tanh) CASE(unary, asin) CASE(unary, acos) CASE(unary, step)
+  CASE(unary, inv)  CASE(unary, rond) CASE(unary, flor) CASE(unary, ceil)
+  CASE(binary, del) CASE(binary, gt)  CASE(binary, lt)  CASE(binary, eq)
+  CASE(binary, hgss)
+  CASE(nary, add)   CASE(nary, mult)  CASE(nary, min)   CASE(nary, max)
+#undef CASE
+  }
+  utils::doThrow<std::logic_error>("Invalid opcode ", int(op));
+  return 0;
+}
+
+template <typename IE, uint N, typename OE, uint A>
+void CGP<IE,N,OE,A>::execute (bytecode::Op op,
+                              const std::array<const double*, A> &inputs,
+                              double *out, uint n) {
+  using bytecode::Op;
+
+  // Arithmetic and comparison operators work on whole columns, in the same
+  // order as their scalar counterparts (same results)
+  const double *x = inputs[0], *y = inputs[1];
+  switch (op) {
+  case Op::rand:  return;  // Already drawn
+  case Op::mone:  std::fill_n(out, n, -1.); return;
+  case Op::zero:  std::fill_n(out, n, 0.);  return;
+  case Op::one:   std::fill_n(out, n, 1.);  return;
+
+  case Op::id:    std::copy_n(x, n, out);   return;
+  case Op::abs:
+    for (uint r=0; r<n; r++)  out[r] = std::fabs(x[r]);
+    return;
+  case Op::sq:
+    for (uint r=0; r<n; r++)  out[r] = x[r] * x[r];
+    return;
+  case Op::inv:
+    for (uint r=0; r<n; r++)
+      out[r] = (x[r] == 0) ? 0 : utils::clip(-1., 1./x[r], 1.);
+    return;
+
+  case Op::del:
+    for (uint r=0; r<n; r++)  out[r] = (x[r] - y[r]) / 2.;
+    return;
+  case Op::gt:
+    for (uint r=0; r<n; r++)  out[r] = x[r] > y[r];
+    return;
+  case Op::lt:
+    for (uint r=0; r<n; r++)  out[r] = x[r] < y[r];
+    return;
+  case Op::eq:
+    for (uint r=0; r<n; r++)  out[r] = x[r] == y[r];
+    return;
+
+  case Op::add:
+    std::fill_n(out, n, 0.);
+    for (uint j=0; j<A; j++)
+      for (uint r=0; r<n; r++)  out[r] += inputs[j][r];
+    for (uint r=0; r<n; r++)  out[r] /= A;
+    return;
+  case Op::mult:
+    std::fill_n(out, n, 1.);
+    for (uint j=0; j<A; j++)
+      for (uint r=0; r<n; r++)  out[r] *= inputs[j][r];
+    return;
+  case Op::min:
+    std::copy_n(x, n, out);
+    for (uint j=1; j<A; j++)
+      for (uint r=0; r<n; r++)  out[r] = std::min(out[r], inputs[j][r]);
+    return;
+  case Op::max:
+    std::copy_n(x, n, out);
+    for (uint j=1; j<A; j++)
+      for (uint r=0; r<n; r++)  out[r] = std::max(out[r], inputs[j][r]);
+    return;
+
+  default:  break;
+  }
+
+  // Remaining (library) functions are applied row by row
+  const auto row = [&inputs] (uint r) {
+    functions::Inputs<A> values;
+    for (uint j=0; j<A; j++)  values[j] = inputs[j][r];
+    return values;
+  };
+
+  switch (op) {
+#define CASE(ARITY, X) \
+  case Op::X: \
+    for (uint r=0; r<n; r++)  out[r] = functions::ARITY::X<A>(row(r)); \
+    break;
+  CASE(unary, sqrt) CASE(unary, exp)  CASE(unary, sin)  CASE(unary, cos)
+  CASE(unary, tan)  CASE(unary, tanh) CASE(unary, asin) CASE(unary, acos)
+  CASE(unary, step) CASE(unary, rond) CASE(unary, flor) CASE(unary, ceil)
+  CASE(binary, hgss)
+#undef CASE
+  default:
+    utils::doThrow<std::logic_error>("Invalid opcode ", int(op));
+  }
+}
+
 template <typename IE, uint N, typename OE, uint A>
 const typename CGP<IE,N,OE,A>::LatexFormatter
 CGP<IE,N,OE,A>::defaultLatexFormatter {
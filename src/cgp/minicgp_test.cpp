@@ -1,3 +1,6 @@
+#include <chrono>
+#include <cstring>
+
 #include "kgd/external/cxxopts.hpp"
 
 #include "minicgp.h"
@@ -34,6 +37,128 @@ void showCGP (std::string label, const CGP &cgp) {
       std::cout << "Generated file." << std::endl;
   }
 
+  std::ofstream cppfs (label + ".cpp");
+  cgp.toCpp(cppfs, label);
+}
+
+/// Compares the throughput of the compiled (row-wise, batch and concurrent
+/// chunks) evaluators with that of the reference implementation and checks
+/// that all give the exact same outputs and final state
+bool benchmark (const CGP &cgp, rng::AbstractDice &dice, uint evaluations) {
+  using IUtils = EnumUtils<TestCGPInputs>;
+  using OUtils = EnumUtils<TestCGPOutputs>;
+  std::bitset<IUtils::size()> activeInputs;
+  for (uint i=0; i<IUtils::size(); i++)
+    activeInputs.set(i, config::CGP::isActiveInput(i));
+  std::bitset<OUtils::size()> activeOutputs;
+  for (uint o=0; o<OUtils::size(); o++)
+    activeOutputs.set(o, config::CGP::isActiveOutput(o));
+
+  CGP::InputColumns inputs;
+  inputs.resize(evaluations);
+  for (uint e=0; e<evaluations; e++)
+    for (uint i=0; i<IUtils::size(); i++)
+      inputs[i][e] = activeInputs.test(i) ? dice(-1., 1.) : 0;
+
+  using Clock = std::chrono::high_resolution_clock;
+  const auto duration = [] (Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+
+  // Outputs are stored row-wise
+  const auto rowWise = [&] (CGP &instance, bool reference,
+                            std::vector<double> &results) {
+    CGP::Inputs in (activeInputs, 0);
+    CGP::Outputs out (activeOutputs, 0);
+    results.clear();
+    results.reserve(evaluations * OUtils::size());
+
+    auto start = Clock::now();
+    for (uint e=0; e<evaluations; e++) {
+      for (uint i=0; i<IUtils::size(); i++)  in[i] = inputs[i][e];
+      if (reference)
+            instance.evaluateReference(in, out);
+      else  instance.evaluate(in, out);
+      results.insert(results.end(), out.begin(), out.end());
+    }
+    return duration(start);
+  };
+
+  const auto batch = [&] (CGP &instance, std::vector<double> &results) {
+    CGP::OutputColumns out;
+    auto start = Clock::now();
+    instance.evaluate(inputs, out);
+    double t = duration(start);
+
+    results.clear();
+    for (uint e=0; e<evaluations; e++)
+      for (uint o=0; o<OUtils::size(); o++) results.push_back(out[o][e]);
+    return t;
+  };
+
+  // Same as above with rows split into chunks evaluated concurrently (as
+  // the environment does)
+  const auto chunked = [&] (CGP &instance, std::vector<double> &results) {
+    static constexpr uint CHUNK = 37; // Not aligned on the batch blocks
+    const int chunks = (evaluations + CHUNK - 1) / CHUNK;
+
+    CGP::OutputColumns out;
+    out.resize(evaluations);
+    CGP::Batch b;
+
+    auto start = Clock::now();
+    instance.beginBatch(evaluations, b);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      std::vector<double> scratch;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (int c=chunks-1; c>=0; c--)
+        instance.evaluateRows(inputs, out, c * CHUNK,
+                              std::min(evaluations, (c+1) * CHUNK), b,
+                              scratch);
+    }
+    instance.endBatch(b);
+    double t = duration(start);
+
+    results.clear();
+    for (uint e=0; e<evaluations; e++)
+      for (uint o=0; o<OUtils::size(); o++) results.push_back(out[o][e]);
+    return t;
+  };
+
+  CGP reference = cgp, compiled = cgp, batched = cgp, split = cgp;
+  std::vector<double> referenceResults, compiledResults, batchResults,
+                      splitResults;
+  double tr = rowWise(reference, true, referenceResults);
+  double tc = rowWise(compiled, false, compiledResults);
+  double tb = batch(batched, batchResults);
+  double ts = chunked(split, splitResults);
+
+  const auto same = [&referenceResults] (const std::vector<double> &results) {
+    return results.size() == referenceResults.size()
+        && 0 == std::memcmp(referenceResults.data(), results.data(),
+                            results.size() * sizeof(double));
+  };
+  bool ok = same(compiledResults) && same(batchResults)
+         && same(splitResults)
+         && reference == compiled && reference == batched
+         && batched == split;
+
+  std::cout << "Evaluated " << evaluations << " inputs:"
+            << "\n\treference: " << evaluations / tr << " evals/s"
+            << "\n\t compiled: " << evaluations / tc << " evals/s"
+            << " (x" << tr / tc << ")"
+            << "\n\t    batch: " << evaluations / tb << " evals/s"
+            << " (x" << tr / tb << ")"
+            << "\n\t  chunked: " << evaluations / ts << " evals/s"
+            << " (x" << tr / ts << ")"
+            << "\n\tOutputs are " << (ok ? "identical" : "DIFFERENT")
+            << std::endl;
+  return ok;
 }
 
 int main (int argc, char *argv[]) {
@@ -45,6 +170,8 @@ int main (int argc, char *argv[]) {
   std::string configFile = "auto";  // Default to auto-config
   Verbosity verbosity = Verbosity::SHOW;
 
+  uint evaluations = 100000;
+
   cxxopts::Options options("MiniCGP-tester",
                            "Tests that MiniCGP implementation is correct");
   options.add_options()
@@ -54,6 +181,8 @@ int main (int argc, char *argv[]) {
      cxxopts::value(configFile))
     ("v,verbosity", "Verbosity level. " + config::verbosityValues(),
      cxxopts::value(verbosity))
+    ("b,benchmark", "Number of evaluations for the throughput benchmark",
+     cxxopts::value(evaluations))
     ;
 
   auto result = options.parse(argc, argv);
@@ -78,8 +207,8 @@ int main (int argc, char *argv[]) {
   showCGP("null", cgp);
 
   uint N = 100;
-  CGP mutated = cgp.clone();
-  assertEqual(cgp, mutated);
+  CGP mutated = cgp;
+  assertEqual(cgp, mutated, true);
 
   uint n = 0;
   for (uint i=0; i<N; i++) {
@@ -95,5 +224,7 @@ int main (int argc, char *argv[]) {
     showCGP(oss.str(), mutated);
   }
 
+  if (!benchmark(mutated, dice, evaluations)) return 1;
+
   return 0;
 }
@@ -14,12 +14,32 @@ DEFINE_PARAMETER(int, verbosity, 1)
 DEFINE_PARAMETER(bool, allowEmptySimulation, false)
 
 DEFINE_PARAMETER(uint, saveEvery, 1)
+DEFINE_PARAMETER(bool, asyncSaves, true)
+DEFINE_PARAMETER(uint, saveKeyframeEvery, 1)
+DEFINE_PARAMETER(bool, binarySaves, false)
+
+DEFINE_PARAMETER(bool, binaryVoxelLogs, false)
+DEFINE_PARAMETER(uint, voxelLogStride, 1)
+DEFINE_PARAMETER(uint, voxelLogBatch, 100)
+DEFINE_PARAMETER(uint, profileEvery, 0)
+DEFINE_PARAMETER(bool, profileTrace, false)
 
 DEFINE_PARAMETER(uint, initSeeds, 100)
 DEFINE_PARAMETER(uint, stepsPerDay, 10)
 DEFINE_PARAMETER(uint, daysPerYear, 100)
 DEFINE_PARAMETER(bool, taurusWorld, false)
 
+DEFINE_PARAMETER(bool, parallelStep, false)
+DEFINE_PARAMETER(uint, stepThreads, 0)
+DEFINE_PARAMETER(bool, parallelEnvironment, false)
+DEFINE_PARAMETER(uint, envChunkSize, 256)
+DEFINE_PARAMETER(float, stepStripWidth, 10)
+DEFINE_PARAMETER(bool, counterRNG, false)
+
+DEFINE_PARAMETER(bool, gridBroadphase, false)
+DEFINE_PARAMETER(float, broadphaseCellWidth, 2)
+DEFINE_PARAMETER(bool, collisionMemo, false)
+
 DEFINE_PARAMETER(bool, killSeedsEarly, true)
 
 DEFINE_PARAMETER(float, assimilationRate, .01)
@@ -43,6 +63,8 @@ DEFINE_PARAMETER(float, temperatureMaxRange, 10)
 DEFINE_PARAMETER(float, temperatureRangePenalty, 10)
 
 DEFINE_PARAMETER(uint, updateTopologyEvery, 10)
+DEFINE_PARAMETER(uint, envUpdatePeriod, 1)
+DEFINE_PARAMETER(bool, envUpdateValidation, false)
 DEFINE_PARAMETER(float, heightPenaltyStddev, 1)
 
 DEFINE_DEBUG_PARAMETER(bool, DEBUG_NO_METABOLISM, false)
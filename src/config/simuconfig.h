@@ -19,11 +19,31 @@ struct CONFIG_FILE(Simulation) {
 
   DECLARE_PARAMETER(uint, initSeeds)
   DECLARE_PARAMETER(uint, saveEvery)
+  DECLARE_PARAMETER(bool, asyncSaves)
+  DECLARE_PARAMETER(uint, saveKeyframeEvery)
+  DECLARE_PARAMETER(bool, binarySaves)
+
+  DECLARE_PARAMETER(bool, binaryVoxelLogs)
+  DECLARE_PARAMETER(uint, voxelLogStride)
+  DECLARE_PARAMETER(uint, voxelLogBatch)
+  DECLARE_PARAMETER(uint, profileEvery)   // 0 to disable
+  DECLARE_PARAMETER(bool, profileTrace)
 
   DECLARE_PARAMETER(uint, stepsPerDay)
   DECLARE_PARAMETER(uint, daysPerYear)
   DECLARE_PARAMETER(bool, taurusWorld)
 
+  DECLARE_PARAMETER(bool, parallelStep)
+  DECLARE_PARAMETER(uint, stepThreads)    // 0 for all available
+  DECLARE_PARAMETER(bool, parallelEnvironment)
+  DECLARE_PARAMETER(uint, envChunkSize)   // In voxels
+  DECLARE_PARAMETER(float, stepStripWidth) // Part of the schedule
+  DECLARE_PARAMETER(bool, counterRNG)     // Also steps on strips if serial
+
+  DECLARE_PARAMETER(bool, gridBroadphase)
+  DECLARE_PARAMETER(float, broadphaseCellWidth)
+  DECLARE_PARAMETER(bool, collisionMemo)
+
   DECLARE_PARAMETER(bool, killSeedsEarly)
 
   DECLARE_PARAMETER(float, assimilationRate)
@@ -41,6 +61,8 @@ struct CONFIG_FILE(Simulation) {
   DECLARE_PARAMETER(float, temperatureRangePenalty) // stddev
 
   DECLARE_PARAMETER(uint, updateTopologyEvery)  // In tics
+  DECLARE_PARAMETER(uint, envUpdatePeriod)      // In tics (interpolated)
+  DECLARE_PARAMETER(bool, envUpdateValidation)
   DECLARE_PARAMETER(float, heightPenaltyStddev)
 
   DECLARE_DEBUG_PARAMETER(bool, DEBUG_NO_METABOLISM, false)
@@ -74,8 +74,8 @@ void GenePool::parse (const Simulation &s) {
   auto start = Simulation::clock::now();
 
   histograms.clear();
-  for (const auto &p: s.plants())
-    addGenome(histograms, p.second->genome());
+  for (const simu::Plant *p: s.plants())
+    addGenome(histograms, p->genome());
 
   float N = s.plants().size();
   for (auto &hist: histograms) for (auto &bin: hist.second) bin.second /= N;
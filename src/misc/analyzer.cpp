@@ -25,26 +25,46 @@ void finalCounts (const Simulation &simu) {
 void extractField (const Simulation &simu,
                    const std::vector<std::string> &fields) {
 //  std::cout << "Extracting field '" << field << "'..." << std::endl;
-  for (const auto &pair: simu.plants()) {
+  for (const auto &l: simu.plants().byPosition()) {
+    const simu::Plant *p = l.plant;
     for (const auto &field: fields) {
       if (field == ".morphology")
         std::cout << field << ".shoot: "
-                  << pair.second->toString(simu::Plant::Layer::SHOOT) << "\n"
+                  << p->toString(simu::Plant::Layer::SHOOT) << "\n"
                   << field << ".root: "
-                  << pair.second->toString(simu::Plant::Layer::ROOT) << "\n";
+                  << p->toString(simu::Plant::Layer::ROOT) << "\n";
 
       else if (field == ".boundingBox")
-        std::cout << field << ": " << pair.second->translatedBoundingRect()
+        std::cout << field << ": " << p->translatedBoundingRect()
                   << "\n";
 
       else
-        std::cout << field << ": " << pair.second->genome().getField(field)
+        std::cout << field << ": " << p->genome().getField(field)
                   << "\n";
     }
   }
   std::cout << std::endl;
 }
 
+/// Whether \p fields can be extracted from the genomes alone
+bool genomicFields (const std::vector<std::string> &fields) {
+  for (const auto &field: fields)
+    if (field == ".morphology" || field == ".boundingBox")
+      return false;
+  return true;
+}
+
+/// Same as extractField but streams genomes directly from the save file
+void streamFields (const stdfs::path &file, const std::string &constraints,
+                   const std::vector<std::string> &fields) {
+  Simulation::forEachGenome(file, constraints,
+                            [&fields] (const simu::Plant::Genome &g) {
+    for (const auto &field: fields)
+      std::cout << field << ": " << g.getField(field) << "\n";
+  });
+  std::cout << std::endl;
+}
+
 stdfs::path replaceFullExtension (const stdfs::path &p, const std::string &ext) {
   stdfs::path out = p.parent_path();
   stdfs::path stem = p.filename();
@@ -60,8 +80,8 @@ void plotSpeciesRanges (const Simulation &simu, const stdfs::path &savefile) {
     uint count = 0;
   };
   std::map<SID, Range> ranges;
-  for (const auto &pair: simu.plants()) {
-    simu::Plant &p = *pair.second;
+  for (const simu::Plant *plant: simu.plants()) {
+    const simu::Plant &p = *plant;
     Range &r = ranges[p.species()];
     const simu::Rect b = p.boundingRect().translated(p.pos());
     if (b.l() < r.min)  r.min = b.l();
@@ -121,8 +141,8 @@ void plotDensityHistogram (const Simulation &simu, const stdfs::path &savefile)
   const float plantCount = simu.plants().size();
   std::map<SID, uint> counts;
   const auto &phylogeny = simu.phylogeny();
-  for (const auto &p: simu.plants())
-    counts[p.second->species()]++;
+  for (const simu::Plant *p: simu.plants())
+    counts[p->species()]++;
 
   std::set<Count> sortedCounts;
   for (auto &p: counts) sortedCounts.insert({p.first, p.second});
@@ -187,17 +207,18 @@ void compatibilityMatrix (const Simulation &simu, const std::string &sidList) {
   uint i = 0, total = simu.plants().size();
   std::map<SID, std::set<genotype::BOCData::Sex>> sexes;
   std::map<SID, std::vector<const simu::Plant*>> species;
-  for (const auto &p: simu.plants()) {
+  for (const auto &l: simu.plants().byPosition()) {
+    const simu::Plant *p = l.plant;
     std::cout << "[" << std::setw(3) << 100 * (++i) / total
-              << "%] Examining GID: " << p.second->id() << std::flush;
+              << "%] Examining GID: " << p->id() << std::flush;
 
-    SID sid = p.second->species();
+    SID sid = p->species();
     std::cout << " (SID: " << sid << ") ...\r" << std::flush;
 
     if (fullMatrix || sids.find(sid) != sids.end())
-      species[sid].push_back(p.second.get());
+      species[sid].push_back(p);
     if (fullMatrix) sids.insert(sid);
-    sexes[sid].insert(p.second->sex());
+    sexes[sid].insert(p->sex());
   }
 
   std::set<SID> ignoredSpecies;
@@ -304,8 +325,8 @@ void computeFlowerRobustnessScore (const Simulation &s, char /*type*/) {
   Scores globalScores {0};
   uint validPlants = 0;
 
-  for (auto &ppair: s.plants()) {
-    const simu::Plant &p = *ppair.second;
+  for (const auto &l: s.plants().byPosition()) {
+    const simu::Plant &p = *l.plant;
 
     if (p.isInSeedState())    continue;
     if (p.flowers().empty())  continue;
@@ -418,6 +439,17 @@ int main (int argc, char *argv[]) {
   // ===========================================================================
   // == Core setup
 
+  // Only genomic fields requested: no need to rebuild the simulation
+  bool onlyGenomes = !viewFields.empty() && genomicFields(viewFields)
+                  && !doFinalCounts && !doSpeciesRanges && !doDensityHistogram
+                  && !result.count("compatibility-matrix")
+                  && flowerMarkingType == '\0'
+                  && popOutFile.empty() && ptreeOutFile.empty();
+  if (onlyGenomes) {
+    streamFields(loadSaveFile, loadConstraints, viewFields);
+    return 0;
+  }
+
   Simulation s;
 
   Simulation::load(loadSaveFile, s, loadConstraints, loadFields);
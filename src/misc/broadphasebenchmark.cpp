@@ -0,0 +1,116 @@
+#include "kgd/external/cxxopts.hpp"
+
+#include "../simu/simulation.h"
+
+/// Runs the same simulation with the sweep-and-prune and the grid broadphases
+/// and compares their step times (and final populations)
+
+using Simulation = simu::Simulation;
+using SConfig = config::Simulation;
+using clock = std::chrono::high_resolution_clock;
+
+bool isValidSeed(const std::string& s) {
+  return !s.empty()
+    && std::all_of(s.begin(), s.end(),
+                   [](char c) { return std::isdigit(c); });
+}
+
+struct Timings {
+  double total = 0, max = 0;
+  uint steps = 0;
+  size_t plants = 0;
+};
+
+int main (int argc, char *argv[]) {
+  // ===========================================================================
+  // == Command line arguments parsing
+
+  std::string configFile = "auto";
+  std::string envGenomeArg = "0", plantGenomeArg = "0";
+  uint seeds = 1000, steps = 1000;
+  float cellWidth = -1;
+
+  cxxopts::Options options("ReusWorld (broadphase benchmark)",
+                           "Compares the sweep-and-prune and grid broadphases"
+                           " on identical dense populations");
+  options.add_options()
+    ("h,help", "Display help")
+    ("c,config", "File containing configuration data",
+     cxxopts::value(configFile))
+    ("e,environment", "Environment's genome or a random seed",
+     cxxopts::value(envGenomeArg))
+    ("p,plant", "Plant genome to start from or a random seed",
+     cxxopts::value(plantGenomeArg))
+    ("seeds", "Number of initial seeds", cxxopts::value(seeds))
+    ("steps", "Number of steps to simulate", cxxopts::value(steps))
+    ("cell-width", "Width of the grid's cells (defaults to the configuration)",
+     cxxopts::value(cellWidth))
+    ;
+
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+
+  SConfig::setupConfig(configFile, config::Verbosity::QUIET);
+  SConfig::verbosity.ref() = 0;
+  SConfig::initSeeds.ref() = seeds;
+  if (cellWidth > 0)  SConfig::broadphaseCellWidth.ref() = cellWidth;
+
+  genotype::Environment envGenome;
+  if (isValidSeed(envGenomeArg)) {
+    rng::FastDice dice (std::stoi(envGenomeArg));
+    envGenome = genotype::Environment::random(dice);
+  } else
+    envGenome = genotype::Environment::fromFile(envGenomeArg);
+
+  genotype::Plant plantGenome;
+  if (isValidSeed(plantGenomeArg)) {
+    rng::FastDice dice (std::stoi(plantGenomeArg));
+    plantGenome = genotype::Plant::random(dice);
+  } else
+    plantGenome = genotype::Plant::fromFile(plantGenomeArg);
+
+  // ===========================================================================
+  // == Runs
+
+  std::array<Simulation, 2> simulations;
+  std::array<Timings, 2> timings;
+  for (uint i=0; i<2; i++) {
+    SConfig::gridBroadphase.ref() = (i == 1);
+
+    Simulation &s = simulations[i];
+    Timings &t = timings[i];
+    s.init(envGenome, plantGenome);
+
+    for (uint j=0; j<steps && !s.extinct(); j++) {
+      auto start = clock::now();
+      s.step();
+      double d = std::chrono::duration<double, std::milli>(
+                   clock::now() - start).count();
+      t.total += d;
+      t.max = std::max(t.max, d);
+      t.steps++;
+    }
+    t.plants = s.plants().size();
+  }
+
+  std::cout << "Backend Steps Plants Total(ms) Mean(ms) Max(ms)\n";
+  for (uint i=0; i<2; i++) {
+    const Timings &t = timings[i];
+    std::cout << (i == 0 ? "sap" : "grid") << " " << t.steps << " "
+              << t.plants << " " << t.total << " " << t.total / t.steps
+              << " " << t.max << "\n";
+  }
+  std::cout << "Speedup: " << timings[0].total / timings[1].total
+            << " (cell width: " << SConfig::broadphaseCellWidth() << ")"
+            << std::endl;
+
+  // Both backends must select the same candidates
+  assertEqual(simulations[0].plants(), simulations[1].plants(), true);
+
+  for (Simulation &s: simulations)  s.destroy();
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include "kgd/external/cxxopts.hpp"
+
+#include "../simu/voxellog.h"
+
+using namespace simu::voxellog;
+
+int main (int argc, char *argv[]) {
+  // ===========================================================================
+  // == Command line arguments parsing
+
+  std::string logFile, outputFolder;
+  std::vector<std::string> layerNames;
+
+  cxxopts::Options options("ReusWorld (voxel log converter)",
+                           "Converts a binary voxel log into the text files"
+                           " expected by the plotting scripts");
+  options.add_options()
+    ("h,help", "Display help")
+    ("f,file", "Binary voxel log", cxxopts::value(logFile))
+    ("o,output", "Folder in which to write the <layer>.dat files (defaults"
+                 " to the log's folder)", cxxopts::value(outputFolder))
+    ("l,layers", "Only convert these layers",
+     cxxopts::value(layerNames))
+    ;
+
+  options.parse_positional("file");
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+
+  if (logFile.empty())
+    utils::doThrow<std::invalid_argument>("No voxel log provided");
+
+  stdfs::path folder = outputFolder;
+  if (folder.empty()) folder = stdfs::path(logFile).parent_path();
+
+  // ===========================================================================
+  // == Conversion
+
+  Reader reader (logFile);
+
+  std::vector<std::unique_ptr<std::ofstream>> outputs;
+  for (const LayerInfo &li: reader.layers()) {
+    std::string name (li.name, strnlen(li.name, sizeof(li.name)));
+    if (!layerNames.empty()
+        && std::find(layerNames.begin(), layerNames.end(), name)
+            == layerNames.end()) {
+      outputs.emplace_back();
+      continue;
+    }
+
+    stdfs::path path = folder / (name + ".dat");
+    outputs.emplace_back(std::make_unique<std::ofstream>(path));
+    if (!*outputs.back())
+      utils::doThrow<std::invalid_argument>(
+        "Unable to open ", path, " for writing");
+    std::cout << "Writing layer " << name << " (" << li.count
+              << " voxels) to " << path << std::endl;
+  }
+
+  uint rows = 0;
+  uint32_t timestamp;
+  std::vector<std::vector<float>> values;
+  while (reader.next(timestamp, values)) {
+    std::string time = reader.pretty(timestamp);
+    for (uint i=0; i<outputs.size(); i++) {
+      if (!outputs[i])  continue;
+      std::ofstream &ofs = *outputs[i];
+      ofs << time;
+      for (float f: values[i])  ofs << " " << f;
+      ofs << "\n";
+    }
+    rows++;
+  }
+
+  std::cout << "Converted " << rows << " rows" << std::endl;
+  return 0;
+}
@@ -50,8 +50,8 @@ bool PVESimulation::finished(void) const {
 void PVESimulation::updateRegions(void) {
   _regions.reset();
   float W = _env.width();
-  for (const auto &p: _plants) {
-    uint r = uint(R * ((p.second->pos().x / W) + .5));
+  for (const Plant *p: _plants) {
+    uint r = uint(R * ((p->pos().x / W) + .5));
     _regions.set(r);
   }
 }
@@ -81,9 +81,9 @@ PVESimulation* PVESimulation::type1PVE (const Parameters &params) {
     std::vector<Plant*> germinated;
 
     // Identify all germinated plants ...
-    for (auto &pair: s._plants)
-      if (!pair.second->isInSeedState())
-        germinated.push_back(pair.second.get());
+    for (const auto &l: s._plants.byPosition())
+      if (!l.plant->isInSeedState())
+        germinated.push_back(l.plant);
 
     // ... and remove then
     for (Plant *p: germinated)
@@ -92,9 +92,8 @@ PVESimulation* PVESimulation::type1PVE (const Parameters &params) {
     // Plant the collected seeds
     s.plantSeeds(newseeds);
 
-    // Copy all remaining plants and delete from source
-    while (!s._plants.empty()) {
-      Plant *p = s._plants.begin()->second.get();
+    // Copy all remaining plants (in x order) and delete from source
+    for (Plant *p: s._plants.sorted()) {
       assert(p->isInSeedState());
       if (!p->starvedSeed())  plants.push_back(pclone(p));
       s.delPlant(*p, newseeds);
@@ -116,10 +115,10 @@ PVESimulation* PVESimulation::type1PVE (const Parameters &params) {
 //    p->updatePosition(.5 * (p->pos().x + -lhs._env.xextent()));
     p->updatePosition(s->_env.xextent() * ((p->pos().x / lhs._env.width()) - .5));
 
-    if (s->_plants.find(p->pos().x) == s->_plants.end()
+    if (!s->_plants.find(p->pos().x)
         && s->_env.addCollisionData(p)) {
 
-      s->_plants.emplace(p->pos().x, Plant_ptr(p));
+      s->_plants.insert(Plant_ptr(p));
 
       if (params.noTopology)  p->updateAltitude(s->_env, 0);
       assert(!p->isDead());
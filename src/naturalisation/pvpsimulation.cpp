@@ -186,9 +186,9 @@ PVESimulation::artificialNaturalisation (const Parameters &params) {
     std::vector<Plant*> germinated;
 
     // Identify all germinated plants ...
-    for (auto &pair: s._plants)
-      if (!pair.second->isInSeedState())
-        germinated.push_back(pair.second.get());
+    for (const auto &l: s._plants.byPosition())
+      if (!l.plant->isInSeedState())
+        germinated.push_back(l.plant);
 
     // ... and remove then
     for (Plant *p: germinated)
@@ -199,10 +199,9 @@ PVESimulation::artificialNaturalisation (const Parameters &params) {
       s._pendingSeeds[seed.genome.id()] = Ratios::fromTag(tag);
     s.plantSeeds(newseeds);
 
-    // Copy all remaining plants and delete from source
+    // Copy all remaining plants (in x order) and delete from source
     s._pendingSeeds.clear();
-    while (!s._plants.empty()) {
-      Plant *p = s._plants.begin()->second.get();
+    for (Plant *p: s._plants.sorted()) {
       assert(p->isInSeedState());
       if (!p->starvedSeed())  plants.push_back({pclone(p), tag});
       s.Simulation::delPlant(*p, newseeds);
@@ -236,8 +235,7 @@ PVESimulation::artificialNaturalisation (const Parameters &params) {
   std::cout<< "Populating LHS\r" << std::flush;
 
   for (const TaggedPlant &tp: rng::randomIterator(plants, lhs._env.dice())) {
-    if (lhs._plants.try_emplace(tp.plant->pos().x,
-                                Plant_ptr(tp.plant)).second
+    if (lhs._plants.insert(Plant_ptr(tp.plant)).isValid()
         && lhs._env.addCollisionData(tp.plant)) {
 
       assert(!tp.plant->isDead());
@@ -278,8 +276,7 @@ PVESimulation::naturalNaturalisation (const Parameters &params) {
     Simulation::load(file, tmp, constraints, "!ptree");
 
     Plant::Seeds discardedseeds;
-    while(!tmp._plants.empty()) {
-      Plant *p = tmp._plants.begin()->second.get();
+    for (Plant *p: tmp._plants.sorted()) {
       plants.push_back({pclone(p), tag});
       tmp.Simulation::delPlant(*p, discardedseeds);
     }
@@ -311,10 +308,10 @@ PVESimulation::naturalNaturalisation (const Parameters &params) {
 
     tp.plant->updatePosition(tp.plant->pos().x + dx);
 
-    if (s->_plants.find(tp.plant->pos().x) == s->_plants.end()
+    if (!s->_plants.find(tp.plant->pos().x)
         && s->_env.addCollisionData(tp.plant)) {
 
-      s->_plants.emplace(tp.plant->pos().x, Plant_ptr(tp.plant));
+      s->_plants.insert(Plant_ptr(tp.plant));
       if (params.noTopology)  tp.plant->updateAltitude(s->_env, 0);
 
       Ratios r = Ratios::fromTag(tp.tag);
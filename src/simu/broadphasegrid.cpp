@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include "kgd/settings/configfile.h"
+
+#include "broadphasegrid.h"
+
+namespace simu {
+namespace physics {
+
+BroadphaseGrid::BroadphaseGrid (float cellWidth)
+  : _width(cellWidth), _origin(0) {
+  if (!(_width > 0))
+    utils::doThrow<std::invalid_argument>(
+      "Invalid broadphase cell width ", _width);
+}
+
+void BroadphaseGrid::cover (int c0, int c1) {
+  if (_cells.empty()) {
+    _origin += c0;
+    _cells.resize(c1 - c0 + 1);
+    return;
+  }
+
+  if (c0 < 0) {
+    _cells.insert(_cells.begin(), -c0, {});
+    _origin += c0;
+    c1 -= c0;
+  }
+  if (c1 >= int(_cells.size()))
+    _cells.resize(c1 + 1);
+}
+
+void BroadphaseGrid::insert (Object o, float l, float r) {
+  cover(cell(l), cell(r));
+  for (int c=cell(l), c1=cell(r); c<=c1; c++)
+    _cells[c].push_back({l, r, o});
+}
+
+void BroadphaseGrid::erase (Object o, float l, float r) {
+  for (int c=clamped(cell(l)), c1=clamped(cell(r)); c<=c1; c++) {
+    auto &entries = _cells[c];
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [o] (const Entry &e) { return e.object == o; });
+    assert(it != entries.end());
+    *it = entries.back();
+    entries.pop_back();
+  }
+}
+
+void BroadphaseGrid::move (Object o, float oldL, float oldR, float l, float r) {
+  if (cell(oldL) == cell(l) && cell(oldR) == cell(r)) {
+    // Same cells: update in place
+    for (int c=cell(l), c1=cell(r); c<=c1; c++)
+      for (Entry &e: _cells[c])
+        if (e.object == o)  e.l = l, e.r = r;
+
+  } else {
+    erase(o, oldL, oldR);
+    insert(o, l, r);
+  }
+}
+
+void BroadphaseGrid::clear (void) {
+  _cells.clear();
+  _origin = 0;
+}
+
+} // end of namespace physics
+} // end of namespace simu
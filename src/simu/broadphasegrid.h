@@ -0,0 +1,88 @@
+#ifndef SIMU_BROADPHASEGRID_H
+#define SIMU_BROADPHASEGRID_H
+
+/// Uniform bucket grid over x for the broadphase (see config::gridBroadphase)
+///
+/// Every object is registered, along with its [l,r] interval, in all the cells
+/// that interval overlaps. Candidates for a query are thus found by scanning
+/// only the corresponding cells' contiguous entries. The grid grows on demand
+/// to cover every inserted interval.
+
+#include <cmath>
+#include <vector>
+
+#include "physicstypes.hpp"
+
+namespace simu {
+namespace physics {
+
+class BroadphaseGrid {
+public:
+  using Object = const CollisionObject*;
+
+  BroadphaseGrid (float cellWidth);
+
+  void insert (Object o, float l, float r);
+  void erase (Object o, float l, float r);
+
+  /// Moves \p o from [\p oldL, \p oldR] to [\p l, \p r]
+  void move (Object o, float oldL, float oldR, float l, float r);
+
+  /// Calls \p f(o, l, r) exactly once for every object whose cells overlap
+  /// those of [\p l, \p r]
+  /// \note This is a superset of the objects intersecting [\p l, \p r]
+  template <typename F>
+  void forEach (float l, float r, F &&f) const {
+    if (_cells.empty()) return;
+    const int c0 = clamped(cell(l)), c1 = clamped(cell(r));
+    for (int c=c0; c<=c1; c++)
+      for (const Entry &e: _cells[c])
+        // Only report an object in the first visited cell it belongs to
+        if (c == c0 || clamped(cell(e.l)) == c)
+          f(e.object, e.l, e.r);
+  }
+
+  /// Calls \p f(c, o, l, r) for every registration of \p o in the cell of
+  /// absolute index \p c
+  template <typename F>
+  void forEachEntry (F &&f) const {
+    for (uint c=0; c<_cells.size(); c++)
+      for (const Entry &e: _cells[c])  f(_origin + int(c), e.object, e.l, e.r);
+  }
+
+  void clear (void);
+
+  float cellWidth (void) const {
+    return _width;
+  }
+
+  size_t cells (void) const {
+    return _cells.size();
+  }
+
+private:
+  struct Entry {
+    float l, r;
+    Object object;
+  };
+
+  float _width;
+  int _origin;  ///< Absolute index of the first cell
+  std::vector<std::vector<Entry>> _cells;
+
+  int cell (float x) const {
+    return int(std::floor(x / _width)) - _origin;
+  }
+
+  int clamped (int c) const {
+    return std::max(0, std::min(c, int(_cells.size())-1));
+  }
+
+  /// Extends the grid to cover cells [\p c0, \p c1] (relative indices)
+  void cover (int c0, int c1);
+};
+
+} // end of namespace physics
+} // end of namespace simu
+
+#endif // SIMU_BROADPHASEGRID_H
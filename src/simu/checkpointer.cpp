@@ -0,0 +1,153 @@
+#include "checkpointer.h"
+#include "savefile.h"
+
+namespace simu {
+
+static constexpr bool debugCheckpoints = false;
+
+using json = Checkpointer::json;
+
+Checkpointer::Checkpointer (bool async)
+  : _async(async), _busy(false), _stop(false) {
+  if (_async) _thread = std::thread(&Checkpointer::run, this);
+}
+
+Checkpointer::~Checkpointer (void) {
+  if (!_async)  return;
+
+  {
+    std::unique_lock<std::mutex> lock (_mutex);
+    _idle.wait(lock, [this] { return _jobs.empty() && !_busy; });
+    _stop = true;
+  }
+  _notEmpty.notify_one();
+  _thread.join();
+
+  if (_error) {
+    try {
+      std::rethrow_exception(_error);
+    } catch (std::exception &e) {
+      std::cerr << "Discarded checkpoint error: " << e.what() << std::endl;
+    }
+  }
+}
+
+void Checkpointer::submit (Job &&job) {
+  if (!_async) {
+    process(job);
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock (_mutex);
+    rethrow();
+
+    if (debugCheckpoints && _jobs.size() + _busy >= capacity)
+      std::cerr << "Checkpointer full. Waiting for " << _jobs.front().file
+                << std::endl;
+
+    // Back-pressure: wait for the writer to catch up
+    _notFull.wait(lock, [this] {
+      return _jobs.size() + _busy < capacity || _error;
+    });
+    rethrow();
+
+    _jobs.push_back(std::move(job));
+  }
+  _notEmpty.notify_one();
+}
+
+void Checkpointer::flush (void) {
+  if (!_async)  return;
+  std::unique_lock<std::mutex> lock (_mutex);
+  _idle.wait(lock, [this] { return _jobs.empty() && !_busy; });
+  rethrow();
+}
+
+bool Checkpointer::pending (void) const {
+  std::unique_lock<std::mutex> lock (_mutex);
+  return !_jobs.empty() || _busy;
+}
+
+void Checkpointer::run (void) {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock (_mutex);
+      _notEmpty.wait(lock, [this] { return _stop || !_jobs.empty(); });
+      if (_jobs.empty())  return; // Stopped with nothing left to do
+
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+      _busy = true;
+    }
+
+    std::exception_ptr error;
+    try {
+      process(job);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::unique_lock<std::mutex> lock (_mutex);
+      _busy = false;
+      if (error && !_error) _error = error;
+    }
+    _notFull.notify_all();
+    _idle.notify_all();
+  }
+}
+
+void Checkpointer::process (Job &job) {
+  if (job.snapshot) {
+    job.snapshot->write(job.file);
+    return;
+  }
+
+  for (const std::string &f: job.incremental) {
+    json &current = job.data[f];
+    if (job.delta) {
+      json patch = json::diff(_previous[f], current);
+      _previous[f] = std::move(current);
+      current = std::move(patch);
+
+    } else
+      _previous[f] = current;
+  }
+
+  write(job.file, job.data);
+}
+
+void Checkpointer::rethrow (void) {
+  if (!_error)  return;
+  auto e = _error;
+  _error = nullptr;
+  std::rethrow_exception(e);
+}
+
+stdfs::path Checkpointer::savePath (stdfs::path file) {
+  const auto ext = file.extension();
+  if (ext != ".cbor" && ext != ".msgpack" && ext != ".ubjson"
+      && ext != snapshot::extension)
+    file += ".ubjson";
+  return file;
+}
+
+stdfs::path Checkpointer::write (stdfs::path file, const json &j) {
+  using clock = std::chrono::high_resolution_clock;
+  auto startTime = clock::now();
+
+  file = savePath(file);
+  savefile::write(file, j);
+
+  if (debugCheckpoints)
+    std::cerr << "Saving " << file << " took "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   clock::now() - startTime).count()
+              << " ms" << std::endl;
+
+  return file;
+}
+
+} // end of namespace simu
@@ -0,0 +1,96 @@
+#ifndef SIMU_CHECKPOINTER_H
+#define SIMU_CHECKPOINTER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "snapshot.h"
+
+namespace simu {
+
+/// Writes simulation saves, possibly in a background thread
+///
+/// The caller provides an already serialized (json) snapshot of the simulation
+/// which is then encoded, checksumed and written to disk (asynchronously if
+/// requested).
+/// At most \p capacity snapshots can be pending at the same time (double
+/// buffering): further submissions block until the writer catches up.
+///
+/// Snapshots can also be written as deltas: the requested top-level fields are
+/// then replaced by a json patch against their value in the previous snapshot.
+///
+/// Native binary snapshots (see snapshot.h) are written as is.
+class Checkpointer {
+public:
+  using json = nlohmann::json;
+
+  /// A snapshot waiting to be written
+  struct Job {
+    stdfs::path file;
+    json data;
+
+    /// Top-level fields of \p data stored as patches (if \p delta) and
+    /// remembered for the next snapshot
+    std::set<std::string> incremental;
+    bool delta;
+
+    /// If set, written instead of \p data (as a native snapshot)
+    std::unique_ptr<snapshot::Writer> snapshot;
+  };
+
+  /// Number of snapshots that can be queued before submissions block
+  static constexpr uint capacity = 2;
+
+  Checkpointer (bool async);
+  ~Checkpointer (void);
+
+  Checkpointer (const Checkpointer&) = delete;
+  Checkpointer& operator= (const Checkpointer&) = delete;
+
+  /// Queues \p job for writing. Blocks if the queue is full
+  /// \note Performs the writing directly for synchronous checkpointers
+  void submit (Job &&job);
+
+  /// Blocks until all pending snapshots have been written
+  void flush (void);
+
+  /// Whether there are snapshots still waiting to be (or being) written
+  bool pending (void) const;
+
+  /// \returns the path of the file that will actually be written for \p file
+  /// (i-e with a supported extension, native snapshots included)
+  static stdfs::path savePath (stdfs::path file);
+
+  /// Encodes \p j according to \p file's extension (defaulting to ubjson)
+  /// and writes it to disk with its index (see savefile.h)
+  /// \returns the path of the file actually written
+  static stdfs::path write (stdfs::path file, const json &j);
+
+private:
+  bool _async;
+
+  std::deque<Job> _jobs;
+  bool _busy, _stop;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _notEmpty, _notFull, _idle;
+
+  /// Error raised by the writer thread (rethrown on the next submit/flush)
+  std::exception_ptr _error;
+
+  /// Values of the incremental fields in the previous snapshot
+  /// \note Only accessed by the writer
+  std::map<std::string, json> _previous;
+
+  std::thread _thread;
+
+  void run (void);
+  void process (Job &job);
+  void rethrow (void);
+};
+
+} // end of namespace simu
+
+#endif // SIMU_CHECKPOINTER_H
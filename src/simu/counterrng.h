@@ -0,0 +1,133 @@
+#ifndef SIMU_COUNTERRNG_H
+#define SIMU_COUNTERRNG_H
+
+/// Counter-based random streams (Philox4x32-10, Salmon et al. 2011)
+///
+/// A stream is fully determined by its key (world seed) and its counter
+/// (entity id, step, purpose) so that an entity's draws do not depend on how
+/// many values were consumed by others before it. This makes plant-local
+/// decisions independent from the iteration order and, thus, from the
+/// schedule (serial or parallel).
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+
+#include "kgd/random/dice.hpp"
+
+namespace simu {
+
+class CounterDice {
+public:
+  /// What the stream is used for (distinguishes streams of a same entity)
+  enum Purpose : uint8_t {
+    STEP,         ///< Plants' stepping order (entity is the plant)
+    REPRODUCTION, ///< Fathers' order (entity is 0)
+    POLLINATION,  ///< Pistils' selection (entity is the father)
+    CROSSOVER,    ///< Crossing and mutations (entity is the father)
+    SOWING,       ///< Seeds' order (entity is 0)
+    DISPERSAL,    ///< Seed placement (entity is the seed)
+    CLEANUP,      ///< Newborns' order (entity is 0)
+  };
+
+  using result_type = uint32_t;
+
+  CounterDice (uint64_t seed, uint64_t entity, uint32_t step, Purpose purpose)
+    : _key{ uint32_t(seed), uint32_t(seed >> 32) },
+      _counter{ 0, step, uint32_t(entity),
+                uint32_t((entity >> 32) & 0x00FFFFFF) | (uint32_t(purpose) << 24) },
+      _index(4) {}
+
+  static constexpr result_type min (void) { return 0; }
+  static constexpr result_type max (void) {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  /// Next 32 random bits
+  result_type operator() (void) {
+    if (_index == 4) {
+      _block = philox(_counter, _key);
+      _counter[0]++;
+      _index = 0;
+    }
+    return _block[_index++];
+  }
+
+  /// Uniform integer in [\p a, \p b]
+  template <typename T>
+  std::enable_if_t<std::is_integral<T>::value, T> operator() (T a, T b) {
+    uint64_t range = uint64_t(int64_t(b) - int64_t(a)) + 1;
+    uint64_t x = (uint64_t((*this)()) << 32) | (*this)();
+    return T(int64_t(a) + int64_t(range ? x % range : x));
+  }
+
+  /// Uniform real in [\p a, \p b[
+  template <typename T>
+  std::enable_if_t<std::is_floating_point<T>::value, T> operator() (T a, T b) {
+    return a + (b - a) * T((*this)() >> 8) * T(1.f / (1u << 24));
+  }
+
+  /// Draws from distribution \p d (e.g. rng::rdist)
+  template <typename D, typename = decltype(std::declval<D>()(
+                          std::declval<CounterDice&>()))>
+  auto operator() (D &&d) {
+    return d(*this);
+  }
+
+  /// Uniformly selected iterator in [\p begin, \p end[
+  template <typename IT, typename = typename
+              std::iterator_traits<IT>::iterator_category>
+  IT operator() (IT begin, IT end) {
+    auto n = std::distance(begin, end);
+    return std::next(begin, (*this)(decltype(n)(0), n-1));
+  }
+
+  /// Fisher-Yates shuffle, independent from the standard library
+  template <typename C>
+  void shuffle (C &c) {
+    using std::swap;
+    for (size_t i=c.size(); i>1; i--)
+      swap(c[i-1], c[(*this)(size_t(0), i-1)]);
+  }
+
+  /// Classical dice seeded from this stream, for consumers requiring one
+  /// (e.g. genomes' crossover and mutations)
+  rng::FastDice fork (void) {
+    return rng::FastDice((*this)() & std::numeric_limits<int>::max());
+  }
+
+private:
+  using Counter = std::array<uint32_t, 4>;
+  using Key = std::array<uint32_t, 2>;
+
+  Key _key;
+  Counter _counter;
+  Counter _block;
+  uint _index;
+
+  static uint32_t mulhilo (uint32_t a, uint32_t b, uint32_t &hi) {
+    uint64_t p = uint64_t(a) * b;
+    hi = p >> 32;
+    return uint32_t(p);
+  }
+
+  static Counter philox (Counter c, Key k) {
+    static constexpr uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    static constexpr uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+    for (uint r=0; r<10; r++) {
+      uint32_t hi0, hi1;
+      uint32_t lo0 = mulhilo(M0, c[0], hi0);
+      uint32_t lo1 = mulhilo(M1, c[2], hi1);
+      c = { hi1 ^ c[1] ^ k[0], lo1, hi0 ^ c[3] ^ k[1], lo0 };
+      k[0] += W0;
+      k[1] += W1;
+    }
+    return c;
+  }
+};
+
+} // end of namespace simu
+
+#endif // SIMU_COUNTERRNG_H
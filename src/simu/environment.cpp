@@ -1,5 +1,14 @@
+#include <exception>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "environment.h"
 #include "tiniestphysicsengine.h"
+#include "snapshot.h"
+#include "counterrng.h"
+#include "profiler.h"
 
 #include "../config/simuconfig.h"
 
@@ -117,6 +126,8 @@ void Environment::initInternal(void) {
 
   _dice.reset(_genomes.front().rngSeed); /// TODO Really okay?
   _updatedTopology = false;
+  _topologyEpoch++;
+  _lod.valid = false;
 
   _startTime = _currTime = _endTime = Time();
 }
@@ -126,6 +137,10 @@ void Environment::destroy (void) {
 }
 
 void Environment::stepStart(void) {
+  _collisionMemoStats.hits = 0;
+  _collisionMemoStats.misses = 0;
+  _physics->resetCounters();
+
 #ifdef DEBUG_COLLISIONS
   for (auto &p: _physics->collisionsDebugData)
     p.second.clear();
@@ -154,64 +169,143 @@ void Environment::setDuration(DurationSetType type, uint years) {
   }
 }
 
-void Environment::cgpStep (void) {
+namespace {
+
+/// Fields driven by the controllers
+struct Fields {
+  std::vector<float> &topology, &temperature, &water, &grazing;
+};
+
+/// Evaluates the controllers of \p genomes over \p fields and calls
+/// \p apply(g, v, A_, T_, H_, G_) with the targets of every voxel v (once)
+///
+/// Genome areas are split into chunks of rows (one per voxel) which may be
+/// evaluated concurrently (see config::parallelEnvironment). Outputs are then
+/// applied sequentially, junctions included, so that results do not depend on
+/// the number of threads
+template <typename F>
+void evaluateControllers (std::vector<genotype::Environment> &genomes,
+                          const Fields &fields, double D, double Y,
+                          F &&apply) {
+  using Genome = genotype::Environment;
   using CGP = Genome::CGP;
 
   using I = genotype::cgp::Inputs;
-  using Inputs = CGP::Inputs;
-  Inputs inputs (Genome::config_t::activeInputs(), 0);
-
   using O = genotype::cgp::Outputs;
-  using Outputs = CGP::Outputs;
-  Outputs outputs (Genome::config_t::activeOutputs(), 0);
 
-  const auto baselineWater = config::Simulation::baselineShallowWater();
+  struct Area {
+    CGP::InputColumns inputs;
+    CGP::OutputColumns outputs;
+    CGP::Batch batch;
+    uint offset;
+  };
+  std::vector<Area> areas (genomes.size());
 
-  _updatedTopology = !_noTopology &&
-    (_currTime.toTimestamp() % config::Simulation::updateTopologyEvery()) == 0;
-
-  inputs[I::D] = sin(2 * M_PI * _currTime.timeOfYear());
+  struct Chunk {
+    uint area, begin, end;
+  };
+  std::vector<Chunk> chunks;
 
-  const auto S = _startTime.toTimestamp(), E = _endTime.toTimestamp();
-  inputs[I::Y] = sin(2 * M_PI * (1. - (E - _currTime.toTimestamp()) / (E - S)));
-
-  for (I i: {I::D, I::Y})
-    utils::iclip(-1., inputs[i], 1.);
+  const uint chunkSize = std::max(1u, config::Simulation::envChunkSize());
 
   uint offset = 0;
-  std::array<float, 4> junctions;
-  junctions.fill(NAN);
+  for (uint i=0; i<genomes.size(); i++) {
+    Genome &g = genomes[i];
+    Area &a = areas[i];
+    const uint rows = g.voxels+1;
 
-  for (uint i=0; i<_genomes.size(); i++) {
-    Genome &g = _genomes[i];
+    a.offset = offset;
+    a.inputs.resize(rows);
+    a.outputs.resize(rows);
+    g.controller.beginBatch(rows, a.batch); // Random values drawn in order
 
-    for (uint j=0; j<=g.voxels; j++) {
-      uint j_ = j+offset;
+    for (uint b=0; b<rows; b+=chunkSize)
+      chunks.push_back({i, b, std::min(rows, b+chunkSize)});
 
-      float &A = _topology[j_];
-      float &T = _temperature[j_];
-      float &H = _hygrometry[SHALLOW][j_];
-      float &G = _grazing[j_];
+    offset += g.voxels;
+  }
 
-      auto rangeT = g.maxT - g.minT;
+  const auto evaluate = [&] (const Chunk &c, std::vector<double> &scratch) {
+    const Genome &g = genomes[c.area];
+    Area &a = areas[c.area];
+    auto rangeT = g.maxT - g.minT;
 
-      inputs[I::X] = 2 * float(j) / g.voxels - 1;
-      inputs[I::T] = A / g.depth;
-      inputs[I::H] = 2 * (T - g.minT) / rangeT - 1;
-      inputs[I::W] = H / config::Simulation::baselineShallowWater() - 1;
-      inputs[I::G] = G;
+    auto &inputs = a.inputs;
+    std::fill(inputs[I::D].begin()+c.begin, inputs[I::D].begin()+c.end, D);
+    std::fill(inputs[I::Y].begin()+c.begin, inputs[I::Y].begin()+c.end, Y);
+    for (uint j=c.begin; j<c.end; j++) {
+      uint j_ = j+a.offset;
+
+      inputs[I::X][j] = 2 * float(j) / g.voxels - 1;
+      inputs[I::T][j] = fields.topology[j_] / g.depth;
+      inputs[I::H][j] = 2 * (fields.temperature[j_] - g.minT) / rangeT - 1;
+      inputs[I::W][j] = fields.water[j_]
+                      / config::Simulation::baselineShallowWater() - 1;
+      inputs[I::G][j] = fields.grazing[j_];
 
       for (I i: {I::X, I::T, I::H, I::W, I::G})
-        utils::iclip(-1., inputs[i], 1.);
+        utils::iclip(-1., inputs[i][j], 1.);
+    }
 
-      g.controller.evaluate(inputs, outputs);
+    g.controller.evaluateRows(inputs, a.outputs, c.begin, c.end, a.batch,
+                              scratch);
+  };
 
-      float A_ = .9 * outputs[O::T] * g.depth,
-            T_ = .5 * (outputs[O::H] + 1) * rangeT + g.minT,
-            H_ = (1 + outputs[O::W]) * baselineWater,
-            G_ = std::fabs(outputs[O::G]);
+  if (config::Simulation::parallelEnvironment() && chunks.size() > 1) {
+#ifdef _OPENMP
+    const uint threads = config::Simulation::stepThreads();
+    const int nthreads = threads > 0 ? int(threads) : omp_get_max_threads();
+#endif
 
-      bool isRight = (i+1 < _genomes.size() && j == g.voxels);
+    // Exceptions cannot cross the parallel region: store them per chunk and
+    // rethrow the first one afterwards
+    std::vector<std::exception_ptr> errors (chunks.size());
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+    {
+      std::vector<double> scratch;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (uint c=0; c<chunks.size(); c++) {
+        try {
+          evaluate(chunks[c], scratch);
+        } catch (...) {
+          errors[c] = std::current_exception();
+        }
+      }
+    }
+
+    for (const std::exception_ptr &e: errors)
+      if (e)  std::rethrow_exception(e);
+
+  } else {
+    std::vector<double> scratch;
+    for (const Chunk &c: chunks)  evaluate(c, scratch);
+  }
+
+  const auto baselineWater = config::Simulation::baselineShallowWater();
+
+  std::array<float, 4> junctions;
+  junctions.fill(NAN);
+
+  for (uint i=0; i<genomes.size(); i++) {
+    Genome &g = genomes[i];
+    Area &a = areas[i];
+    auto rangeT = g.maxT - g.minT;
+
+    g.controller.endBatch(a.batch);
+
+    const auto &outputs = a.outputs;
+    for (uint j=0; j<=g.voxels; j++) {
+      float A_ = .9 * outputs[O::T][j] * g.depth,
+            T_ = .5 * (outputs[O::H][j] + 1) * rangeT + g.minT,
+            H_ = (1 + outputs[O::W][j]) * baselineWater,
+            G_ = std::fabs(outputs[O::G][j]);
+
+      bool isRight = (i+1 < genomes.size() && j == g.voxels);
       if (isRight) {
         junctions[0] = .5 * A_;
         junctions[1] = .5 * T_;
@@ -227,17 +321,142 @@ void Environment::cgpStep (void) {
           G_ = .5 * G_ + junctions[3];
         }
 
-        // Keep 10% of space
-        if (_updatedTopology) updateVoxel(g, A, A_);
-        updateVoxel(g, T, T_);
-        updateVoxel(g, H, H_);
-        updateVoxel(g, G, G_);
+        apply(g, j+a.offset, A_, T_, H_, G_);
       }
     }
+  }
+}
 
-    offset += g.voxels;
+} // end of anonymous namespace
+
+void Environment::cgpStep (void) {
+  profiler::Scope profile (profiler::Phase::CGP_STEP);
+
+  _updatedTopology = !_noTopology &&
+    (_currTime.toTimestamp() % config::Simulation::updateTopologyEvery()) == 0;
+
+  double D = sin(2 * M_PI * _currTime.timeOfYear());
+
+  const auto S = _startTime.toTimestamp(), E = _endTime.toTimestamp();
+  double Y = sin(2 * M_PI * (1. - (E - _currTime.toTimestamp()) / (E - S)));
+
+  for (double *v: {&D, &Y})
+    utils::iclip(-1., *v, 1.);
+
+  bool topologyChanged = false;
+  const auto updateTopology = [this, &topologyChanged] (float inertia,
+                                                        float &A, float A_) {
+    const float A0 = A;
+    updateVoxel(inertia, A, A_);
+    topologyChanged |= (A != A0);
+  };
+
+  const Fields fields {
+    _topology, _temperature, _hygrometry[SHALLOW], _grazing
+  };
+
+  const bool validate = config::Simulation::envUpdateValidation();
+  if (validate && !_lod.valid) {
+    // (Re)start the exact schedule from the current state
+    _lodShadow.genomes = _genomes;
+    _lodShadow.topology = _topology;
+    _lodShadow.temperature = _temperature;
+    _lodShadow.water = _hygrometry[SHALLOW];
+    _lodShadow.grazing = _grazing;
   }
 
+  const uint period = config::Simulation::envUpdatePeriod();
+  if (period <= 1) {
+    evaluateControllers(_genomes, fields, D, Y,
+                        [&] (const Genome &g, uint v,
+                             float A_, float T_, float H_, float G_) {
+      // Keep 10% of space
+      if (_updatedTopology) updateTopology(g.inertia, _topology[v], A_);
+      updateVoxel(g, _temperature[v], T_);
+      updateVoxel(g, _hygrometry[SHALLOW][v], H_);
+      updateVoxel(g, _grazing[v], G_);
+    });
+    _lod.valid = true;
+
+  } else {
+    // Interpolated fields, in the order of TemporalLOD::from/to
+    const std::array<Voxels*, 3> voxels {
+      &_temperature, &_hygrometry[SHALLOW], &_grazing
+    };
+
+    const uint t = _currTime.toTimestamp();
+    if (!_lod.valid || t % period == 0) {
+      // Aim for where the exact schedule would approximately be at the next
+      // evaluation, were the targets constant
+      _lod.valid = true;
+      _lod.begin = t;
+      _lod.steps = period - t % period;
+
+      const auto n = _topology.size();
+      for (Voxels *v: {&_lod.topology, &_lod.inertia})  v->resize(n);
+      for (uint f=0; f<3; f++) {
+        _lod.from[f].resize(n);
+        _lod.to[f].resize(n);
+      }
+
+      evaluateControllers(_genomes, fields, D, Y,
+                          [&] (const Genome &g, uint v,
+                               float A_, float T_, float H_, float G_) {
+        _lod.topology[v] = A_;
+        _lod.inertia[v] = g.inertia;
+
+        const float k = std::pow(g.inertia, _lod.steps);
+        const std::array<float, 3> targets { T_, H_, G_ };
+        for (uint f=0; f<3; f++) {
+          float from = (*voxels[f])[v];
+          _lod.from[f][v] = from;
+          _lod.to[f][v] = k * from + (1.f - k) * targets[f];
+        }
+      });
+    }
+
+    const float r = float(t - _lod.begin + 1) / _lod.steps;
+    for (uint f=0; f<3; f++) {
+      const Voxels &from = _lod.from[f], &to = _lod.to[f];
+      for (uint v=0; v<voxels[f]->size(); v++)
+        (*voxels[f])[v] = from[v] + r * (to[v] - from[v]);
+    }
+
+    // Keep 10% of space
+    if (_updatedTopology)
+      for (uint v=0; v<_topology.size(); v++)
+        updateTopology(_lod.inertia[v], _topology[v], _lod.topology[v]);
+  }
+
+  if (validate) {
+    auto &s = _lodShadow;
+    evaluateControllers(s.genomes,
+                        { s.topology, s.temperature, s.water, s.grazing },
+                        D, Y,
+                        [&s, this] (const Genome &g, uint v,
+                                    float A_, float T_, float H_, float G_) {
+      if (_updatedTopology) updateVoxel(g, s.topology[v], A_);
+      updateVoxel(g, s.temperature[v], T_);
+      updateVoxel(g, s.water[v], H_);
+      updateVoxel(g, s.grazing[v], G_);
+    });
+
+    const auto deviation = [] (const Voxels &lhs, const Voxels &rhs) {
+      float d = 0;
+      for (uint v=0; v<lhs.size(); v++)
+        d = std::max(d, std::fabs(lhs[v] - rhs[v]));
+      return d;
+    };
+    _lodDeviation = {
+      deviation(_topology, s.topology),
+      deviation(_temperature, s.temperature),
+      deviation(_hygrometry[SHALLOW], s.water),
+      deviation(_grazing, s.grazing)
+    };
+  }
+
+  if (topologyChanged)  _topologyEpoch++;
+
   if (debugEnvCTRL) showVoxelsContents();
 }
 
@@ -252,15 +471,47 @@ float Environment::temperatureAt(float x) const {
 }
 
 float Environment::waterAt(const Point &p) const {
-  if (!inside(p)) return 0; // No water outside world
+  return waterAt(sampleAt(p));
+}
+
+VoxelSample Environment::sampleAt (const Point &p) const {
+  VoxelSample s;
+  s.pos = p;
+  s.insideX = insideXRange(p.x);
+  s.insideY = insideYRange(p.y);
+
+  s.voxel = 0;
+  s.weight = 0;
+  if (s.insideX) {  // Otherwise v may be negative (unrepresentable as uint)
+    float v = (p.x + xextent()) * float(_voxels) / width();
+    s.voxel = uint(v);
+    s.weight = v - s.voxel;
+  }
+  return s;
+}
+
+float Environment::temperatureAt (const VoxelSample &s) const {
+  if (!s.insideX) return 0;
+  return interpolate(_temperature, s);
+}
+
+float Environment::waterAt (const VoxelSample &s) const {
+  if (!s.insideX || !s.insideY) return 0; // No water outside world
 
-  float h = heightAt(p.x);
+  const Point &p = s.pos;
+  float h = interpolate(_topology, s);
   if (h < p.y)  return 0; // No water above ground
 
   float d = (h - p.y) / (h + yextent());
   assert(0 <= d && d <= 1);
-  return interpolate(_hygrometry[SHALLOW], p.x) * (1.f - uint(d))
-       + interpolate(_hygrometry[DEEP], p.x) * d;
+  return interpolate(_hygrometry[SHALLOW], s) * (1.f - uint(d))
+       + interpolate(_hygrometry[DEEP], s) * d;
+}
+
+void Environment::waterAt (const std::vector<VoxelSample> &samples,
+                           std::vector<float> &values) const {
+  values.resize(samples.size());
+  for (uint i=0; i<samples.size(); i++)  values[i] = waterAt(samples[i]);
 }
 
 float Environment::lightAt(float) const {
@@ -268,13 +519,21 @@ float Environment::lightAt(float) const {
 }
 
 void Environment::updateVoxel (const Genome &g, float &voxel, float newValue) {
-  voxel = g.inertia * voxel + (1.f - g.inertia) * newValue;
+  updateVoxel(g.inertia, voxel, newValue);
+}
+
+void Environment::updateVoxel (float inertia, float &voxel, float newValue) {
+  voxel = inertia * voxel + (1.f - inertia) * newValue;
 }
 
 float Environment::interpolate(const Voxels &voxels, float x) const {
-  float v = (x + xextent()) * float(_voxels) / width();
-  uint v0 = uint(v);
-  float d = v - v0;
+  return interpolate(voxels, sampleAt({x, 0}));
+}
+
+float Environment::interpolate(const Voxels &voxels,
+                               const VoxelSample &s) const {
+  uint v0 = s.voxel;
+  float d = s.weight;
 
   assert(v0 <= voxels.size());
 
@@ -283,7 +542,7 @@ float Environment::interpolate(const Voxels &voxels, float x) const {
   else  return voxels[v0] * (1.f - d) + voxels[v0+1] * d;
 }
 
-const physics::UpperLayer::Items& Environment::canopy(const Plant *p) const {
+physics::UpperLayer::Items Environment::canopy(const Plant *p) const {
   return _physics->canopy(p);
 }
 
@@ -297,6 +556,7 @@ void Environment::updateCollisionData(Plant *p) {
 
 void Environment::updateCollisionDataFinal(Plant *p) {
   _physics->updateFinal(*this, p);
+  p->invalidateEnvironmentSamples();
 }
 
 void Environment::removeCollisionData(Plant *p) {
@@ -309,10 +569,16 @@ Environment::initialCollisionTest (const Plant *plant) const {
 }
 
 physics::CollisionResult
-Environment::collisionTest (const Plant *plant,
-                            const Branch &self, const Branch &branch,
+Environment::collisionTest (const Plant *plant, const Organ *apex,
+                            const Branch &branch,
                             const std::set<Organ*> &newOrgans) const {
-  return _physics->collisionTest(plant, self, branch, newOrgans);
+  return _physics->collisionTest(plant, apex, branch, newOrgans);
+}
+
+void Environment::collisionNeighbourhood (const Plant *plant,
+                                          const Rect &bounds,
+                                          physics::Neighbourhood &n) const {
+  _physics->neighbourhood(plant, bounds, n);
 }
 
 void Environment::disseminateGeneticMaterial(Organ *f) {
@@ -327,16 +593,31 @@ void Environment::removeGeneticMaterial(Organ *f) {
   _physics->delPistil(f);
 }
 
-physics::Pistil Environment::collectGeneticMaterial(Organ *f) {
-  auto itP = _physics->sporesInRange(f);
+void Environment::prepareGeneticMaterialCollection (
+    const std::vector<Organ*> &stamens) {
+  _physics->prepareSporesQueries(stamens);
+}
 
-  if (std::distance(itP.first, itP.second) >= 1)
-    return *dice()(itP.first, itP.second);
+template <typename D>
+static physics::Pistil collect (physics::TinyPhysicsEngine &physics, Organ *f, D &dice) {
+  const auto &spores = physics.sporesInRange(f);
+
+  if (spores.size() >= 1)
+    return *dice(spores.begin(), spores.end());
 
   else
     return physics::Pistil();
 }
 
+physics::Pistil Environment::collectGeneticMaterial(Organ *f) {
+  return collect(*_physics, f, dice());
+}
+
+physics::Pistil Environment::collectGeneticMaterial(Organ *f,
+                                                    CounterDice &dice) {
+  return collect(*_physics, f, dice);
+}
+
 void Environment::processNewObjects(void) {
   _physics->processNewObjects();
 }
@@ -366,6 +647,10 @@ void Environment::clone (const Environment &e,
   _grazing = e._grazing;
 
   _updatedTopology = false;
+  _topologyEpoch++;
+  _lod = e._lod;
+  _lodShadow = e._lodShadow;
+  _lodDeviation = e._lodDeviation;
 
   _startTime = e._startTime;
   _currTime = e._currTime;
@@ -403,6 +688,49 @@ void Environment::save (nlohmann::json &j, const Environment &e) {
   }
 }
 
+void Environment::save (snapshot::Writer &w, const Environment &e) {
+  nlohmann::json j;
+  save(j, e);
+
+  // Voxels are stored in their own section
+  j[2] = j[3] = j[5] = nlohmann::json::array();
+  j[4] = { nlohmann::json::array(), nlohmann::json::array() };
+  w.addJson(snapshot::Section::ENVIRONMENT, j);
+
+  w.meta.voxels = e._topology.size();
+  const std::array<const Voxels*, 5> layers {
+    &e._topology, &e._temperature,
+    &e._hygrometry[SHALLOW], &e._hygrometry[DEEP],
+    &e._grazing
+  };
+  for (const Voxels *v: layers) {
+    assert(v->size() == w.meta.voxels);
+    w.voxels.insert(w.voxels.end(), v->begin(), v->end());
+  }
+}
+
+void Environment::load (const snapshot::Reader &r, Environment &e) {
+  load(r.json(snapshot::Section::ENVIRONMENT), e);
+
+  const auto n = r.meta().voxels;
+  auto voxels = r.voxels();
+  if (voxels.size() != 5 * n)
+    utils::doThrow<std::invalid_argument>(
+      "Invalid voxels section in ", r.file(), ": expected ", 5 * n,
+      " values, got ", voxels.size());
+
+  std::array<Voxels*, 5> layers {
+    &e._topology, &e._temperature,
+    &e._hygrometry[SHALLOW], &e._hygrometry[DEEP],
+    &e._grazing
+  };
+  for (uint i=0; i<layers.size(); i++)
+    layers[i]->assign(voxels.begin() + i * n, voxels.begin() + (i+1) * n);
+  e._topologyEpoch++;
+
+  if (debugEnvCTRL) e.showVoxelsContents();
+}
+
 void Environment::postLoad(void) {  _physics->postLoad(); }
 
 void Environment::load (const nlohmann::json &j, Environment &e) {
@@ -442,6 +770,8 @@ void Environment::load (const nlohmann::json &j, Environment &e) {
 
   e.updateInternals();
   e._updatedTopology = false;
+  e._topologyEpoch++;
+  e._lod.valid = false; // Interpolation restarts from the loaded state
 
   if (totalWidth != -1) e._totalWidth = totalWidth;
 
@@ -1,6 +1,8 @@
 #ifndef SIMU_ENVIRONMENT_H
 #define SIMU_ENVIRONMENT_H
 
+#include <atomic>
+
 #include "../genotype/environment.h"
 #include "physicstypes.hpp"
 #include "types.h"
@@ -16,6 +18,13 @@ struct TinyPhysicsEngine;
 struct Plant;
 struct Branch;
 
+namespace snapshot {
+class Writer;
+class Reader;
+} // end of namespace snapshot
+
+class CounterDice;
+
 /// Manages everything related to the external conditions:
 ///  - abiotic inputs (sunlight, water, temperature, topology)
 ///  - biotic (inter-plant collisions)
@@ -41,6 +50,32 @@ class Environment {
   bool _updatedTopology;
   bool _noTopology;
 
+  /// Incremented whenever the topology is modified (see Plant::CollisionMemo)
+  uint _topologyEpoch = 0;
+
+  /// Controller outputs between two evaluations (see config::envUpdatePeriod)
+  struct TemporalLOD {
+    bool valid = false;   ///< Whether to re-evaluate at the next step
+    uint begin, steps;    ///< Time of the last evaluation and steps to the next
+
+    /// Interpolation bounds for temperature, shallow water and grazing
+    std::array<Voxels, 3> from, to;
+
+    Voxels topology;      ///< Target topology
+    Voxels inertia;       ///< Inertia of the genome responsible for each voxel
+  } _lod;
+
+  /// Exact schedule run alongside the interpolated one (see
+  /// config::envUpdateValidation)
+  struct {
+    std::vector<Genome> genomes;
+    Voxels topology, temperature, water, grazing;
+  } _lodShadow;
+
+  /// Maximal absolute deviation of topology, temperature, water and grazing
+  /// from the exact schedule for the current step
+  std::array<float, 4> _lodDeviation {};
+
   Time _startTime, _currTime, _endTime;
 
   std::unique_ptr<physics::TinyPhysicsEngine> _physics;
@@ -112,6 +147,27 @@ public:
     return _updatedTopology;
   }
 
+  uint topologyEpoch (void) const {
+    return _topologyEpoch;
+  }
+
+  /// \returns the deviations of the fields from the exact schedule (only
+  /// meaningful when config::envUpdateValidation is set)
+  const auto& lodDeviation (void) const {
+    return _lodDeviation;
+  }
+
+  /// Per-step usage of the derivations' collision memos (see
+  /// config::collisionMemo)
+  struct CollisionMemoStats {
+    std::atomic<uint> hits {0};   ///< Collision tests skipped
+    std::atomic<uint> misses {0}; ///< Collision tests performed
+  };
+
+  CollisionMemoStats& collisionMemoStats (void) const {
+    return _collisionMemoStats;
+  }
+
   const auto& startTime (void) const {
     return _startTime;
   }
@@ -156,6 +212,17 @@ public:
   float waterAt (const Point &p) const;
   float lightAt (float x) const;
 
+  /// \returns where to read the voxels for \p p. Only depends on the world's
+  /// dimensions and can thus be kept while \p p does not move
+  VoxelSample sampleAt (const Point &p) const;
+
+  /// Same as above with precomputed samples
+  float temperatureAt (const VoxelSample &s) const;
+
+  /// Gathers the current water values at all \p samples into \p values
+  void waterAt (const std::vector<VoxelSample> &samples,
+                std::vector<float> &values) const;
+
   void setDuration (DurationSetType type, uint duration);
   void mutateController (rng::AbstractDice &dice) {
     if (_genomes.size() != 1)
@@ -164,7 +231,7 @@ public:
     _genomes.front().controller.mutate(dice);
   }
 
-  const physics::UpperLayer::Items& canopy(const Plant *p) const;
+  physics::UpperLayer::Items canopy(const Plant *p) const;
 
   bool addCollisionData(Plant *p);
   void updateCollisionData (Plant *p);  ///< During plant step when testing for shape validity
@@ -175,15 +242,28 @@ public:
   initialCollisionTest (const Plant *plant) const;
 
   physics::CollisionResult
-  collisionTest (const Plant *plant,
-                 const Branch &self, const Branch &branch,
+  collisionTest (const Plant *plant, const Organ *apex,
+                 const Branch &branch,
                  const std::set<Organ*> &newOrgans) const;
 
+  /// Plants (and their state) a branch of \p plant with bounds \p bounds
+  /// would be tested against
+  void collisionNeighbourhood (const Plant *plant, const Rect &bounds,
+                               physics::Neighbourhood &n) const;
+
   void disseminateGeneticMaterial (Organ *f);
   void updateGeneticMaterial (Organ *f, const Point &oldPos);
   void removeGeneticMaterial(Organ *p);
+
+  /// Answers the pollination queries of all \p stamens at once (to be
+  /// followed by calls to collectGeneticMaterial)
+  void prepareGeneticMaterialCollection (const std::vector<Organ*> &stamens);
+
   physics::Pistil collectGeneticMaterial (Organ *f);
 
+  /// Same as above with the pistil selected through \p dice
+  physics::Pistil collectGeneticMaterial (Organ *f, CounterDice &dice);
+
   void processNewObjects (void);
 
   const auto& collisionData (void) const {
@@ -200,6 +280,10 @@ public:
   static void save (nlohmann::json &j, const Environment &e);
   static void load (const nlohmann::json &j, Environment &e);
 
+  /// Stores voxels as raw floats and everything else as json
+  static void save (snapshot::Writer &w, const Environment &e);
+  static void load (const snapshot::Reader &r, Environment &e);
+
   friend void assertEqual (const Environment &lhs, const Environment &rhs,
                            bool deepcopy);
 
@@ -212,6 +296,9 @@ public:
     swap(lhs._hygrometry, rhs._hygrometry);
     swap(lhs._grazing, rhs._grazing);
     swap(lhs._updatedTopology, rhs._updatedTopology);
+    lhs._topologyEpoch++;
+    rhs._topologyEpoch++;
+    lhs._lod.valid = rhs._lod.valid = false;
     swap(lhs._startTime, rhs._startTime);
     swap(lhs._currTime, rhs._currTime);
     swap(lhs._endTime, rhs._endTime);
@@ -219,12 +306,17 @@ public:
   }
 
 private:
+  mutable CollisionMemoStats _collisionMemoStats;
+
   void initInternal (void);
   void updateInternals (void);
 
   void updateVoxel (const Genome &g, float &voxel, float newValue);
+  static void updateVoxel (float inertia, float &voxel, float newValue);
 
   float interpolate (const Voxels &voxels, float x) const;
+  float interpolate (const Voxels &voxels, const VoxelSample &s) const;
+  float waterAt (const VoxelSample &s) const;
 
   void cgpStep (void);
 
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cassert>
+
+#include "intervaltree.h"
+
+namespace simu {
+namespace physics {
+
+void IntervalTree::insert (Object o, float l, float r) {
+  int i;
+  if (_free.empty()) {
+    i = _nodes.size();
+    _nodes.emplace_back();
+  } else {
+    i = _free.back();
+    _free.pop_back();
+  }
+
+  // xorshift32
+  _seed ^= _seed << 13;
+  _seed ^= _seed >> 17;
+  _seed ^= _seed << 5;
+
+  _nodes[i] = Node { l, r, r, o, _seed, null, null };
+  _root = insert(_root, i);
+  _size++;
+}
+
+void IntervalTree::erase (Object o, float l) {
+  _root = erase(_root, o, l);
+}
+
+void IntervalTree::clear (void) {
+  _nodes.clear();
+  _free.clear();
+  _root = null;
+  _size = 0;
+}
+
+void IntervalTree::refresh (int i) {
+  Node &n = _nodes[i];
+  n.maxR = n.r;
+  if (n.left != null)   n.maxR = std::max(n.maxR, _nodes[n.left].maxR);
+  if (n.right != null)  n.maxR = std::max(n.maxR, _nodes[n.right].maxR);
+}
+
+int IntervalTree::insert (int t, int i) {
+  if (t == null)  return i;
+
+  Node &n = _nodes[i];
+  if (n.priority > _nodes[t].priority) {
+    split(t, n.l, n.object, n.left, n.right);
+    refresh(i);
+    return i;
+  }
+
+  Node &nt = _nodes[t];
+  if (lower(n.l, n.object, nt.l, nt.object))
+        nt.left = insert(nt.left, i);
+  else  nt.right = insert(nt.right, i);
+  refresh(t);
+  return t;
+}
+
+int IntervalTree::erase (int t, Object o, float l) {
+  assert(t != null);
+
+  Node &nt = _nodes[t];
+  if (nt.object == o) {
+    _free.push_back(t);
+    _size--;
+    return merge(nt.left, nt.right);
+  }
+
+  if (lower(l, o, nt.l, nt.object))
+        nt.left = erase(nt.left, o, l);
+  else  nt.right = erase(nt.right, o, l);
+  refresh(t);
+  return t;
+}
+
+int IntervalTree::merge (int lhs, int rhs) {
+  if (lhs == null)  return rhs;
+  if (rhs == null)  return lhs;
+
+  if (_nodes[lhs].priority > _nodes[rhs].priority) {
+    _nodes[lhs].right = merge(_nodes[lhs].right, rhs);
+    refresh(lhs);
+    return lhs;
+
+  } else {
+    _nodes[rhs].left = merge(lhs, _nodes[rhs].left);
+    refresh(rhs);
+    return rhs;
+  }
+}
+
+void IntervalTree::split (int t, float l, Object o, int &lhs, int &rhs) {
+  if (t == null) {
+    lhs = rhs = null;
+    return;
+  }
+
+  Node &nt = _nodes[t];
+  if (lower(nt.l, nt.object, l, o)) {
+    split(nt.right, l, o, nt.right, rhs);
+    lhs = t;
+  } else {
+    split(nt.left, l, o, lhs, nt.left);
+    rhs = t;
+  }
+  refresh(t);
+}
+
+} // end of namespace physics
+} // end of namespace simu
@@ -0,0 +1,99 @@
+#ifndef SIMU_INTERVALTREE_H
+#define SIMU_INTERVALTREE_H
+
+/// Interval tree over the collision objects' horizontal extents
+///
+/// Balanced binary search tree (treap) ordered by left edge and augmented with
+/// the maximal right edge of each subtree. Used to find which objects contain
+/// (or are contained in) a given interval in O(log n + k).
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "physicstypes.hpp"
+
+namespace simu {
+namespace physics {
+
+class IntervalTree {
+public:
+  using Object = CollisionObject*;
+
+  void insert (Object o, float l, float r);
+
+  /// \p l must be the value \p o was inserted with
+  void erase (Object o, float l);
+
+  void clear (void);
+
+  size_t size (void) const {
+    return _size;
+  }
+
+  /// Calls \p f(o, ol, or) for every object with [ol,or] containing [l,r]
+  template <typename F>
+  void forEachContaining (float l, float r, F &&f) const {
+    forEachContaining(_root, l, r, f);
+  }
+
+  /// Calls \p f(o, ol, or) for every object with [ol,or] inside [l,r]
+  template <typename F>
+  void forEachContainedIn (float l, float r, F &&f) const {
+    forEachContainedIn(_root, l, r, f);
+  }
+
+private:
+  static constexpr int null = -1;
+
+  struct Node {
+    float l, r;
+    float maxR;   ///< Largest right edge in this subtree
+    Object object;
+    uint32_t priority;
+    int left, right;
+  };
+
+  std::vector<Node> _nodes;
+  std::vector<int> _free;
+  int _root = null;
+  size_t _size = 0;
+
+  uint32_t _seed = 2463534242; ///< For the (deterministic) priorities
+
+  static bool lower (float lhsL, Object lhsO, float rhsL, Object rhsO) {
+    if (lhsL != rhsL) return lhsL < rhsL;
+    return lhsO < rhsO;
+  }
+
+  void refresh (int i);
+  int insert (int t, int n);
+  int erase (int t, Object o, float l);
+  int merge (int lhs, int rhs);
+  void split (int t, float l, Object o, int &lhs, int &rhs);
+
+  template <typename F>
+  void forEachContaining (int i, float l, float r, F &f) const {
+    if (i == null)  return;
+    const Node &n = _nodes[i];
+    if (n.maxR < r) return;
+    forEachContaining(n.left, l, r, f);
+    if (l < n.l)  return; // Right subtree starts even further right
+    if (r <= n.r) f(n.object, n.l, n.r);
+    forEachContaining(n.right, l, r, f);
+  }
+
+  template <typename F>
+  void forEachContainedIn (int i, float l, float r, F &f) const {
+    if (i == null)  return;
+    const Node &n = _nodes[i];
+    if (l <= n.l) forEachContainedIn(n.left, l, r, f);
+    if (l <= n.l && n.l <= r && n.r <= r) f(n.object, n.l, n.r);
+    if (n.l <= r) forEachContainedIn(n.right, l, r, f);
+  }
+};
+
+} // end of namespace physics
+} // end of namespace simu
+
+#endif // SIMU_INTERVALTREE_H
@@ -1,6 +1,7 @@
 #include "organ.h"
 
 #include "plant.h"  /// TODO Remove (for printing plant id)
+#include "snapshot.h"
 
 namespace simu {
 
@@ -25,9 +26,10 @@ Organ::Organ (Plant *plant, float w, float l, float r, char c, Layer t,
 }
 
 Organ* Organ::cloneAndUpdate(Organ *newParent, float rotation) {
-  Organ *clone = new Organ(_plant, _width, _length,
-                           _parentCoordinates.rotation + rotation,
-                           _symbol,  _layer, newParent);
+  Organ *clone = _plant->organPool().make(
+                   _plant, _width, _length,
+                   _parentCoordinates.rotation + rotation,
+                   _symbol,  _layer, newParent);
 
   _cloned = true;
 
@@ -143,6 +145,7 @@ void Organ::updateBoundingBox(void) {
     _plantCoordinates.center = pr.center();
   }
 
+  _plant->organMoved(this);
 
   updateGlobalTransformation();
 }
@@ -204,7 +207,7 @@ std::ostream& operator<< (std::ostream &os, const Organ &o) {
 }
 
 Organ* Organ::clone (const Organ *that_o, Plant *const this_p) {
-  Organ *this_o = new Organ (this_p);
+  Organ *this_o = this_p->organPool().make(this_p);
 
   this_o->_id = that_o->_id;
 
@@ -278,7 +281,8 @@ void Organ::save (nlohmann::json &j, const Organ &o) {
 Organ* Organ::load (const nlohmann::json &j, Organ *parent, Plant *plant,
                     Collection &organs) {
 
-  Organ *o = new Organ(plant, j[3], j[4], j[1], j[5].get<char>(), j[6], parent);
+  Organ *o = plant->organPool().make(plant, j[3], j[4], j[1],
+                                     j[5].get<char>(), j[6], parent);
   o->setID(j[0]);
 
   simu::load(j[2], o->_plantCoordinates);
@@ -301,6 +305,85 @@ Organ* Organ::load (const nlohmann::json &j, Organ *parent, Plant *plant,
   return o;
 }
 
+void Organ::save (snapshot::Writer &w, const Organ &o, int32_t parent,
+                  uint32_t first) {
+  snapshot::OrganRecord r {};
+  r.id = o._id;
+  r.parent = parent;
+  r.rotation = o._parentCoordinates.rotation;
+  r.width = o._width;
+  r.length = o._length;
+  r.surface = o._surface;
+  r.baseBiomass = o._baseBiomass;
+  r.accumulatedBiomass = o._accumulatedBiomass;
+  r.requiredBiomass = o._requiredBiomass;
+
+  const PlantCoordinates &pc = o._plantCoordinates;
+  r.origin[0] = pc.origin.x;  r.origin[1] = pc.origin.y;
+  r.end[0] = pc.end.x;        r.end[1] = pc.end.y;
+  r.center[0] = pc.center.x;  r.center[1] = pc.center.y;
+  r.plantRotation = pc.rotation;
+
+  r.symbol = o._symbol;
+  r.layer = uint8_t(o._layer);
+
+  int32_t index = w.organs.size() - first;
+  w.organs.push_back(r);
+  for (Organ *c: o._children) save(w, *c, index, first);
+}
+
+Organ* Organ::load (const snapshot::OrganRecord &r, Organ *parent,
+                    Plant *plant, Collection &organs) {
+
+  Organ *o = plant->organPool().make(plant, r.width, r.length, r.rotation,
+                                     r.symbol, Layer(r.layer), parent);
+  o->setID(OID(r.id));
+
+  PlantCoordinates &pc = o->_plantCoordinates;
+  pc.origin = { r.origin[0], r.origin[1] };
+  pc.end = { r.end[0], r.end[1] };
+  pc.center = { r.center[0], r.center[1] };
+  pc.rotation = r.plantRotation;
+
+  o->_surface = r.surface;
+  o->_baseBiomass = r.baseBiomass;
+  o->_accumulatedBiomass = r.accumulatedBiomass;
+  o->_requiredBiomass = r.requiredBiomass;
+
+  o->updateBoundingBox();
+  o->updateGlobalTransformation();
+
+  organs.insert(o);
+  return o;
+}
+
+void Organ::saveState (nlohmann::json &j, const Organ &o) {
+  nlohmann::json jpc;
+  simu::save(jpc, o._plantCoordinates);
+
+  j = {
+    o._id,
+    o._width, o._length,
+    o._surface,
+    o._baseBiomass, o._accumulatedBiomass, o._requiredBiomass,
+    jpc
+  };
+}
+
+void Organ::applyState (nlohmann::json &j, const States &states) {
+  auto it = states.find(j[0].get<OID>());
+  if (it != states.end()) {
+    const nlohmann::json &js = *it->second;
+    j[2] = js[7];
+    j[3] = js[1];
+    j[4] = js[2];
+    for (uint i=0; i<4; i++)  j[7+i] = js[3+i];
+  }
+
+  for (nlohmann::json &jc: j[11])
+    applyState(jc, states);
+}
+
 void assertEqual (const Organ::ParentCoordinates &lhs,
                   const Organ::ParentCoordinates &rhs, bool deepcopy) {
   utils::assertEqual(lhs.rotation, rhs.rotation, deepcopy);
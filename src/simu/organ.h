@@ -9,6 +9,12 @@ namespace simu {
 
 struct Plant;
 
+namespace snapshot {
+class Writer;
+class Reader;
+struct OrganRecord;
+} // end of namespace snapshot
+
 class Organ {
 public:
   using Symbol = genotype::grammar::Symbol;
@@ -79,6 +85,7 @@ private:
   float _baseBiomass, _accumulatedBiomass, _requiredBiomass;
 
   Organ (Plant *const p) : _plant(p) {}
+  friend class OrganPool;
 
 public:
   Organ (Plant *plant, float w, float l, float r, char c, Layer t,
@@ -188,6 +195,24 @@ public:
   static Organ* load (const nlohmann::json &j, Organ *parent, Plant *plant,
                       Collection &organs);
 
+  /// Appends \p o and its subtree (depth-first) to \p w's organs
+  /// \p parent is the index of the parent's record relative to \p first, the
+  /// index of the plant's first organ
+  static void save (snapshot::Writer &w, const Organ &o, int32_t parent,
+                    uint32_t first);
+
+  /// Rebuilds an organ from its record (children are handled by the caller)
+  static Organ* load (const snapshot::OrganRecord &r, Organ *parent,
+                      Plant *plant, Collection &organs);
+
+  /// Saves the values that evolve with biomass (not the subtree)
+  static void saveState (nlohmann::json &j, const Organ &o);
+
+  /// Recursively overwrites, in \p j (as produced by save()), the values of
+  /// every organ found in \p states
+  using States = std::map<OID, const nlohmann::json*>;
+  static void applyState (nlohmann::json &j, const States &states);
+
   friend void assertEqual (const Organ &lhs, const Organ &rhs, bool deepcopy);
 };
 
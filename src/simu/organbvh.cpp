@@ -0,0 +1,261 @@
+#include <algorithm>
+
+#include "organbvh.h"
+
+namespace simu {
+
+static Rect enlarged (const Rect &r, float m) {
+  return { { r.l() - m, r.t() + m }, { r.r() + m, r.b() - m } };
+}
+
+static Rect united (Rect lhs, const Rect &rhs) {
+  return lhs.uniteWith(rhs);
+}
+
+static float perimeter (const Rect &r) {
+  return 2 * (r.width() + r.height());
+}
+
+static bool contains (const Rect &lhs, const Rect &rhs) {
+  return lhs.l() <= rhs.l() && rhs.r() <= lhs.r()
+      && lhs.b() <= rhs.b() && rhs.t() <= lhs.t();
+}
+
+static Rect boundsOf (const Organ *o) {
+  return enlarged(o->inPlantCoordinates().boundingRect, OrganBVH::margin);
+}
+
+void OrganBVH::insert (const Organ *o) {
+  auto it = _leaves.find(o);
+  if (it != _leaves.end())  return;
+
+  int leaf = allocate();
+  Node &n = _nodes[leaf];
+  n.bounds = boundsOf(o);
+  n.organ = o;
+  _leaves.emplace(o, leaf);
+  insertLeaf(leaf);
+}
+
+void OrganBVH::erase (const Organ *o) {
+  auto it = _leaves.find(o);
+  if (it == _leaves.end())  return;
+
+  removeLeaf(it->second);
+  release(it->second);
+  _leaves.erase(it);
+}
+
+void OrganBVH::update (const Organ *o) {
+  auto it = _leaves.find(o);
+  if (it == _leaves.end())  return;
+
+  int leaf = it->second;
+  if (contains(_nodes[leaf].bounds, o->inPlantCoordinates().boundingRect))
+    return;
+
+  removeLeaf(leaf);
+  _nodes[leaf].bounds = boundsOf(o);
+  insertLeaf(leaf);
+}
+
+void OrganBVH::clear (void) {
+  _nodes.clear();
+  _leaves.clear();
+  _root = _free = null;
+}
+
+int OrganBVH::allocate (void) {
+  int i;
+  if (_free != null) {
+    i = _free;
+    _free = _nodes[i].parent;
+  } else {
+    i = _nodes.size();
+    _nodes.emplace_back();
+  }
+
+  Node &n = _nodes[i];
+  n.organ = nullptr;
+  n.parent = n.left = n.right = null;
+  n.height = 0;
+  return i;
+}
+
+void OrganBVH::release (int i) {
+  _nodes[i].parent = _free;
+  _nodes[i].height = -1;
+  _free = i;
+}
+
+void OrganBVH::insertLeaf (int leaf) {
+  if (_root == null) {
+    _root = leaf;
+    _nodes[leaf].parent = null;
+    return;
+  }
+
+  // Find the best sibling (cheapest increase in perimeter)
+  const Rect bounds = _nodes[leaf].bounds;
+  int i = _root;
+  while (!_nodes[i].isLeaf()) {
+    const Node &n = _nodes[i];
+    const float p = perimeter(n.bounds),
+                cp = perimeter(united(n.bounds, bounds));
+
+    // Cost of creating a new parent for this node and the new leaf
+    const float cost = 2 * cp;
+
+    // Minimum cost of pushing the leaf further down the tree
+    const float inheritance = 2 * (cp - p);
+
+    float costs [2];
+    const int children [2] { n.left, n.right };
+    for (uint j=0; j<2; j++) {
+      const Node &c = _nodes[children[j]];
+      costs[j] = perimeter(united(c.bounds, bounds)) + inheritance;
+      if (!c.isLeaf())  costs[j] -= perimeter(c.bounds);
+    }
+
+    if (cost < costs[0] && cost < costs[1]) break;
+    i = (costs[0] < costs[1]) ? children[0] : children[1];
+  }
+
+  // Create a new parent for the sibling and the leaf
+  const int sibling = i;
+  const int oldParent = _nodes[sibling].parent;
+  const int newParent = allocate();
+  Node &p = _nodes[newParent];
+  p.parent = oldParent;
+  p.bounds = united(_nodes[sibling].bounds, bounds);
+  p.height = _nodes[sibling].height + 1;
+  p.left = sibling;
+  p.right = leaf;
+
+  if (oldParent != null) {
+    Node &op = _nodes[oldParent];
+    if (op.left == sibling) op.left = newParent;
+    else                    op.right = newParent;
+  } else
+    _root = newParent;
+
+  _nodes[sibling].parent = newParent;
+  _nodes[leaf].parent = newParent;
+
+  refit(newParent);
+}
+
+void OrganBVH::removeLeaf (int leaf) {
+  if (leaf == _root) {
+    _root = null;
+    return;
+  }
+
+  const int parent = _nodes[leaf].parent;
+  const int grandParent = _nodes[parent].parent;
+  const int sibling = (_nodes[parent].left == leaf) ? _nodes[parent].right
+                                                    : _nodes[parent].left;
+
+  if (grandParent != null) {
+    Node &gp = _nodes[grandParent];
+    if (gp.left == parent)  gp.left = sibling;
+    else                    gp.right = sibling;
+    _nodes[sibling].parent = grandParent;
+    release(parent);
+    refit(grandParent);
+
+  } else {
+    _root = sibling;
+    _nodes[sibling].parent = null;
+    release(parent);
+  }
+
+  _nodes[leaf].parent = null;
+}
+
+void OrganBVH::refit (int i) {
+  while (i != null) {
+    i = balance(i);
+
+    Node &n = _nodes[i];
+    const Node &l = _nodes[n.left], &r = _nodes[n.right];
+    n.height = 1 + std::max(l.height, r.height);
+    n.bounds = united(l.bounds, r.bounds);
+
+    i = n.parent;
+  }
+}
+
+int OrganBVH::balance (int ia) {
+  Node &a = _nodes[ia];
+  if (a.isLeaf() || a.height < 2) return ia;
+
+  const int ib = a.left, ic = a.right;
+  Node &b = _nodes[ib], &c = _nodes[ic];
+  const int diff = c.height - b.height;
+
+  // Rotate c up
+  if (diff > 1) {
+    const int ifc = c.left, igc = c.right;
+    Node &f = _nodes[ifc], &g = _nodes[igc];
+
+    c.left = ia;
+    c.parent = a.parent;
+    a.parent = ic;
+
+    if (c.parent != null) {
+      Node &cp = _nodes[c.parent];
+      if (cp.left == ia)  cp.left = ic;
+      else                cp.right = ic;
+    } else
+      _root = ic;
+
+    // Keep the tallest of c's children under c
+    const bool fTaller = f.height > g.height;
+    const int ikeep = fTaller ? ifc : igc, imove = fTaller ? igc : ifc;
+    Node &keep = _nodes[ikeep], &move = _nodes[imove];
+    c.right = ikeep;
+    a.right = imove;
+    move.parent = ia;
+    a.bounds = united(b.bounds, move.bounds);
+    c.bounds = united(a.bounds, keep.bounds);
+    a.height = 1 + std::max(b.height, move.height);
+    c.height = 1 + std::max(a.height, keep.height);
+
+    return ic;
+  }
+
+  // Rotate b up
+  if (diff < -1) {
+    const int id = b.left, ie = b.right;
+    Node &d = _nodes[id], &e = _nodes[ie];
+
+    b.left = ia;
+    b.parent = a.parent;
+    a.parent = ib;
+
+    if (b.parent != null) {
+      Node &bp = _nodes[b.parent];
+      if (bp.left == ia)  bp.left = ib;
+      else                bp.right = ib;
+    } else
+      _root = ib;
+
+    const bool dTaller = d.height > e.height;
+    const int ikeep = dTaller ? id : ie, imove = dTaller ? ie : id;
+    Node &keep = _nodes[ikeep], &move = _nodes[imove];
+    b.right = ikeep;
+    a.left = imove;
+    move.parent = ia;
+    a.bounds = united(c.bounds, move.bounds);
+    b.bounds = united(a.bounds, keep.bounds);
+    a.height = 1 + std::max(c.height, move.height);
+    b.height = 1 + std::max(a.height, keep.height);
+
+    return ib;
+  }
+
+  return ia;
+}
+
+} // end of namespace simu
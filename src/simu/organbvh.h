@@ -0,0 +1,100 @@
+#ifndef SIMU_ORGANBVH_H
+#define SIMU_ORGANBVH_H
+
+/// Dynamic bounding volume hierarchy over a plant's terminal organs
+///
+/// Leaves store the organs' bounding rects in plant coordinates (so that
+/// moving the whole plant does not invalidate them), enlarged by a small
+/// margin so that growing organs rarely need to be reinserted. The tree is
+/// kept balanced through rotations (as in Box2D's b2DynamicTree) so that
+/// queries cost O(log n + k).
+
+#include <unordered_map>
+#include <vector>
+
+#include "organ.h"
+
+namespace simu {
+
+class OrganBVH {
+public:
+  /// Slack around leaves (in plant coordinates)
+  static constexpr float margin = .01f;
+
+  /// Registers \p o (if not already present)
+  void insert (const Organ *o);
+
+  /// Unregisters \p o (if present)
+  void erase (const Organ *o);
+
+  /// Refits the tree after \p o moved (if present)
+  void update (const Organ *o);
+
+  void clear (void);
+
+  size_t size (void) const {
+    return _leaves.size();
+  }
+
+  /// Calls \p f(o) for every organ whose enlarged bounds intersect \p r
+  /// (in plant coordinates)
+  /// \note This is a superset of the organs intersecting \p r
+  template <typename F>
+  void query (const Rect &r, F &&f) const {
+    if (_root == null)  return;
+
+    // Shared by all queries of this thread (and reentrant)
+    static thread_local std::vector<int> stack;
+    const size_t base = stack.size();
+    stack.push_back(_root);
+    while (stack.size() > base) {
+      const Node &n = _nodes[stack.back()];
+      stack.pop_back();
+      if (!intersects(n.bounds, r)) continue;
+      if (n.isLeaf())
+        f(n.organ);
+      else {
+        stack.push_back(n.left);
+        stack.push_back(n.right);
+      }
+    }
+  }
+
+private:
+  static constexpr int null = -1;
+
+  struct Node {
+    Rect bounds;
+    const Organ *organ;
+    int parent; ///< Also next free node when released
+    int left, right;
+    int height; ///< 0 for leaves
+
+    bool isLeaf (void) const {
+      return left == null;
+    }
+  };
+
+  std::vector<Node> _nodes;
+  int _root = null;
+  int _free = null;
+
+  std::unordered_map<const Organ*, int> _leaves;
+
+  int allocate (void);
+  void release (int i);
+
+  void insertLeaf (int leaf);
+  void removeLeaf (int leaf);
+
+  /// Recomputes bounds and heights from \p i up to the root
+  void refit (int i);
+
+  /// Performs a left or right rotation if node \p a is imbalanced
+  /// \returns the index of the new root of the subtree
+  int balance (int a);
+};
+
+} // end of namespace simu
+
+#endif // SIMU_ORGANBVH_H
@@ -0,0 +1,41 @@
+#include "organpool.h"
+
+namespace simu {
+
+static constexpr bool debugOrganPool = false;
+
+void* OrganPool::allocate (void) {
+  if (!_free) {
+    _chunks.emplace_back(new Slot [chunkSize]);
+    Slot *chunk = _chunks.back().get();
+    for (uint i=0; i+1<chunkSize; i++)  chunk[i].next = &chunk[i+1];
+    chunk[chunkSize-1].next = nullptr;
+    _free = chunk;
+
+    if (debugOrganPool)
+      std::cerr << "OrganPool grew to " << capacity() << " slots" << std::endl;
+  }
+
+  Slot *s = _free;
+  _free = s->next;
+  return s;
+}
+
+void OrganPool::release (Organ *o) {
+  assert(_live > 0);
+  o->~Organ();
+  Slot *s = reinterpret_cast<Slot*>(o);
+  s->next = _free;
+  _free = s;
+  _live--;
+}
+
+void OrganPool::clear (const Organ::Collection &live) {
+  assert(live.size() == _live);
+  for (Organ *o: live)  o->~Organ();
+  _chunks.clear();
+  _free = nullptr;
+  _live = 0;
+}
+
+} // end of namespace simu
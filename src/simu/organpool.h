@@ -0,0 +1,66 @@
+#ifndef SIMU_ORGANPOOL_H
+#define SIMU_ORGANPOOL_H
+
+/// Per-plant storage for organs
+///
+/// Organs are constructed in fixed-size chunks which are only ever returned to
+/// the global allocator when the whole pool is cleared (i-e when the plant
+/// dies). Released organs (deleted or rejected during a derivation) go into an
+/// intrusive free list and are reused by subsequent allocations.
+
+#include "organ.h"
+
+namespace simu {
+
+class OrganPool {
+public:
+  static constexpr uint chunkSize = 32;
+
+  OrganPool (void) : _free(nullptr), _live(0) {}
+
+  OrganPool (const OrganPool&) = delete;
+  OrganPool& operator= (const OrganPool&) = delete;
+
+  /// Constructs a new organ from \p args in a free slot
+  template <typename... ARGS>
+  Organ* make (ARGS&&... args) {
+    void *slot = allocate();
+    Organ *o = new (slot) Organ (std::forward<ARGS>(args)...);
+    _live++;
+    return o;
+  }
+
+  /// Destroys \p o and puts its slot back into the free list
+  void release (Organ *o);
+
+  /// Destroys all organs in \p live and frees every chunk at once
+  /// \warning Any other organ from this pool is discarded without having its
+  /// destructor called
+  void clear (const Organ::Collection &live);
+
+  /// Number of organs currently allocated
+  size_t live (void) const {
+    return _live;
+  }
+
+  /// Number of organs that can be allocated without a new chunk
+  size_t capacity (void) const {
+    return _chunks.size() * chunkSize;
+  }
+
+private:
+  union Slot {
+    Slot *next;
+    alignas(Organ) unsigned char storage [sizeof(Organ)];
+  };
+
+  std::vector<std::unique_ptr<Slot[]>> _chunks;
+  Slot *_free;
+  size_t _live;
+
+  void* allocate (void);
+};
+
+} // end of namespace simu
+
+#endif // SIMU_ORGANPOOL_H
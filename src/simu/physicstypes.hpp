@@ -1,6 +1,7 @@
 #ifndef PHYSICS_TYPES_HPP
 #define PHYSICS_TYPES_HPP
 
+#include <cstdint>
 #include <vector>
 #include <set>
 
@@ -82,6 +83,20 @@ struct Pistil {
   friend bool operator< (const Point &lhs, const Pistil &rhs);
 };
 
+/// A plant a branch is tested against (see TinyPhysicsEngine::neighbourhood)
+struct Neighbour {
+  uint64_t plant; ///< Plant id
+  uint epoch;     ///< Plant geometry epoch
+  Rect bounds;
+
+  friend bool operator== (const Neighbour &lhs, const Neighbour &rhs) {
+    return lhs.plant == rhs.plant && lhs.epoch == rhs.epoch
+        && lhs.bounds.l() == rhs.bounds.l() && lhs.bounds.r() == rhs.bounds.r()
+        && lhs.bounds.t() == rhs.bounds.t() && lhs.bounds.b() == rhs.bounds.b();
+  }
+};
+using Neighbourhood = std::vector<Neighbour>;
+
 enum CollisionResult {
     AUTO_COLLISION = 1<<0,
   BRANCH_COLLISION = 1<<1,
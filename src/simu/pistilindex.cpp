@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <numeric>
+
+#include "pistilindex.h"
+#include "plant.h"
+
+namespace simu {
+namespace physics {
+
+static PistilIndex::Tag tagOf (const Organ *o) {
+  return { uint64_t(o->plant()->id()), uint(o->id()) };
+}
+
+static bool before (float lhsX, const PistilIndex::Tag &lhsT,
+                    float rhsX, const PistilIndex::Tag &rhsT) {
+  if (lhsX != rhsX) return lhsX < rhsX;
+  return lhsT < rhsT;
+}
+
+/// Whether a pistil at \p x is too far left to reach a stamen at \p sx
+/// (\p range being the sum of their maximal radii). Same rounding as
+/// intersects() so that the windows below are supersets of the results
+static bool leftOf (float x, float sx, float range) {
+  return sx - x > range;
+}
+
+static bool rightOf (float x, float sx, float range) {
+  return x - sx > range;
+}
+
+void PistilIndex::Columns::push (Organ *o, const Plant *p, const Tag &t,
+                                 const Disk &d) {
+  x.push_back(d.center.x);
+  y.push_back(d.center.y);
+  radii.push_back(d.radius);
+  organs.push_back(o);
+  plants.push_back(p);
+  tags.push_back(t);
+}
+
+void PistilIndex::Columns::push (const Columns &that, uint i) {
+  push(that.organs[i], that.plants[i], that.tags[i], that.disk(i));
+}
+
+void PistilIndex::Columns::clear (void) {
+  x.clear();
+  y.clear();
+  radii.clear();
+  organs.clear();
+  plants.clear();
+  tags.clear();
+}
+
+void PistilIndex::insert (Organ *o, const Disk &d) {
+  patch(o, Patch { o, o->plant(), tagOf(o), d, false });
+}
+
+void PistilIndex::erase (const Organ *o) {
+  patch(o, Patch { nullptr, nullptr, Tag(), Disk(), true });
+}
+
+void PistilIndex::erase (const Plant *p) {
+  for (uint i=0; i<_columns.size(); i++)
+    if (_columns.plants[i] == p)  erase(_columns.organs[i]);
+
+  for (Patch &patch: _patches)
+    if (patch.plant == p) patch = Patch { nullptr, nullptr, Tag(), Disk(), true };
+}
+
+void PistilIndex::patch (const Organ *o, const Patch &p) {
+  auto it = _patched.find(o);
+  if (it != _patched.end())
+    _patches[it->second] = p;
+  else {
+    _patched.emplace(o, _patches.size());
+    _patches.push_back(p);
+  }
+}
+
+void PistilIndex::clear (void) {
+  _columns.clear();
+  _buffer.clear();
+  _maxRadius = 0;
+  _patches.clear();
+  _patched.clear();
+  _prepared.clear();
+  _candidates.clear();
+}
+
+void PistilIndex::commit (void) {
+  if (_patches.empty()) return;
+
+  std::sort(_patches.begin(), _patches.end(),
+            [] (const Patch &lhs, const Patch &rhs) {
+    return before(lhs.disk.center.x, lhs.tag, rhs.disk.center.x, rhs.tag);
+  });
+
+  // Merge surviving entries with the new ones
+  _buffer.clear();
+  auto itP = _patches.begin();
+  const auto pushPatch = [this] (const Patch &p) {
+    if (!p.erased)  _buffer.push(p.organ, p.plant, p.tag, p.disk);
+  };
+  for (uint i=0; i<_columns.size(); i++) {
+    if (_patched.find(_columns.organs[i]) != _patched.end())  continue;
+    for (; itP != _patches.end()
+           && before(itP->disk.center.x, itP->tag,
+                     _columns.x[i], _columns.tags[i]); ++itP)
+      pushPatch(*itP);
+    _buffer.push(_columns, i);
+  }
+  for (; itP != _patches.end(); ++itP)  pushPatch(*itP);
+  std::swap(_columns, _buffer);
+
+  const auto &radii = _columns.radii;
+  _maxRadius = radii.empty() ? 0 : *std::max_element(radii.begin(), radii.end());
+
+  _patches.clear();
+  _patched.clear();
+  _prepared.clear();
+  _candidates.clear();
+}
+
+void PistilIndex::prepare (
+    const std::vector<std::pair<const Organ*, Disk>> &stamens) {
+
+  commit();
+  _prepared.clear();
+  _candidates.clear();
+
+  // Sort the queries by left end of their windows
+  std::vector<uint> order (stamens.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&stamens] (uint lhs, uint rhs) {
+    const Disk &l = stamens[lhs].second, &r = stamens[rhs].second;
+    return l.center.x - l.radius < r.center.x - r.radius;
+  });
+
+  const auto &x = _columns.x;
+  const uint n = size();
+  uint lo = 0;
+  for (uint q: order) {
+    const Disk &d = stamens[q].second;
+    const float sx = d.center.x, range = d.radius + _maxRadius;
+
+    // Window start only moves forward (up to rounding errors)
+    while (lo < n && leftOf(x[lo], sx, range))     lo++;
+    while (lo > 0 && !leftOf(x[lo-1], sx, range))  lo--;
+
+    Prepared p { d, uint(_candidates.size()), 0 };
+    for (uint i=lo; i<n && !rightOf(x[i], sx, range); i++)
+      if (intersects(_columns.disk(i), d))  _candidates.push_back(i);
+    p.end = _candidates.size();
+    _prepared.insert_or_assign(stamens[q].first, p);
+  }
+}
+
+void PistilIndex::query (const Organ *s, const Disk &d,
+                         std::vector<Pistil> &out) const {
+  out.clear();
+
+  // Pending pistils in range, in index order
+  std::vector<const Patch*> patches;
+  for (const Patch &p: _patches)
+    if (!p.erased && intersects(p.disk, d)) patches.push_back(&p);
+  std::sort(patches.begin(), patches.end(),
+            [] (const Patch *lhs, const Patch *rhs) {
+    return before(lhs->disk.center.x, lhs->tag, rhs->disk.center.x, rhs->tag);
+  });
+
+  auto itP = patches.begin();
+  const auto emit = [&] (uint i) {
+    if (_patched.find(_columns.organs[i]) != _patched.end()) return;
+    for (; itP != patches.end()
+           && before((*itP)->disk.center.x, (*itP)->tag,
+                     _columns.x[i], _columns.tags[i]); ++itP)
+      out.emplace_back((*itP)->organ, (*itP)->disk);
+    out.push_back(_columns.pistil(i));
+  };
+
+  auto it = _prepared.find(s);
+  if (it != _prepared.end()
+      && it->second.disk.center == d.center
+      && it->second.disk.radius == d.radius) {
+    for (uint k=it->second.begin; k<it->second.end; k++)
+      emit(_candidates[k]);
+
+  } else {
+    const auto &x = _columns.x;
+    const float sx = d.center.x, range = d.radius + _maxRadius;
+    uint i = std::lower_bound(x.begin(), x.end(), sx,
+                              [range] (float x, float sx) {
+               return leftOf(x, sx, range);
+             }) - x.begin();
+    for (; i<size() && !rightOf(x[i], sx, range); i++)
+      if (intersects(_columns.disk(i), d))  emit(i);
+  }
+
+  for (; itP != patches.end(); ++itP)
+    out.emplace_back((*itP)->organ, (*itP)->disk);
+}
+
+} // end of namespace physics
+} // end of namespace simu
@@ -0,0 +1,136 @@
+#ifndef SIMU_PISTILINDEX_H
+#define SIMU_PISTILINDEX_H
+
+/// Flat spatial index for the pistils
+///
+/// Pistils are stored as sorted columns (structure of arrays) ordered by x
+/// (ties broken by plant/organ ids). Modifications are buffered as patches,
+/// keyed by organ, and merged into the columns in a single pass on commit().
+/// Queries see the patched state at all times.
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "physicstypes.hpp"
+
+namespace simu {
+namespace physics {
+
+class PistilIndex {
+public:
+  /// Plant and organ ids (tie-breaker for identical x)
+  using Tag = std::pair<uint64_t, uint>;
+
+  /// Registers \p o at \p d (or moves it there)
+  void insert (Organ *o, const Disk &d);
+
+  /// Unregisters \p o (if present)
+  void erase (const Organ *o);
+
+  /// Unregisters all pistils of \p p
+  void erase (const Plant *p);
+
+  void clear (void);
+
+  /// Merges pending modifications into the columns
+  void commit (void);
+
+  /// Answers the queries of all \p stamens (and their bounding disks) in a
+  /// single sweep. The results are used by query() as long as the index is
+  /// not committed and the stamen has not moved
+  void prepare (const std::vector<std::pair<const Organ*, Disk>> &stamens);
+
+  /// Fills \p out with the pistils intersecting \p d (in index order)
+  /// \p s is the stamen the query is made for (see prepare())
+  void query (const Organ *s, const Disk &d, std::vector<Pistil> &out) const;
+
+  /// Number of committed pistils
+  size_t size (void) const {
+    return _columns.size();
+  }
+
+  /// \returns the \p i-th committed pistil
+  Pistil operator[] (uint i) const {
+    return _columns.pistil(i);
+  }
+
+  /// Calls \p f(organ, disk) for every pistil (committed or not)
+  template <typename F>
+  void forEach (F &&f) const {
+    for (uint i=0; i<_columns.size(); i++)
+      if (_patched.find(_columns.organs[i]) == _patched.end())
+        f(_columns.organs[i], _columns.disk(i));
+    for (const Patch &p: _patches)
+      if (!p.erased)  f(p.organ, p.disk);
+  }
+
+  struct const_iterator {
+    const PistilIndex &index;
+    uint i;
+
+    Pistil operator* (void) const { return index[i];  }
+    const_iterator& operator++ (void) { ++i; return *this; }
+    bool operator!= (const const_iterator &that) const {
+      return i != that.i;
+    }
+  };
+
+  /// Iteration over the committed pistils
+  const_iterator begin (void) const { return { *this, 0 };  }
+  const_iterator end (void) const { return { *this, uint(size()) }; }
+
+private:
+  struct Columns {
+    std::vector<float> x, y, radii;
+    std::vector<Organ*> organs;
+    std::vector<const Plant*> plants;
+    std::vector<Tag> tags;
+
+    size_t size (void) const {
+      return x.size();
+    }
+
+    Disk disk (uint i) const {
+      return { { x[i], y[i] }, radii[i] };
+    }
+
+    Pistil pistil (uint i) const {
+      return Pistil(organs[i], disk(i));
+    }
+
+    void push (Organ *o, const Plant *p, const Tag &t, const Disk &d);
+    void push (const Columns &that, uint i);
+    void clear (void);
+  };
+
+  struct Patch {
+    Organ *organ;   ///< nullptr if erased
+    const Plant *plant;
+    Tag tag;
+    Disk disk;
+    bool erased;
+  };
+
+  Columns _columns, _buffer;
+  float _maxRadius = 0;
+
+  /// Latest modification of each patched organ
+  std::vector<Patch> _patches;
+  std::unordered_map<const Organ*, uint> _patched;
+
+  struct Prepared {
+    Disk disk;
+    uint begin, end;
+  };
+  std::unordered_map<const Organ*, Prepared> _prepared;
+  std::vector<uint> _candidates;
+
+  void patch (const Organ *o, const Patch &p);
+};
+
+} // end of namespace physics
+} // end of namespace simu
+
+#endif // SIMU_PISTILINDEX_H
@@ -2,6 +2,8 @@
 
 #include "plant.h"
 #include "environment.h"
+#include "snapshot.h"
+#include "profiler.h"
 
 using genotype::LSystemType;
 
@@ -36,6 +38,7 @@ Plant::Plant(const Genome &g, const Point &pos)
     _pstats(nullptr), _pstatsWC(nullptr) {
 
   _nextOrganID = OID(0);
+  _geometryEpoch = 0;
 
   _biomasses.fill(0);
 
@@ -56,8 +59,7 @@ Plant::~Plant (void) {
     autopsy();
     utils::doThrow<std::logic_error>(oss.str());
   }
-  for (Organ *o: _organs)
-    delete o;
+  _organPool.clear(_organs);
   if (_pstats)  _pstats->plant = nullptr;
 }
 
@@ -233,6 +235,11 @@ uint Plant::deriveRules(Environment &env) {
                   << "%)" << std::endl;
       continue;
 
+    } else if (stillBlocked(apex, env)) {
+      if (debugDerivation > 1)
+        std::cerr << OrganID(apex) << " Apex is still blocked" << std::endl;
+      continue;
+
     } else if (debugDerivation)
       std::cerr << OrganID(apex) << " Applying " << apex->symbol() << " -> "
                 << succ << std::endl;
@@ -254,15 +261,14 @@ uint Plant::deriveRules(Environment &env) {
       if (apex->parent() == newApex)  stBases.insert(c_);
     }
 
-    // Create temporary collision data
-    const auto inSelf = [apex] (const Organ *o) {
-      return (o != apex) && !o->isUncommitted();
-    };
-    Branch self (_bases, inSelf);
-
+    // Create temporary collision data (the rest of the plant is queried
+    // through the organ tree)
     Branch branch (stBases);
 
     if (debugDerivation > 1) {
+      const auto inSelf = [apex] (const Organ *o) {
+        return (o != apex) && !o->isUncommitted();
+      };
       std::cerr << "Rule:\n";
       for (Organ *st: stBases)
         printSubTree(st, 13, [&newOrgans] (const Organ *o) {
@@ -277,7 +283,9 @@ uint Plant::deriveRules(Environment &env) {
 
     // Perform collision detection
     using CR = physics::CollisionResult;
-    CR cres = env.collisionTest(this, self, branch, newOrgans);
+    CR cres = env.collisionTest(this, apex, branch, newOrgans);
+    if (config::Simulation::collisionMemo())
+      env.collisionMemoStats().misses++;
 
     if (cres != CR::NO_COLLISION) {
       if (debugDerivation) {
@@ -300,6 +308,17 @@ uint Plant::deriveRules(Environment &env) {
         // Also delete apex
         updateSubtree(apex, apex->parent(), apex->localRotation());
         delOrgan(apex, env);
+
+      } else if (config::Simulation::collisionMemo()) {
+        // Remember why so that the test is not repeated needlessly
+        CollisionMemo &m = _collisionMemos[apex->id()];
+        m.epoch = _geometryEpoch;
+        m.topology = env.topologyEpoch();
+        m.result = cres;
+        m.bounds = branch.bounds;
+        m.neighbours.clear();
+        if (cres == CR::INTER_COLLISION)
+          env.collisionNeighbourhood(this, m.bounds, m.neighbours);
       }
 
       continue;
@@ -455,8 +474,8 @@ Organ* Plant::turtleParse (Organ *parent, const std::string &successor,
 
 Organ* Plant::makeOrgan(Organ *parent, float angle, char symbol, Layer type) {
   auto size = _genome.sizeOf(symbol);
-  Organ *o = new Organ(this, size.width, size.length, angle,
-                       symbol, type, parent);
+  Organ *o = _organPool.make(this, size.width, size.length, angle,
+                             symbol, type, parent);
 
   if (debugOrganManagement) {
     std::cerr << PlantID(this) << " Created " << *o;
@@ -469,6 +488,30 @@ Organ* Plant::makeOrgan(Organ *parent, float angle, char symbol, Layer type) {
   return o;
 }
 
+bool Plant::stillBlocked (const Organ *apex, const Environment &env) {
+  if (!config::Simulation::collisionMemo()) return false;
+
+  auto it = _collisionMemos.find(apex->id());
+  if (it == _collisionMemos.end())  return false;
+
+  // Same plant, same ground and (for inter-plant collisions) same neighbours
+  // -> same outcome
+  const CollisionMemo &m = it->second;
+  bool valid = (m.epoch == _geometryEpoch && m.topology == env.topologyEpoch());
+  if (valid && m.result == physics::CollisionResult::INTER_COLLISION) {
+    physics::Neighbourhood n;
+    env.collisionNeighbourhood(this, m.bounds, n);
+    valid = (n == m.neighbours);
+  }
+
+  if (valid)
+    env.collisionMemoStats().hits++;
+  else
+    _collisionMemos.erase(it);
+
+  return valid;
+}
+
 void Plant::addOrgan(Organ *o, Environment &env) {
   assert(!o->isCloned()); // Must be commited
 
@@ -476,8 +519,10 @@ void Plant::addOrgan(Organ *o, Environment &env) {
     o->setID(_nextOrganID);
     _nextOrganID = OID(uint(_nextOrganID)+1);
   }
+  _geometryEpoch++;
 
   _organs.insert(o);
+  _dirty.set(DIRTY_STRUCTURE, true);
 
   if (debugOrganManagement) {
     std::cerr << PlantID(this) << " Inserted " << *o;
@@ -502,6 +547,7 @@ void Plant::assignToViews(Organ *o) {
   if (o->isNonTerminal()) _nonTerminals.insert(o);
   if (o->isHair())  _hairs.insert(o);
   if (o->isFlower())  _flowers.insert(o);
+  if (!o->isNonTerminal())  _organTree.insert(o);
 
   if (isSink(o))  _sinks.insert(o);
 }
@@ -516,12 +562,18 @@ void Plant::delOrgan(Organ *o, Environment &env) {
     std::cerr << std::endl;
   }
 
+  if (!o->isUncommitted()) {
+    _geometryEpoch++;
+    if (o->isNonTerminal()) _collisionMemos.erase(o->id());
+  }
+
   o->removeFromParent();
-  _organs.erase(o);
+  if (_organs.erase(o) > 0) _dirty.set(DIRTY_STRUCTURE, true);
   if (!o->parent()) _bases.erase(o);
   if (o->isNonTerminal()) _nonTerminals.erase(o);
   if (o->isHair())  _hairs.erase(o);
   if (isSink(o))  _sinks.erase(o);
+  _organTree.erase(o);
 
   if (o->isFlower()) {
     _flowers.erase(o);
@@ -536,7 +588,7 @@ void Plant::delOrgan(Organ *o, Environment &env) {
   }
 
   _dirty.set(DIRTY_COLLISION, true);
-  delete o;
+  _organPool.release(o);
 }
 
 bool Plant::destroyDeadSubtree(Organ *o, Environment &env) {
@@ -676,7 +728,18 @@ void Plant::metabolicStep(Environment &env) {
   const auto &f_p = SConfig::photosynthesisCost();
   const auto &f_E = SConfig::resourceCost();
 
-  float T = env.temperatureAt(_pos.x);
+  EnvironmentSamples &samples = _envSamples;
+  if (!samples.valid || samples.epoch != _geometryEpoch) {
+    samples.valid = true;
+    samples.epoch = _geometryEpoch;
+    samples.temperature = env.sampleAt(_pos);
+    samples.hairs.clear();
+    for (const Organ *h: _hairs)
+      samples.hairs.push_back(env.sampleAt(h->globalCoordinates().center));
+  }
+  env.waterAt(samples.hairs, samples.water);
+
+  float T = env.temperatureAt(samples.temperature);
   if (_pstats)  _pstatsWC->sumTemperature += T;
   float T_eff = heatEfficiency(T);
   float T_dir = utils::sgn(T - _genome.temperatureOptimal);
@@ -704,8 +767,9 @@ void Plant::metabolicStep(Environment &env) {
 
   if (_pstats)  _pstatsWC->tmpSum = 0;
 
+  uint hi = 0;
   for (Organ *h: _hairs) {
-    decimal w = env.waterAt(h->globalCoordinates().center);
+    decimal w = samples.water[hi++];
 
     if (_pstats)  _pstatsWC->tmpSum += w;
 
@@ -768,7 +832,7 @@ void Plant::metabolicStep(Environment &env) {
 
   if (_pstats)  _pstatsWC->tmpSum = 0;
 
-  const auto &canopy = env.canopy(this);
+  const auto canopy = env.canopy(this);
   for (const physics::UpperLayer::Item &i: canopy) {
     if (!i.organ->isLeaf()) continue;
 
@@ -1021,12 +1085,15 @@ void Plant::updateRequirements(void) {
 
 void Plant::updatePosition (float newx) {
   _pos.x = newx;
+  _geometryEpoch++;
   for (Organ *o: _organs) o->updateGlobalTransformation();
   updateGeometry();
 }
 
 void Plant::updateAltitude(Environment &env, float h) {
   _pos.y = h;
+  _geometryEpoch++;
+  invalidateEnvironmentSamples();
 
   // Store current pistils location
   std::map<Organ*, Point> oldPistilsPositions;
@@ -1070,7 +1137,10 @@ uint Plant::step(Environment &env) {
   if ((SConfig::DEBUG_NO_METABOLISM() || _age % SConfig::stepsPerDay() == 0)
     && !_nonTerminals.empty()) {
 
-    derived += deriveRules(env);
+    {
+      profiler::Scope profile (profiler::Phase::DERIVE_RULES);
+      derived += deriveRules(env);
+    }
     _derived += bool(derived);
 
     if (!_nonTerminals.empty()) {
@@ -1094,9 +1164,15 @@ uint Plant::step(Environment &env) {
     update(env);
   }
 
-  metabolicStep(env);
+  {
+    profiler::Scope profile (profiler::Phase::METABOLIC_STEP);
+    metabolicStep(env);
+  }
 
-  processFruits(env);
+  {
+    profiler::Scope profile (profiler::Phase::PROCESS_FRUITS);
+    processFruits(env);
+  }
 
   /// Recursively delete dead organs
   // First take note of the current flowers
@@ -1283,14 +1359,15 @@ Plant* Plant::clone (const Plant &that_p,
   this_p->_nextOrganID = that_p._nextOrganID;
 
   assert(!that_p._killed);
-  assert(that_p._dirty.none());
+  assert(!that_p.isDirty(DIRTY_METABOLISM)
+         && !that_p.isDirty(DIRTY_COLLISION));
 
   return this_p;
 }
 
 void Plant::save (nlohmann::json &j, const Plant &p) {
   assert(p._currentStepSeeds.empty());
-  assert(p._dirty.none());
+  assert(!p.isDirty(DIRTY_METABOLISM) && !p.isDirty(DIRTY_COLLISION));
   assert(!p._killed);
 
   nlohmann::json jo, jf;
@@ -1349,6 +1426,131 @@ Plant* Plant::load (const nlohmann::json &j) {
   return p;
 }
 
+void Plant::save (snapshot::Writer &w, const Plant &p) {
+  assert(p._currentStepSeeds.empty());
+  assert(!p.isDirty(DIRTY_METABOLISM) && !p.isDirty(DIRTY_COLLISION));
+  assert(!p._killed);
+
+  snapshot::PlantRecord r {};
+  r.genome = w.addGenome(p._genome);
+  r.age = p._age;
+  r.derived = p._derived;
+  r.nextOrganID = p._nextOrganID;
+  r.pos[0] = p._pos.x;
+  r.pos[1] = p._pos.y;
+  for (uint l=0; l<2; l++)
+    for (uint e=0; e<2; e++)
+      r.reserves[l][e] = p._reserves[l][e];
+
+  r.firstOrgan = w.organs.size();
+  for (const Organ *o: p._bases) Organ::save(w, *o, -1, r.firstOrgan);
+  r.organs = w.organs.size() - r.firstOrgan;
+  assert(r.organs == p._organs.size());
+
+  r.firstFruit = w.fruits.size();
+  for (const auto &f: p._fruits) {
+    snapshot::FruitRecord fr {};
+    fr.organ = f.second.fruit->id();
+    fr.firstGenome = w.genomes();
+    for (const Genome &g: f.second.genomes) w.addGenome(g);
+    fr.genomes = f.second.genomes.size();
+    w.fruits.push_back(fr);
+  }
+  r.fruits = p._fruits.size();
+
+  w.plants.push_back(r);
+}
+
+Plant* Plant::load (const snapshot::Reader &reader, uint i) {
+  const snapshot::PlantRecord &r = reader.plants()[i];
+  Point pos { r.pos[0], r.pos[1] };
+  Plant *p = new Plant (reader.genome(r.genome).get<Genome>(), pos);
+
+  p->_age = r.age;
+
+  // Parents are stored before their children: a single pass is enough
+  auto records = reader.organs();
+  std::vector<Organ*> organs (r.organs, nullptr);
+  std::map<OID, Organ*> fruits;
+  for (uint j=0; j<r.organs; j++) {
+    const snapshot::OrganRecord &or_ = records[r.firstOrgan + j];
+    Organ *parent = nullptr;
+    if (or_.parent >= 0) {
+      if (uint(or_.parent) >= j)
+        utils::doThrow<std::invalid_argument>(
+          "Invalid parent index ", or_.parent, " for organ ", j, " of plant ",
+          i, " in ", reader.file());
+      parent = organs[or_.parent];
+    }
+
+    Organ *o = organs[j] = Organ::load(or_, parent, p, p->_organs);
+    if (o->isFruit()) fruits[o->id()] = o;
+    p->assignToViews(o);
+  }
+
+  p->_derived = r.derived;
+  for (uint l=0; l<2; l++)
+    for (uint e=0; e<2; e++)
+      p->_reserves[l][e] = r.reserves[l][e];
+
+  auto fruitRecords = reader.fruits();
+  for (uint j=0; j<r.fruits; j++) {
+    const snapshot::FruitRecord &fr = fruitRecords[r.firstFruit + j];
+    Organ *f = fruits.at(OID(fr.organ));
+
+    std::vector<Genome> genomes;
+    genomes.reserve(fr.genomes);
+    for (uint k=0; k<fr.genomes; k++)
+      genomes.push_back(reader.genome(fr.firstGenome + k).get<Genome>());
+    p->_fruits.emplace(f->id(), FruitData{genomes, f});
+  }
+
+  p->_nextOrganID = OID(r.nextOrganID);
+  p->_killed = false;
+  p->_dirty.reset();
+
+  p->updateGeometry();
+  p->updateMetabolicValues();
+
+  p->updateDepths();
+
+  return p;
+}
+
+void Plant::saveState (nlohmann::json &j, const Plant &p) {
+  assert(p._currentStepSeeds.empty());
+  assert(!p.isDirty(DIRTY_METABOLISM) && !p.isDirty(DIRTY_COLLISION));
+
+  nlohmann::json jo;
+  for (const Organ *o: p._organs) {
+    nlohmann::json jo_;
+    Organ::saveState(jo_, *o);
+    jo.push_back(jo_);
+  }
+
+  j = {
+    {p._pos.x, p._pos.y}, p._age,
+    p._derived, p._reserves,
+    p._nextOrganID,
+    jo
+  };
+}
+
+void Plant::applyState (nlohmann::json &j, const nlohmann::json &state) {
+  j[1] = state[0];
+  j[2] = state[1];
+  j[4] = state[2];
+  j[5] = state[3];
+  j[7] = state[4];
+
+  Organ::States states;
+  for (const nlohmann::json &js: state[5])
+    states[js[0].get<OID>()] = &js;
+
+  for (nlohmann::json &jo: j[3])
+    Organ::applyState(jo, states);
+}
+
 void assertEqual (const Plant &lhs, const Plant &rhs, bool deepcopy) {
   using utils::assertEqual;
 
@@ -1,7 +1,9 @@
 #ifndef SIMU_PLANT_H
 #define SIMU_PLANT_H
 
-#include "organ.h"
+#include "organpool.h"
+#include "organbvh.h"
+#include "physicstypes.hpp"
 #include "phylogenystats.hpp"
 
 namespace simu {
@@ -67,6 +69,7 @@ private:
 
   uint _age;
 
+  OrganPool _organPool; ///< Owns every organ below
   Organs _organs;
 
   using OrgansView = Organs;
@@ -75,6 +78,8 @@ private:
   using OrgansSortedView = Organ::SortedCollection;
   OrgansSortedView _nonTerminals, _flowers;
 
+  OrganBVH _organTree;  ///< Spatial index of the terminal organs
+
   uint _derived;  ///< Number of times derivation rules were applied
 
   Rect _boundingRect;
@@ -104,12 +109,37 @@ private:
 
   OID _nextOrganID;
 
+  /// Incremented whenever the committed geometry changes
+  uint _geometryEpoch;
+
+  /// Outcome of the last (failed) collision test of a non-terminal
+  /// (see config::collisionMemo)
+  struct CollisionMemo {
+    uint epoch;     ///< Plant geometry epoch at the time of the test
+    uint topology;  ///< Environment topology epoch at the time of the test
+    physics::CollisionResult result;
+    Rect bounds;    ///< Of the rejected branch
+    physics::Neighbourhood neighbours;  ///< For inter-plant collisions
+  };
+  std::map<OID, CollisionMemo> _collisionMemos;
+
+  /// Where this plant reads the environment during its metabolic step.
+  /// Rebuilt when the geometry changed (not copied on clone nor saved)
+  struct EnvironmentSamples {
+    bool valid = false;
+    uint epoch;                       ///< Geometry epoch at the time of build
+    VoxelSample temperature;          ///< At the plant's base
+    std::vector<VoxelSample> hairs;   ///< In the order of _hairs
+    std::vector<float> water;         ///< Gathered at each step
+  } _envSamples;
+
   bool _killed;
 
   enum State {
-    DIRTY_METABOLISM, DIRTY_COLLISION
+    DIRTY_METABOLISM, DIRTY_COLLISION,
+    DIRTY_STRUCTURE ///< Organs were added/removed since the last checkpoint
   };
-  std::bitset<2> _dirty;
+  std::bitset<3> _dirty;
 
   PStats *_pstats;
   std::unique_ptr<PStatsWorkingCache> _pstatsWC;
@@ -128,8 +158,21 @@ public:
 
   bool isDirty (State s) const {  return _dirty.test(s);  }
 
+  /// Whether the organ tree changed since the last call to markSaved()
+  bool structureChanged (void) const {
+    return isDirty(DIRTY_STRUCTURE);
+  }
+  void markSaved (void) {
+    _dirty.set(DIRTY_STRUCTURE, false);
+  }
+
   void updatePosition (float newx);
   void updateAltitude (Environment &env, float h);
+
+  /// Forces the environment samples to be rebuilt at the next metabolic step
+  void invalidateEnvironmentSamples (void) {
+    _envSamples.valid = false;
+  }
   void updateGeometry (void);
   void update (Environment &env);
 
@@ -157,6 +200,42 @@ public:
     return _organs;
   }
 
+  /// Calls \p f(o) for every terminal organ, committed or not, whose bounding
+  /// rect intersects \p r (in world coordinates)
+  template <typename F>
+  void terminalOrgansIn (const Rect &r, F &&f) const {
+    if (!r.isValid()) return;
+
+    // The tree works in plant coordinates: leave some room for rounding
+    const float tol = 4 * std::numeric_limits<float>::epsilon()
+                    * (1 + std::max({ std::fabs(r.l()), std::fabs(r.r()),
+                                      std::fabs(r.t()), std::fabs(r.b()) })
+                         + std::max(std::fabs(_pos.x), std::fabs(_pos.y)));
+    const Rect q {
+      { r.l() - _pos.x - tol, r.t() - _pos.y + tol },
+      { r.r() - _pos.x + tol, r.b() - _pos.y - tol }
+    };
+
+    _organTree.query(q, [&r, &f] (const Organ *o) {
+      if (intersects(r, o->globalCoordinates().boundingRect)) f(o);
+    });
+  }
+
+  /// To be called whenever \p o's geometry changed
+  void organMoved (const Organ *o) {
+    _organTree.update(o);
+    if (!o->isUncommitted())  _geometryEpoch++;
+  }
+
+  uint geometryEpoch (void) const {
+    return _geometryEpoch;
+  }
+
+  /// Storage for this plant's organs (including uncommitted ones)
+  OrganPool& organPool (void) {
+    return _organPool;
+  }
+
   auto& stamens (void) {
     assert(sex() == Sex::MALE);
     return _flowers;
@@ -266,6 +345,20 @@ public:
 
   static void save (nlohmann::json &j, const Plant &p);
   static Plant* load (const nlohmann::json &j);
+
+  /// Appends \p p's record, organs, fruits and genomes to \p w
+  static void save (snapshot::Writer &w, const Plant &p);
+
+  /// Rebuilds the \p i-th plant stored in \p r
+  static Plant* load (const snapshot::Reader &r, uint i);
+
+  /// Saves only the values that can change without altering the organ tree
+  static void saveState (nlohmann::json &j, const Plant &p);
+
+  /// Overwrites, in \p j (as produced by save()), the values stored in \p state
+  /// (as produced by saveState())
+  static void applyState (nlohmann::json &j, const nlohmann::json &state);
+
   friend void assertEqual (const Plant &lhs, const Plant &rhs, bool deepcopy);
 
   friend std::ostream& operator<< (std::ostream &os, const Plant &p);
@@ -286,6 +379,9 @@ public:
 private:  
   uint deriveRules(Environment &env);
 
+  /// Whether a previous collision test of \p apex still holds
+  bool stillBlocked (const Organ *apex, const Environment &env);
+
   void assignToViews (Organ *o);
 
   void updateDepths (void) {
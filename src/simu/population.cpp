@@ -0,0 +1,254 @@
+#include "population.h"
+
+namespace simu {
+
+static constexpr bool debugPopulation = false;
+
+using Contribution = PopulationAggregates::Contribution;
+
+Contribution Contribution::of (const Plant &p) {
+  Contribution c;
+  c.biomass = p.biomass();
+  c.seeds = p.isInSeedState();
+  c.females = (p.sex() == Plant::Sex::FEMALE);
+  c.males = (p.sex() == Plant::Sex::MALE);
+  c.organs = p.organs().size();
+  c.flowers = p.flowers().size();
+  c.fruits = p.fruits().size();
+  return c;
+}
+
+Contribution& Contribution::operator+= (const Contribution &that) {
+  biomass += that.biomass;
+  seeds += that.seeds;
+  females += that.females;
+  males += that.males;
+  organs += that.organs;
+  flowers += that.flowers;
+  fruits += that.fruits;
+  return *this;
+}
+
+Contribution& Contribution::operator-= (const Contribution &that) {
+  biomass -= that.biomass;
+  seeds -= that.seeds;
+  females -= that.females;
+  males -= that.males;
+  organs -= that.organs;
+  flowers -= that.flowers;
+  fruits -= that.fruits;
+  return *this;
+}
+
+void PopulationAggregates::check (const PopulationAggregates &rescan) const {
+  const Contribution &lhs = totals, &rhs = rescan.totals;
+  const auto mismatch = [] (const char *field, auto l, auto r) {
+    utils::doThrow<std::logic_error>(
+      "Population aggregate '", field, "' drifted: ", l, " != ", r,
+      " (rescan)");
+  };
+
+  if (std::fabs(lhs.biomass - rhs.biomass)
+      > 1e-6 * std::max(decltype(lhs.biomass)(1), std::fabs(rhs.biomass)))
+    mismatch("biomass", lhs.biomass, rhs.biomass);
+  if (lhs.seeds != rhs.seeds)     mismatch("seeds", lhs.seeds, rhs.seeds);
+  if (lhs.females != rhs.females) mismatch("females", lhs.females, rhs.females);
+  if (lhs.males != rhs.males)     mismatch("males", lhs.males, rhs.males);
+  if (lhs.organs != rhs.organs)   mismatch("organs", lhs.organs, rhs.organs);
+  if (lhs.flowers != rhs.flowers) mismatch("flowers", lhs.flowers, rhs.flowers);
+  if (lhs.fruits != rhs.fruits)   mismatch("fruits", lhs.fruits, rhs.fruits);
+
+  if (minGeneration != rescan.minGeneration)
+    mismatch("minGeneration", minGeneration, rescan.minGeneration);
+  if (maxGeneration != rescan.maxGeneration)
+    mismatch("maxGeneration", maxGeneration, rescan.maxGeneration);
+}
+
+// =============================================================================
+
+std::vector<Population::Located>::const_iterator
+Population::lowerBound (float x) const {
+  return std::lower_bound(_index.begin(), _index.end(), x,
+                          [] (const Located &l, float x) { return l.x < x; });
+}
+
+Population::Handle Population::insert (Plant_ptr &&p) {
+  float x = p->pos().x;
+  auto it = lowerBound(x);
+  if (it != _index.end() && it->x == x)  return Handle{};
+
+  uint32_t s;
+  if (_freeSlots.empty()) {
+    s = _slots.size();
+    _slots.push_back({0, 0});
+
+  } else {
+    s = _freeSlots.back();
+    _freeSlots.pop_back();
+  }
+
+  Slot &slot = _slots[s];
+  slot.dense = _plants.size();
+
+  Handle h { s, slot.generation };
+  _index.insert(it, { x, h, p.get() });
+
+  Contribution c = Contribution::of(*p);
+  _aggregates.totals += c;
+  _contributions.push_back(c);
+
+  _generations[p->genome().gdata.generation]++;
+  updateGenerations();
+
+  _plants.push_back(std::move(p));
+  _owners.push_back(s);
+
+  if (debugPopulation)  assertConsistent();
+  return h;
+}
+
+Plant* Population::get (Handle h) const {
+  if (!h.isValid() || h.index >= _slots.size()) return nullptr;
+  const Slot &slot = _slots[h.index];
+  if (slot.generation != h.generation)  return nullptr;
+  return _plants[slot.dense].get();
+}
+
+Plant* Population::find (float x) const {
+  auto it = lowerBound(x);
+  if (it == _index.end() || it->x != x) return nullptr;
+  return it->plant;
+}
+
+std::vector<Plant*> Population::sorted (void) const {
+  std::vector<Plant*> plants;
+  plants.reserve(_index.size());
+  for (const Located &l: _index)  plants.push_back(l.plant);
+  return plants;
+}
+
+Population::Handle Population::handle (float x) const {
+  auto it = lowerBound(x);
+  if (it == _index.end() || it->x != x) return Handle{};
+  return it->handle;
+}
+
+void Population::erase (Handle h) {
+  Plant *p = get(h);
+  if (!p)
+    utils::doThrow<std::invalid_argument>(
+      "Stale population handle ", h.index, ":", h.generation);
+
+  auto it = lowerBound(p->pos().x);
+  assert(it != _index.end() && it->handle == h);
+  _index.erase(it);
+
+  // Move the last plant into the hole
+  Slot &slot = _slots[h.index];
+  _aggregates.totals -= _contributions[slot.dense];
+
+  auto gen = _generations.find(p->genome().gdata.generation);
+  assert(gen != _generations.end());
+  if (--gen->second == 0) _generations.erase(gen);
+  updateGenerations();
+
+  uint32_t last = _plants.size() - 1;
+  if (slot.dense != last) {
+    _plants[slot.dense] = std::move(_plants[last]);
+    _owners[slot.dense] = _owners[last];
+    _contributions[slot.dense] = _contributions[last];
+    _slots[_owners[slot.dense]].dense = slot.dense;
+  }
+  _plants.pop_back();
+  _owners.pop_back();
+  _contributions.pop_back();
+
+  slot.generation++;
+  _freeSlots.push_back(h.index);
+
+  if (debugPopulation)  assertConsistent();
+}
+
+void Population::clear (void) {
+  for (uint32_t s: _owners) {
+    _slots[s].generation++;
+    _freeSlots.push_back(s);
+  }
+  _plants.clear();
+  _owners.clear();
+  _index.clear();
+  _contributions.clear();
+  _aggregates.totals = Contribution{};
+  _generations.clear();
+  updateGenerations();
+}
+
+void Population::updateGenerations (void) {
+  if (_generations.empty()) {
+    _aggregates.minGeneration = std::numeric_limits<uint>::max();
+    _aggregates.maxGeneration = 0;
+
+  } else {
+    _aggregates.minGeneration = _generations.begin()->first;
+    _aggregates.maxGeneration = _generations.rbegin()->first;
+  }
+}
+
+Contribution Population::update (const Plant *p) {
+  Handle h = handle(p->pos().x);
+  if (get(h) != p)
+    utils::doThrow<std::invalid_argument>(
+      PlantID(p), " is not part of this population");
+
+  Contribution &previous = _contributions[_slots[h.index].dense];
+  Contribution current = Contribution::of(*p);
+  Contribution delta = current - previous;
+  previous = current;
+  return delta;
+}
+
+PopulationAggregates Population::rescan (void) const {
+  PopulationAggregates a;
+  for (const Plant *p: *this) {
+    a.totals += Contribution::of(*p);
+    uint gen = p->genome().gdata.generation;
+    a.minGeneration = std::min(a.minGeneration, gen);
+    a.maxGeneration = std::max(a.maxGeneration, gen);
+  }
+  return a;
+}
+
+void Population::assertConsistent (void) const {
+  if (_plants.size() != _owners.size() || _plants.size() != _index.size()
+      || _plants.size() != _contributions.size())
+    utils::doThrow<std::logic_error>(
+      "Population size mismatch: ", _plants.size(), " plants, ",
+      _owners.size(), " owners, ", _index.size(), " indexed");
+
+  for (uint i=0; i<_plants.size(); i++)
+    if (_slots[_owners[i]].dense != i)
+      utils::doThrow<std::logic_error>(
+        "Slot ", _owners[i], " does not point back to dense index ", i);
+
+  for (uint i=0; i<_index.size(); i++) {
+    const Located &l = _index[i];
+    if (i > 0 && !(_index[i-1].x < l.x))
+      utils::doThrow<std::logic_error>("Unsorted population index at ", i);
+    if (get(l.handle) != l.plant || l.plant->pos().x != l.x)
+      utils::doThrow<std::logic_error>(
+        "Population index entry ", i, " is out of date");
+  }
+}
+
+void assertEqual (const Population &lhs, const Population &rhs,
+                  bool deepcopy) {
+  using utils::assertEqual;
+  assertEqual(lhs.size(), rhs.size(), deepcopy);
+  for (uint i=0; i<lhs._index.size(); i++) {
+    const auto &l = lhs._index[i], &r = rhs._index[i];
+    assertEqual(l.x, r.x, deepcopy);
+    assertEqual(*l.plant, *r.plant, deepcopy);
+  }
+}
+
+} // end of namespace simu
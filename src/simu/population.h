@@ -0,0 +1,229 @@
+#ifndef SIMU_POPULATION_H
+#define SIMU_POPULATION_H
+
+/// Storage for the plants of a simulation
+///
+/// Plants are owned by a slot map: a dense array (iterated over every step)
+/// and an array of slots giving stable, generational handles into it.
+/// Removal swaps the last plant into the hole so that iteration remains
+/// contiguous. Position queries go through a separate x-sorted flat index.
+///
+/// \note Iteration order is deterministic (insertion order modulo removals)
+/// but is not sorted on x. Anything whose outcome depends on the order
+/// (random permutations, saves, outputs) must use byPosition() instead, which
+/// matches the order of the former x-keyed container, or a copy of it
+/// (sorted()) when the population is shuffled or modified along the way.
+///
+/// Population-wide statistics are maintained incrementally: each plant's last
+/// known contribution is cached and only differences are applied to the
+/// totals when it is inserted, updated or removed.
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "plant.h"
+
+namespace simu {
+
+/// Totals over a population (see Population::aggregates)
+struct PopulationAggregates {
+  using decimal = Plant::decimal;
+
+  /// What a single plant adds to the totals
+  struct Contribution {
+    decimal biomass = 0;
+    int seeds = 0, females = 0, males = 0;
+    int organs = 0, flowers = 0, fruits = 0;
+
+    static Contribution of (const Plant &p);
+
+    Contribution& operator+= (const Contribution &that);
+    Contribution& operator-= (const Contribution &that);
+
+    friend Contribution operator- (Contribution lhs, const Contribution &rhs) {
+      return lhs -= rhs;
+    }
+  };
+  Contribution totals;
+
+  /// Range of generations over the current plants
+  uint minGeneration = std::numeric_limits<uint>::max();
+  uint maxGeneration = 0;
+
+  /// Throws if \p rescan (computed from scratch) differs from this
+  /// \note Biomass is compared with a relative tolerance to account for
+  /// accumulated rounding errors
+  void check (const PopulationAggregates &rescan) const;
+};
+
+class Population {
+public:
+  using Plant_ptr = std::unique_ptr<Plant>;
+
+  /// Stable reference to a plant. Becomes stale (and is detected as such)
+  /// once the plant is removed
+  struct Handle {
+    static constexpr uint32_t INVALID = std::numeric_limits<uint32_t>::max();
+
+    uint32_t index = INVALID;
+    uint32_t generation = 0;
+
+    bool isValid (void) const {
+      return index != INVALID;
+    }
+
+    friend bool operator== (const Handle &lhs, const Handle &rhs) {
+      return lhs.index == rhs.index && lhs.generation == rhs.generation;
+    }
+  };
+
+  /// Entry of the x-sorted index
+  struct Located {
+    float x;
+    Handle handle;
+    Plant *plant;
+  };
+
+  /// Iterates over Plant* in dense order
+  class const_iterator {
+  public:
+    using base = std::vector<Plant_ptr>::const_iterator;
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Plant*;
+    using difference_type = base::difference_type;
+    using pointer = Plant* const*;
+    using reference = Plant*;
+
+    const_iterator (base it) : _it(it) {}
+
+    Plant* operator* (void) const {  return _it->get(); }
+    const_iterator& operator++ (void) {  ++_it; return *this; }
+    const_iterator operator++ (int) {  return const_iterator(_it++); }
+
+    friend bool operator== (const const_iterator &lhs,
+                            const const_iterator &rhs) {
+      return lhs._it == rhs._it;
+    }
+    friend bool operator!= (const const_iterator &lhs,
+                            const const_iterator &rhs) {
+      return lhs._it != rhs._it;
+    }
+
+  private:
+    base _it;
+  };
+  using value_type = Plant*;
+
+  size_t size (void) const {  return _plants.size();  }
+  bool empty (void) const {   return _plants.empty(); }
+
+  const_iterator begin (void) const { return _plants.begin(); }
+  const_iterator end (void) const {   return _plants.end();   }
+
+  /// Plants sorted by increasing x
+  const std::vector<Located>& byPosition (void) const {
+    return _index;
+  }
+
+  /// \returns a copy of the plants sorted by increasing x (e.g. to shuffle
+  /// them or to modify the population while iterating)
+  std::vector<Plant*> sorted (void) const;
+
+  /// Inserts \p p unless its position is already occupied (in which case it
+  /// is destroyed)
+  /// \returns the handle to the inserted plant (invalid on failure)
+  Handle insert (Plant_ptr &&p);
+
+  /// \returns the plant pointed to by \p h or nullptr if it is stale
+  Plant* get (Handle h) const;
+
+  /// \returns the plant located at \p x or nullptr
+  Plant* find (float x) const;
+
+  /// \returns the handle of the plant located at \p x (invalid if none)
+  Handle handle (float x) const;
+
+  /// Removes (and destroys) the plant pointed to by \p h
+  void erase (Handle h);
+
+  /// Removes (and destroys) the plant located at \p x, if any
+  void erase (float x) {
+    Handle h = handle(x);
+    if (h.isValid())  erase(h);
+  }
+
+  void clear (void);
+
+  const PopulationAggregates& aggregates (void) const {
+    return _aggregates;
+  }
+
+  /// Recomputes the contribution of \p p (after a change in its organs or
+  /// biomass)
+  /// \returns the difference with the previous one, which is *not* applied
+  /// to the totals so that distinct plants can be updated concurrently
+  PopulationAggregates::Contribution update (const Plant *p);
+
+  /// Adds \p delta (from update) to the totals
+  void apply (const PopulationAggregates::Contribution &delta) {
+    _aggregates.totals += delta;
+  }
+
+  /// Updates \p p's contribution and the totals
+  void refresh (const Plant *p) {
+    apply(update(p));
+  }
+
+  /// Computes the aggregates from scratch (for validation purposes)
+  PopulationAggregates rescan (void) const;
+
+  /// Checks internal consistency (slots, dense array and x-index)
+  void assertConsistent (void) const;
+
+  friend void swap (Population &lhs, Population &rhs) {
+    using std::swap;
+    swap(lhs._plants, rhs._plants);
+    swap(lhs._owners, rhs._owners);
+    swap(lhs._slots, rhs._slots);
+    swap(lhs._freeSlots, rhs._freeSlots);
+    swap(lhs._index, rhs._index);
+    swap(lhs._contributions, rhs._contributions);
+    swap(lhs._aggregates, rhs._aggregates);
+    swap(lhs._generations, rhs._generations);
+  }
+
+  /// Compares plants in x order
+  friend void assertEqual (const Population &lhs, const Population &rhs,
+                           bool deepcopy);
+
+private:
+  struct Slot {
+    uint32_t dense;       ///< Index in _plants (if live)
+    uint32_t generation;  ///< Incremented on removal
+  };
+
+  std::vector<Plant_ptr> _plants; ///< Dense storage
+  std::vector<uint32_t> _owners;  ///< Slot of each dense plant
+  std::vector<Slot> _slots;
+  std::vector<uint32_t> _freeSlots;
+
+  std::vector<Located> _index;    ///< Sorted on x
+
+  /// Last known contribution of each dense plant
+  std::vector<PopulationAggregates::Contribution> _contributions;
+  PopulationAggregates _aggregates;
+
+  /// Number of current plants per generation (for the generations range)
+  std::map<uint, uint> _generations;
+
+  std::vector<Located>::const_iterator lowerBound (float x) const;
+
+  /// Updates the generations range from _generations
+  void updateGenerations (void);
+};
+
+} // end of namespace simu
+
+#endif // SIMU_POPULATION_H
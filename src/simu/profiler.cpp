@@ -0,0 +1,171 @@
+#include <memory>
+#include <mutex>
+
+#include "profiler.h"
+
+namespace simu {
+namespace profiler {
+
+static constexpr bool debugProfiler = false;
+
+namespace details {
+bool active = false;
+bool tracing = false;
+} // end of namespace details
+
+namespace {
+
+using U = EnumUtils<Phase>;
+
+struct Event {
+  Phase phase;
+  clock::time_point start, end;
+};
+
+/// Accumulators of a single thread
+struct ThreadData {
+  uint id;
+  std::array<clock::duration, Profiler::PHASES> durations {};
+  std::vector<Event> events;
+};
+
+/// Owns every thread's data (threads of the OpenMP pool outlive steps but
+/// this makes sure nothing dangles)
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadData>> registry;
+
+ThreadData& local (void) {
+  static thread_local ThreadData *data = nullptr;
+  if (!data) {
+    std::lock_guard<std::mutex> lock (registryMutex);
+    registry.push_back(std::make_unique<ThreadData>());
+    data = registry.back().get();
+    data->id = registry.size() - 1;
+  }
+  return *data;
+}
+
+double ms (clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+double us (clock::duration d) {
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+} // end of anonymous namespace
+
+void record (Phase phase, clock::time_point start, clock::time_point end) {
+  ThreadData &d = local();
+  d.durations[U::toUnderlying(phase)] += end - start;
+  if (details::tracing) d.events.push_back({phase, start, end});
+}
+
+Profiler::Profiler (const stdfs::path &folder, uint every, bool trace,
+                    std::ios::openmode mode)
+  : _every(std::max(1u, every)), _steps(0), _total(0), _phases{},
+    _origin(clock::now()), _firstEvent(true) {
+
+  stdfs::path datPath = folder / "profile.dat";
+  _dat.open(datPath, mode);
+  if (!_dat.is_open())
+    utils::doThrow<std::invalid_argument>(
+      "Unable to open profile file ", datPath);
+
+  _dat << "Date Steps Total";
+  for (Phase p: U::iterator())  _dat << " " << U::getName(p);
+  _dat << "\n";
+
+  if (trace) {
+    stdfs::path tracePath = folder / "profile.trace.json";
+    _trace.open(tracePath, std::ios::out | std::ios::trunc);
+    if (!_trace.is_open())
+      utils::doThrow<std::invalid_argument>(
+        "Unable to open trace file ", tracePath);
+    _trace << "{\"traceEvents\":[";
+  }
+
+  // Discard anything recorded by a previous profiler
+  std::lock_guard<std::mutex> lock (registryMutex);
+  for (auto &d: registry) {
+    d->durations.fill(clock::duration::zero());
+    d->events.clear();
+  }
+
+  details::active = true;
+  details::tracing = trace;
+}
+
+Profiler::~Profiler (void) {
+  details::active = false;
+  details::tracing = false;
+
+  flush();
+  if (_trace.is_open())  _trace << "\n]}\n";
+}
+
+void Profiler::stepStart (const std::string &time) {
+  _stepTime = time;
+  if (_steps == 0)  _rowTime = time;
+  _stepStart = clock::now();
+}
+
+void Profiler::stepEnd (void) {
+  const auto end = clock::now();
+  _total += ms(end - _stepStart);
+  _steps++;
+
+  // Called between parallel regions: no thread is recording
+  std::lock_guard<std::mutex> lock (registryMutex);
+  for (auto &d: registry) {
+    for (uint i=0; i<PHASES; i++) {
+      _phases[i] += ms(d->durations[i]);
+      d->durations[i] = clock::duration::zero();
+    }
+
+    if (_trace.is_open()) {
+      for (const Event &e: d->events) {
+        _trace << (_firstEvent ? "\n" : ",\n")
+               << "{\"name\":\"" << U::getName(e.phase)
+               << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << d->id
+               << ",\"ts\":" << us(e.start - _origin)
+               << ",\"dur\":" << us(e.end - e.start) << "}";
+        _firstEvent = false;
+      }
+      d->events.clear();
+    }
+  }
+
+  if (_trace.is_open())
+    _trace << (_firstEvent ? "\n" : ",\n")
+           << "{\"name\":\"STEP\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+           << ",\"ts\":" << us(_stepStart - _origin)
+           << ",\"dur\":" << us(end - _stepStart)
+           << ",\"args\":{\"time\":\"" << _stepTime << "\"}}";
+  _firstEvent = false;
+
+  if (_steps >= _every) writeRow();
+}
+
+void Profiler::flush (void) {
+  if (_steps > 0) writeRow();
+  _dat.flush();
+  if (_trace.is_open()) _trace.flush();
+}
+
+void Profiler::writeRow (void) {
+  _dat << _rowTime << " " << _steps << " " << _total;
+  for (double d: _phases) _dat << " " << d;
+  _dat << "\n";
+
+  if (debugProfiler)
+    std::cerr << "Profiled " << _steps << " step(s) from " << _rowTime
+              << " in " << _total << " ms" << std::endl;
+
+  _steps = 0;
+  _total = 0;
+  _phases.fill(0);
+}
+
+} // end of namespace profiler
+} // end of namespace simu
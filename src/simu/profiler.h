@@ -0,0 +1,106 @@
+#ifndef SIMU_PROFILER_H
+#define SIMU_PROFILER_H
+
+/// Timing of a simulation step's phases
+///
+/// Timed functions open a Scope, which costs a single branch when profiling is
+/// disabled. Durations are accumulated per thread so that phases executed
+/// concurrently (plant stepping) do not contend: those report the cumulated
+/// time over all threads and may thus exceed the step's wall time.
+/// Nested phases (e.g. CLEANUP inside SEEDS) are included in their parent's.
+///
+/// Every config::profileEvery steps, the Profiler writes one row of
+/// accumulated durations (in ms) to profile.dat and, if config::profileTrace
+/// is set, every individual scope as a Chrome trace event to
+/// profile.trace.json (for chrome://tracing or Perfetto).
+///
+/// \warning Accumulators are process-wide: only one simulation should be
+/// profiled at a time
+
+#include <array>
+#include <chrono>
+#include <fstream>
+
+#include "kgd/settings/configfile.h"
+
+DEFINE_PRETTY_ENUMERATION(ProfilerPhase,
+                          PLANTS, DERIVE_RULES, METABOLIC_STEP, PROCESS_FRUITS,
+                          CORPSES, REPRODUCTIONS, SEEDS, CLEANUP, PTREE,
+                          LOGGING, ALTITUDE, CGP_STEP, SAVE)
+
+namespace simu {
+namespace profiler {
+
+using Phase = ProfilerPhase;
+using clock = std::chrono::steady_clock;
+
+namespace details {
+extern bool active, tracing;
+} // end of namespace details
+
+/// Adds [\p start, \p end] to \p phase for the calling thread
+void record (Phase phase, clock::time_point start, clock::time_point end);
+
+/// Times the enclosing block as \p phase
+class Scope {
+public:
+  Scope (Phase phase) : _phase(phase), _active(details::active) {
+    if (_active)  _start = clock::now();
+  }
+
+  ~Scope (void) {
+    if (_active)  record(_phase, _start, clock::now());
+  }
+
+  Scope (const Scope&) = delete;
+  Scope& operator= (const Scope&) = delete;
+
+private:
+  Phase _phase;
+  bool _active;
+  clock::time_point _start;
+};
+
+class Profiler {
+public:
+  static constexpr uint PHASES = EnumUtils<Phase>::size();
+
+  /// Writes to \p folder every \p every steps. Also exports individual scopes
+  /// if \p trace is set
+  Profiler (const stdfs::path &folder, uint every, bool trace,
+            std::ios::openmode mode);
+  ~Profiler (void);
+
+  Profiler (const Profiler&) = delete;
+  Profiler& operator= (const Profiler&) = delete;
+
+  /// Marks the beginning of step \p time (as Time::pretty())
+  void stepStart (const std::string &time);
+
+  /// Collects the timings of the current step and writes them out if needed
+  void stepEnd (void);
+
+  /// Writes the partial row, if any
+  void flush (void);
+
+private:
+  std::ofstream _dat, _trace;
+  uint _every;
+
+  std::string _rowTime;     ///< Time of the first step in the row
+  std::string _stepTime;
+  uint _steps;              ///< Number of steps in the row
+  clock::time_point _stepStart;
+  double _total;            ///< Wall time of the row's steps (ms)
+  std::array<double, PHASES> _phases;  ///< Per-phase time (ms)
+
+  clock::time_point _origin;  ///< Reference for trace timestamps
+  bool _firstEvent;
+
+  void writeRow (void);
+};
+
+} // end of namespace profiler
+} // end of namespace simu
+
+#endif // SIMU_PROFILER_H
@@ -0,0 +1,284 @@
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SAT_X86 1
+#include <immintrin.h>
+#else
+#define SAT_X86 0
+#endif
+
+#include "kgd/settings/configfile.h"
+
+#include "satkernel.h"
+
+/// \note Built with -ffp-contract=off (see CMakeLists.txt) so that no variant
+/// gets its multiply-adds fused differently from the others
+
+namespace simu {
+namespace physics {
+namespace sat {
+
+static float dotProduct (float x, float y, const Point &n) {
+  return x * n.x + y * n.y;
+}
+
+/// Computes the projections' range of \p corners onto \p n
+static void project (const std::array<Point, 4> &corners, const Point &n,
+                     float &min, float &max) {
+  min = max = dotProduct(corners[0].x, corners[0].y, n);
+  for (uint i=1; i<4; i++) {
+    float proj = dotProduct(corners[i].x, corners[i].y, n);
+    if (proj < min)  min = proj;
+    if (max < proj)  max = proj;
+  }
+}
+
+bool collides (const Box &lhs, const Box &rhs) {
+  std::array<Point, 4> normals;
+  uint nnormals = 2;
+  normals[0] = lhs.normal;
+  normals[1] = {-normals[0].y, normals[0].x};
+  if (lhs.rotation != rhs.rotation) {
+    normals[2] = rhs.normal;
+    normals[3] = {-normals[2].y, normals[2].x};
+    nnormals = 4;
+  }
+
+  for (uint i=0; i<nnormals; i++) {
+    float min_lhs, max_lhs, min_rhs, max_rhs;
+    project(lhs.corners, normals[i], min_lhs, max_lhs);
+    project(rhs.corners, normals[i], min_rhs, max_rhs);
+    if (max_lhs <= min_rhs || max_rhs <= min_lhs)
+      return false; // Found a separating axis
+  }
+
+  return true;  // No separating axis found: there must be a collision
+}
+
+static uint32_t collidesScalar (const Box &lhs, const Batch &b) {
+  uint32_t mask = 0;
+  for (uint j=0; j<b.size; j++) {
+    Box rhs;
+    for (uint i=0; i<4; i++)  rhs.corners[i] = { b.cx[i][j], b.cy[i][j] };
+    rhs.normal = { b.nx[j], b.ny[j] };
+    rhs.rotation = b.rotation[j];
+    mask |= uint32_t(collides(lhs, rhs)) << j;
+  }
+  return mask;
+}
+
+#if SAT_X86
+
+// Both kernels mirror the reference:
+//  - min/max operands are ordered so as to keep the reference's result on
+//    ties and NaNs (min_ps(a,b) = a < b ? a : b)
+//  - the rhs' axes only count for lanes with a different rotation
+
+#define SAT_SSE2 __attribute__((target("sse2")))
+#define SAT_AVX2 __attribute__((target("avx2")))
+
+SAT_SSE2 static inline __m128 dot (__m128 x, __m128 y, __m128 nx, __m128 ny) {
+  return _mm_add_ps(_mm_mul_ps(x, nx), _mm_mul_ps(y, ny));
+}
+
+/// Whether the ranges [lmin,lmax] and [rmin,rmax] are disjoint
+SAT_SSE2 static inline __m128 disjoint (__m128 lmin, __m128 lmax,
+                                        __m128 rmin, __m128 rmax) {
+  return _mm_or_ps(_mm_cmple_ps(lmax, rmin), _mm_cmple_ps(rmax, lmin));
+}
+
+SAT_SSE2 static uint32_t collidesSSE2 (const Box &lhs, const Batch &b) {
+  const __m128 sign = _mm_set1_ps(-0.f);
+  uint32_t mask = 0;
+  for (uint j0=0; j0<b.size; j0 += 4) {
+    __m128 separated = _mm_setzero_ps();
+
+    // lhs' axes: lhs' projections are shared by all lanes
+    const Point lnormals [] {
+      lhs.normal, {-lhs.normal.y, lhs.normal.x}
+    };
+    for (const Point &n: lnormals) {
+      float lmin, lmax;
+      project(lhs.corners, n, lmin, lmax);
+
+      const __m128 nx = _mm_set1_ps(n.x), ny = _mm_set1_ps(n.y);
+      __m128 rmin = dot(_mm_load_ps(b.cx[0] + j0), _mm_load_ps(b.cy[0] + j0),
+                        nx, ny);
+      __m128 rmax = rmin;
+      for (uint i=1; i<4; i++) {
+        __m128 p = dot(_mm_load_ps(b.cx[i] + j0), _mm_load_ps(b.cy[i] + j0),
+                       nx, ny);
+        rmin = _mm_min_ps(p, rmin);
+        rmax = _mm_max_ps(p, rmax);
+      }
+
+      separated = _mm_or_ps(separated,
+                            disjoint(_mm_set1_ps(lmin), _mm_set1_ps(lmax),
+                                     rmin, rmax));
+    }
+
+    // rhs' axes
+    const __m128 rnx = _mm_load_ps(b.nx + j0), rny = _mm_load_ps(b.ny + j0);
+    const __m128 rnormals [2][2] {
+      { rnx, rny }, { _mm_xor_ps(rny, sign), rnx }
+    };
+    __m128 rseparated = _mm_setzero_ps();
+    for (const auto &n: rnormals) {
+      __m128 lmin = dot(_mm_set1_ps(lhs.corners[0].x),
+                        _mm_set1_ps(lhs.corners[0].y), n[0], n[1]);
+      __m128 rmin = dot(_mm_load_ps(b.cx[0] + j0), _mm_load_ps(b.cy[0] + j0),
+                        n[0], n[1]);
+      __m128 lmax = lmin, rmax = rmin;
+      for (uint i=1; i<4; i++) {
+        __m128 lp = dot(_mm_set1_ps(lhs.corners[i].x),
+                        _mm_set1_ps(lhs.corners[i].y), n[0], n[1]);
+        __m128 rp = dot(_mm_load_ps(b.cx[i] + j0), _mm_load_ps(b.cy[i] + j0),
+                        n[0], n[1]);
+        lmin = _mm_min_ps(lp, lmin);
+        lmax = _mm_max_ps(lp, lmax);
+        rmin = _mm_min_ps(rp, rmin);
+        rmax = _mm_max_ps(rp, rmax);
+      }
+      rseparated = _mm_or_ps(rseparated, disjoint(lmin, lmax, rmin, rmax));
+    }
+    const __m128 rotated = _mm_cmpneq_ps(_mm_load_ps(b.rotation + j0),
+                                         _mm_set1_ps(lhs.rotation));
+    separated = _mm_or_ps(separated, _mm_and_ps(rseparated, rotated));
+
+    mask |= uint32_t(~_mm_movemask_ps(separated) & 0xF) << j0;
+  }
+  return mask & ((1u << b.size) - 1);
+}
+
+SAT_AVX2 static inline __m256 dot (__m256 x, __m256 y, __m256 nx, __m256 ny) {
+  return _mm256_add_ps(_mm256_mul_ps(x, nx), _mm256_mul_ps(y, ny));
+}
+
+SAT_AVX2 static inline __m256 disjoint (__m256 lmin, __m256 lmax,
+                                        __m256 rmin, __m256 rmax) {
+  return _mm256_or_ps(_mm256_cmp_ps(lmax, rmin, _CMP_LE_OQ),
+                      _mm256_cmp_ps(rmax, lmin, _CMP_LE_OQ));
+}
+
+SAT_AVX2 static uint32_t collidesAVX2 (const Box &lhs, const Batch &b) {
+  static_assert(Batch::capacity == 8, "AVX2 kernel processes 8 lanes");
+  if (b.empty())  return 0;
+
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  __m256 separated = _mm256_setzero_ps();
+
+  const Point lnormals [] {
+    lhs.normal, {-lhs.normal.y, lhs.normal.x}
+  };
+  for (const Point &n: lnormals) {
+    float lmin, lmax;
+    project(lhs.corners, n, lmin, lmax);
+
+    const __m256 nx = _mm256_set1_ps(n.x), ny = _mm256_set1_ps(n.y);
+    __m256 rmin = dot(_mm256_load_ps(b.cx[0]), _mm256_load_ps(b.cy[0]), nx, ny);
+    __m256 rmax = rmin;
+    for (uint i=1; i<4; i++) {
+      __m256 p = dot(_mm256_load_ps(b.cx[i]), _mm256_load_ps(b.cy[i]), nx, ny);
+      rmin = _mm256_min_ps(p, rmin);
+      rmax = _mm256_max_ps(p, rmax);
+    }
+
+    separated = _mm256_or_ps(separated,
+                             disjoint(_mm256_set1_ps(lmin),
+                                      _mm256_set1_ps(lmax), rmin, rmax));
+  }
+
+  const __m256 rnx = _mm256_load_ps(b.nx), rny = _mm256_load_ps(b.ny);
+  const __m256 rnormals [2][2] {
+    { rnx, rny }, { _mm256_xor_ps(rny, sign), rnx }
+  };
+  __m256 rseparated = _mm256_setzero_ps();
+  for (const auto &n: rnormals) {
+    __m256 lmin = dot(_mm256_set1_ps(lhs.corners[0].x),
+                      _mm256_set1_ps(lhs.corners[0].y), n[0], n[1]);
+    __m256 rmin = dot(_mm256_load_ps(b.cx[0]), _mm256_load_ps(b.cy[0]),
+                      n[0], n[1]);
+    __m256 lmax = lmin, rmax = rmin;
+    for (uint i=1; i<4; i++) {
+      __m256 lp = dot(_mm256_set1_ps(lhs.corners[i].x),
+                      _mm256_set1_ps(lhs.corners[i].y), n[0], n[1]);
+      __m256 rp = dot(_mm256_load_ps(b.cx[i]), _mm256_load_ps(b.cy[i]),
+                      n[0], n[1]);
+      lmin = _mm256_min_ps(lp, lmin);
+      lmax = _mm256_max_ps(lp, lmax);
+      rmin = _mm256_min_ps(rp, rmin);
+      rmax = _mm256_max_ps(rp, rmax);
+    }
+    rseparated = _mm256_or_ps(rseparated, disjoint(lmin, lmax, rmin, rmax));
+  }
+  const __m256 rotated = _mm256_cmp_ps(_mm256_load_ps(b.rotation),
+                                       _mm256_set1_ps(lhs.rotation),
+                                       _CMP_NEQ_UQ);
+  separated = _mm256_or_ps(separated, _mm256_and_ps(rseparated, rotated));
+
+  uint32_t mask = ~_mm256_movemask_ps(separated) & 0xFF;
+  return mask & ((1u << b.size) - 1);
+}
+
+#endif
+
+bool supported (ISA isa) {
+  switch (isa) {
+  case ISA::SCALAR: return true;
+#if SAT_X86
+  case ISA::SSE2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+  case ISA::AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:  return false;
+  }
+}
+
+ISA selected (void) {
+  static const ISA isa = [] {
+    for (ISA i: {ISA::AVX2, ISA::SSE2})
+      if (supported(i)) return i;
+    return ISA::SCALAR;
+  }();
+  return isa;
+}
+
+const char* name (ISA isa) {
+  switch (isa) {
+  case ISA::SCALAR: return "scalar";
+  case ISA::SSE2:   return "sse2";
+  case ISA::AVX2:   return "avx2";
+  }
+  return "unknown";
+}
+
+using Kernel = uint32_t (*) (const Box&, const Batch&);
+
+static Kernel kernel (ISA isa) {
+  switch (isa) {
+#if SAT_X86
+  case ISA::SSE2:   return &collidesSSE2;
+  case ISA::AVX2:   return &collidesAVX2;
+#endif
+  default:          return &collidesScalar;
+  }
+}
+
+uint32_t collides (const Box &lhs, const Batch &batch) {
+  static const Kernel k = kernel(selected());
+  return k(lhs, batch);
+}
+
+uint32_t collides (const Box &lhs, const Batch &batch, ISA isa) {
+  if (!supported(isa))
+    utils::doThrow<std::invalid_argument>(
+      "Instruction set ", name(isa), " is not supported on this machine");
+  return kernel(isa)(lhs, batch);
+}
+
+} // end of namespace sat
+} // end of namespace physics
+} // end of namespace simu
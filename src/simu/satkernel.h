@@ -0,0 +1,77 @@
+#ifndef SIMU_SATKERNEL_H
+#define SIMU_SATKERNEL_H
+
+/// Batched separating axis tests between oriented rectangles
+///
+/// One rectangle is tested against a block of up to Batch::capacity candidates
+/// stored in structure-of-arrays form, using the widest instruction set
+/// available at runtime (AVX2, SSE2 or plain scalar code).
+/// All variants perform the exact same floating point operations as the
+/// reference (pair-wise) implementation and thus return the same decisions.
+
+#include <array>
+#include <cstdint>
+
+#include "types.h"
+
+namespace simu {
+namespace physics {
+namespace sat {
+
+/// What the separating axis test needs to know about an organ
+struct Box {
+  std::array<Point, 4> corners;
+  Point normal;     ///< Main normal (from origin to center)
+  float rotation;   ///< Only the main normal is tested for equal rotations
+};
+
+/// Candidates in structure-of-arrays form
+struct alignas(32) Batch {
+  static constexpr uint capacity = 8;
+
+  float cx [4][capacity], cy [4][capacity];
+  float nx [capacity], ny [capacity];
+  float rotation [capacity];
+  uint size = 0;
+
+  void push (const Box &b) {
+    for (uint i=0; i<4; i++) {
+      cx[i][size] = b.corners[i].x;
+      cy[i][size] = b.corners[i].y;
+    }
+    nx[size] = b.normal.x;
+    ny[size] = b.normal.y;
+    rotation[size] = b.rotation;
+    size++;
+  }
+
+  bool empty (void) const { return size == 0;         }
+  bool full (void) const {  return size == capacity;  }
+  void clear (void) {       size = 0;                 }
+};
+
+enum class ISA { SCALAR, SSE2, AVX2 };
+
+/// Reference implementation: whether \p lhs and \p rhs overlap
+bool collides (const Box &lhs, const Box &rhs);
+
+/// Tests \p lhs against all candidates in \p batch
+/// \returns the mask of colliding candidates (bit i for the i-th candidate)
+uint32_t collides (const Box &lhs, const Batch &batch);
+
+/// Same as above with a specific instruction set
+/// \throws std::invalid_argument if \p isa is not supported on this machine
+uint32_t collides (const Box &lhs, const Batch &batch, ISA isa);
+
+bool supported (ISA isa);
+
+/// The instruction set used by the dispatching version of collides
+ISA selected (void);
+
+const char* name (ISA isa);
+
+} // end of namespace sat
+} // end of namespace physics
+} // end of namespace simu
+
+#endif // SIMU_SATKERNEL_H
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+
+#include "kgd/external/cxxopts.hpp"
+
+#include "satkernel.h"
+
+/// Differential test of the batched separating axis kernels against the
+/// reference implementation
+
+using namespace simu;
+using namespace simu::physics;
+
+/// Rectangle of size \p l x \p w starting at \p o with angle \p a, with
+/// corners and normal computed as organs do
+sat::Box makeBox (const Point &o, float a, float l, float w) {
+  sat::Box b;
+  const Point v = Point::fromPolar(a, l), n = Point::fromPolar(a + M_PI/2, w/2);
+  b.corners = {{
+    { o.x + n.x, o.y + n.y },
+    { o.x + v.x + n.x, o.y + v.y + n.y },
+    { o.x + v.x - n.x, o.y + v.y - n.y },
+    { o.x - n.x, o.y - n.y }
+  }};
+  const Point c { o.x + .5f * v.x, o.y + .5f * v.y };
+  b.normal = { c.x - o.x, c.y - o.y };
+  b.rotation = a;
+  return b;
+}
+
+int main (int argc, char *argv[]) {
+  uint seed = 0, tests = 1000000;
+
+  cxxopts::Options options("ReusWorld (SAT kernels test)",
+                           "Compares batched separating axis tests with the"
+                           " reference implementation");
+  options.add_options()
+    ("h,help", "Display help")
+    ("s,seed", "Random seed", cxxopts::value(seed))
+    ("n,tests", "Number of batches to test", cxxopts::value(tests))
+    ;
+
+  auto result = options.parse(argc, argv);
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+
+  std::mt19937 rng (seed);
+
+  // Coarse values to provoke shared edges, identical rotations, etc.
+  std::uniform_int_distribution<int> coord (-8, 8), angle (0, 7), size (0, 4);
+  std::uniform_int_distribution<uint> batchSize (1, sat::Batch::capacity);
+  const auto randomBox = [&] {
+    return makeBox({ .25f * coord(rng), .25f * coord(rng) },
+                   angle(rng) * M_PI / 4, .5f * size(rng), .25f * size(rng));
+  };
+
+  using clock = std::chrono::high_resolution_clock;
+  std::map<sat::ISA, double> durations;
+  std::map<sat::ISA, uint> mismatches;
+  uint collisions = 0, pairs = 0;
+
+  std::vector<sat::ISA> isas;
+  for (sat::ISA isa: {sat::ISA::SCALAR, sat::ISA::SSE2, sat::ISA::AVX2})
+    if (sat::supported(isa))  isas.push_back(isa);
+
+  std::vector<sat::Box> candidates;
+  for (uint t=0; t<tests; t++) {
+    sat::Box lhs = randomBox();
+    sat::Batch batch;
+    candidates.clear();
+    for (uint j=0, n=batchSize(rng); j<n; j++) {
+      candidates.push_back(randomBox());
+      batch.push(candidates.back());
+    }
+
+    uint32_t expected = 0;
+    for (uint j=0; j<candidates.size(); j++)
+      expected |= uint32_t(sat::collides(lhs, candidates[j])) << j;
+    collisions += __builtin_popcount(expected);
+    pairs += candidates.size();
+
+    for (sat::ISA isa: isas) {
+      auto start = clock::now();
+      uint32_t mask = sat::collides(lhs, batch, isa);
+      durations[isa] += std::chrono::duration<double, std::milli>(
+                          clock::now() - start).count();
+
+      if (mask != expected) {
+        if (mismatches[isa]++ < 10)
+          std::cerr << "Mismatch for " << sat::name(isa) << " on batch " << t
+                    << ": " << std::hex << mask << " != " << expected
+                    << std::dec << std::endl;
+      }
+    }
+  }
+
+  std::cout << "Tested " << pairs << " pairs (" << collisions
+            << " collisions). Dispatching to " << sat::name(sat::selected())
+            << "\n";
+  uint errors = 0;
+  for (sat::ISA isa: isas) {
+    std::cout << "\t" << sat::name(isa) << ": " << mismatches[isa]
+              << " mismatch(es), " << durations[isa] << " ms\n";
+    errors += mismatches[isa];
+  }
+  std::cout << std::flush;
+
+  return errors > 0;
+}
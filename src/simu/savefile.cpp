@@ -0,0 +1,259 @@
+#include "savefile.h"
+
+namespace simu {
+namespace savefile {
+
+static constexpr bool debugSaveFile = false;
+
+static const std::string PLANTS = "plants";
+
+using clock = std::chrono::high_resolution_clock;
+static const auto duration = [] (const clock::time_point &start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+           clock::now() - start).count();
+};
+
+std::vector<uint8_t> encode (const stdfs::path &file, const json &j) {
+  const auto ext = file.extension();
+  if (ext == ".cbor")         return json::to_cbor(j);
+  else if (ext == ".msgpack") return json::to_msgpack(j);
+  else                        return json::to_ubjson(j);
+}
+
+template <typename IT>
+json decode (const stdfs::path &file, IT begin, IT end) {
+  const auto ext = file.extension();
+  if (ext == ".cbor")         return json::from_cbor(begin, end);
+  else if (ext == ".msgpack") return json::from_msgpack(begin, end);
+  else if (ext == ".ubjson")  return json::from_ubjson(begin, end);
+  else
+    utils::doThrow<std::invalid_argument>(
+      "Unkown save file type '", file, "' of extension '", ext, "'");
+  return json();
+}
+
+/// Appends the \p n least significant bytes of \p v (big endian)
+void putBE (std::vector<uint8_t> &bytes, uint64_t v, uint n) {
+  for (int i=(n-1)*8; i>=0; i-=8)  bytes.push_back((v >> i) & 0xFF);
+}
+
+uint64_t getBE (const uint8_t *bytes, uint n) {
+  uint64_t v = 0;
+  for (uint i=0; i<n; i++)  v = (v << 8) | bytes[i];
+  return v;
+}
+
+void to_json (json &j, const Entry &e) {
+  j = { e.offset, e.size, e.crc };
+}
+
+void from_json (const json &j, Entry &e) {
+  e.offset = j[0];
+  e.size = j[1];
+  e.crc = j[2];
+}
+
+// =============================================================================
+
+void write (const stdfs::path &file, const json &j) {
+  auto startTime = clock::now();
+
+  std::ofstream ofs (file, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!ofs)
+    utils::doThrow<std::invalid_argument>(
+          "Unable to open '", file, "' for writing");
+
+  uint64_t offset = 0;
+  const auto append = [&] (const std::vector<uint8_t> &bytes) {
+    CRC crcGenerator;
+    Entry e { offset, bytes.size(), crcGenerator(bytes.begin(), bytes.end()) };
+    ofs.write((const char*)bytes.data(), bytes.size());
+    offset += bytes.size();
+    return e;
+  };
+
+  json jfields = json::object(), jplants = json::array();
+  for (auto it = j.begin(); it != j.end(); ++it) {
+    if (it.key() == PLANTS && it->is_array()) {
+      for (const json &jp: *it) {
+        Entry genome = append(encode(file, jp.front()));
+        Entry body = append(encode(file, json(std::next(jp.begin()), jp.end())));
+        jplants.push_back({genome, body});
+      }
+
+    } else
+      jfields[it.key()] = append(encode(file, *it));
+  }
+
+  Footer footer;
+  Entry index = append(encode(file, {
+    { "fields", jfields }, { PLANTS, jplants }
+  }));
+  footer.indexOffset = index.offset;
+  footer.indexSize = index.size;
+  footer.indexCRC = index.crc;
+  footer.version = Footer::currentVersion;
+
+  std::vector<uint8_t> bytes;
+  putBE(bytes, footer.indexOffset, 8);
+  putBE(bytes, footer.indexSize, 8);
+  putBE(bytes, footer.indexCRC, 4);
+  putBE(bytes, footer.version, 4);
+  bytes.insert(bytes.end(), Footer::magicValue, Footer::magicValue + 8);
+  assert(bytes.size() == Footer::size);
+  ofs.write((const char*)bytes.data(), bytes.size());
+  ofs.close();
+
+  if (debugSaveFile)
+    std::cerr << "Wrote " << jfields.size() << " fields and " << jplants.size()
+              << " plants (" << offset + Footer::size << " bytes) into "
+              << file << " in " << duration(startTime) << " ms" << std::endl;
+}
+
+// =============================================================================
+
+Reader::Reader (const stdfs::path &file)
+  : _file(file), _ifs(file, std::ios::binary | std::ios::ate),
+    _indexed(false) {
+
+  if (!_ifs)
+    utils::doThrow<std::invalid_argument>(
+          "Unable to open '", file, "' for reading");
+
+  uint64_t size = _ifs.tellg();
+  if (size >= Footer::size) {
+    std::array<uint8_t, Footer::size> bytes;
+    _ifs.seekg(size - Footer::size);
+    _ifs.read((char*)bytes.data(), bytes.size());
+    _indexed = std::equal(Footer::magicValue, Footer::magicValue + 8,
+                          bytes.end() - 8);
+
+    if (_indexed) {
+      Footer footer;
+      footer.indexOffset = getBE(bytes.data(), 8);
+      footer.indexSize = getBE(bytes.data() + 8, 8);
+      footer.indexCRC = getBE(bytes.data() + 16, 4);
+      footer.version = getBE(bytes.data() + 20, 4);
+
+      if (footer.version != Footer::currentVersion)
+        utils::doThrow<std::invalid_argument>(
+          "Unsupported save file version ", footer.version, " for ", file);
+
+      if (footer.indexOffset + footer.indexSize + Footer::size > size)
+        utils::doThrow<std::invalid_argument>(
+          "Truncated index in ", file);
+
+      json index = read({footer.indexOffset, footer.indexSize,
+                         footer.indexCRC});
+      _fields = index["fields"].get<decltype(_fields)>();
+      for (const json &jp: index[PLANTS])
+        _plants.push_back({jp[0].get<Entry>(), jp[1].get<Entry>()});
+    }
+  }
+
+  if (!_indexed)  loadLegacy();
+}
+
+void Reader::loadLegacy (void) {
+  auto startTime = clock::now();
+
+  std::vector<uint8_t> v (_ifs.seekg(0, std::ios::end).tellg());
+  _ifs.seekg(0, std::ios::beg);
+  _ifs.read((char*)v.data(), v.size());
+
+  if (v.size() < CRC::bytes)
+    utils::doThrow<std::invalid_argument>(_file, " is not a save file");
+
+  CRC::type crcStored = getBE(v.data() + v.size() - CRC::bytes, CRC::bytes);
+  v.resize(v.size() - CRC::bytes);
+
+  CRC crcGenerator;
+  auto crcRecomputed = crcGenerator(v.begin(), v.end());
+  if (crcStored != crcRecomputed)
+    utils::doThrow<std::invalid_argument>(
+      "CRC Check failed: ", std::hex, crcStored, " != ", crcRecomputed);
+
+  std::cout << "Expanding " << _file << "...\r" << std::flush;
+
+  _legacy = decode(_file, v.begin(), v.end());
+
+  if (debugSaveFile)
+    std::cerr << "Loading " << _file << " (" << v.size() << " bytes) took "
+              << duration(startTime) << " ms" << std::endl;
+}
+
+json Reader::read (const Entry &e) {
+  std::vector<uint8_t> v (e.size);
+  _ifs.seekg(e.offset);
+  _ifs.read((char*)v.data(), v.size());
+  if (!_ifs)
+    utils::doThrow<std::invalid_argument>(
+      "Failed to read ", e.size, " bytes at ", e.offset, " in ", _file);
+
+  CRC crcGenerator;
+  auto crc = crcGenerator(v.begin(), v.end());
+  if (crc != e.crc)
+    utils::doThrow<std::invalid_argument>(
+      "CRC Check failed for block at ", e.offset, " in ", _file, ": ",
+      std::hex, e.crc, " != ", crc);
+
+  return decode(_file, v.begin(), v.end());
+}
+
+bool Reader::has (const std::string &field) const {
+  if (!_indexed)  return _legacy.find(field) != _legacy.end();
+  return _fields.find(field) != _fields.end()
+      || (field == PLANTS && !_plants.empty());
+}
+
+json Reader::field (const std::string &name) {
+  if (!_indexed)  return std::move(_legacy[name]);
+
+  if (name == PLANTS && _fields.find(name) == _fields.end()) {
+    json j = json::array();
+    for (size_t i=0; i<_plants.size(); i++) j.push_back(plant(i));
+    return j;
+  }
+
+  auto it = _fields.find(name);
+  if (it == _fields.end())
+    utils::doThrow<std::invalid_argument>(
+      "No field '", name, "' in ", _file);
+  return read(it->second);
+}
+
+size_t Reader::plants (void) const {
+  if (!_indexed) {
+    auto it = _legacy.find(PLANTS);
+    return it != _legacy.end() ? it->size() : 0;
+  }
+  return _plants.size();
+}
+
+json Reader::plantGenome (size_t i) {
+  if (!_indexed)  return _legacy[PLANTS].at(i).at(0);
+  return read(_plants.at(i).genome);
+}
+
+json Reader::plant (size_t i) {
+  if (!_indexed)  return _legacy[PLANTS].at(i);
+
+  const PlantEntry &e = _plants.at(i);
+  json j = read(e.body);
+  j.insert(j.begin(), read(e.genome));
+  return j;
+}
+
+json Reader::all (void) {
+  if (!_indexed)  return std::move(_legacy);
+
+  std::cout << "Expanding " << _file << "...\r" << std::flush;
+
+  json j;
+  for (const auto &p: _fields)  j[p.first] = read(p.second);
+  if (_fields.find(PLANTS) == _fields.end())  j[PLANTS] = field(PLANTS);
+  return j;
+}
+
+} // end of namespace savefile
+} // end of namespace simu
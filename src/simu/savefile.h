@@ -0,0 +1,102 @@
+#ifndef SIMU_SAVEFILE_H
+#define SIMU_SAVEFILE_H
+
+/// Indexed container for json-based saves (ubjson, cbor, msgpack)
+///
+/// Every top-level field is encoded on its own and followed by an index (in
+/// the same encoding) and a fixed-size footer locating it. Plants are further
+/// split into one genome and one body record each so that a reader can decode
+/// any field, plant or genome without touching the rest of the file.
+/// Every encoded block is protected by its own CRC.
+///
+/// Files written before the index was introduced (a single encoded document
+/// followed by a global CRC) are still readable.
+
+#include "kgd/utils/functions.h"
+#include "kgd/settings/configfile.h"
+
+namespace simu {
+namespace savefile {
+
+using json = nlohmann::json;
+using CRC = utils::CRC32<json>;
+
+struct Footer {
+  static constexpr char magicValue[8] = { 'R','E','U','S','I','D','X','1' };
+  static constexpr uint32_t currentVersion = 1;
+
+  /// Serialized size (big endian)
+  static constexpr uint size = 8 + 8 + 4 + 4 + sizeof(magicValue);
+
+  uint64_t indexOffset, indexSize;
+  uint32_t indexCRC, version;
+};
+
+/// Location of an encoded block
+struct Entry {
+  uint64_t offset, size;
+  CRC::type crc;
+};
+
+/// Encodes \p j according to \p file's extension and writes it, with its index
+void write (const stdfs::path &file, const json &j);
+
+/// Random access on the contents of a save file
+class Reader {
+public:
+  Reader (const stdfs::path &file);
+
+  const stdfs::path& file (void) const {
+    return _file;
+  }
+
+  /// Whether the file has an index (i-e fields can be decoded individually)
+  bool indexed (void) const {
+    return _indexed;
+  }
+
+  bool has (const std::string &field) const;
+
+  /// Whether this is an incremental save (see Simulation::loadJson)
+  bool isDelta (void) const {
+    return has("keyframe");
+  }
+
+  /// Decodes top-level field \p name
+  /// \note For non-indexed files the value is moved out of the decoded
+  /// document and can thus only be requested once
+  json field (const std::string &name);
+
+  /// Number of plant records
+  size_t plants (void) const;
+
+  /// Decodes the genome of the \p i-th plant
+  json plantGenome (size_t i);
+
+  /// Decodes the complete record of the \p i-th plant (see Plant::save)
+  json plant (size_t i);
+
+  /// Decodes everything
+  json all (void);
+
+private:
+  stdfs::path _file;
+  std::ifstream _ifs;
+  bool _indexed;
+
+  std::map<std::string, Entry> _fields;
+  struct PlantEntry {
+    Entry genome, body;
+  };
+  std::vector<PlantEntry> _plants;
+
+  json _legacy; ///< Whole contents for non-indexed files
+
+  json read (const Entry &e);
+  void loadLegacy (void);
+};
+
+} // end of namespace savefile
+} // end of namespace simu
+
+#endif // SIMU_SAVEFILE_H
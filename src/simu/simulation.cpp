@@ -1,7 +1,13 @@
-#include "kgd/random/random_iterator.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "kgd/utils/functions.h"
 
 #include "simulation.h"
+#include "savefile.h"
+#include "counterrng.h"
+#include "tiniestphysicsengine.h"
 #include "../config/dependencies.h"
 
 /// TODO Remove
@@ -53,10 +59,56 @@ static constexpr int debugReproduction = 0;
 static constexpr bool debugDeath = false;
 static constexpr int debugTopology = 0;
 static constexpr bool debugSerialization = false;
+static constexpr bool debugParallelStep = false;
+static constexpr bool debugAggregates = false;
 
 static constexpr bool debug = false
   | debugPlantManagement | debugReproduction | debugTopology;
 
+/// Counter-based stream of \p entity for the current step of \p env
+static CounterDice counterDice (const Environment &env, uint64_t entity,
+                                CounterDice::Purpose purpose) {
+  return CounterDice(env.dice().getSeed(), entity, env.time().toTimestamp(),
+                     purpose);
+}
+
+/// Sorts \p plants on the first value of their own (GID, step) stream so that
+/// their relative order does not depend on the list they were dispatched to
+static void counterOrder (const Environment &env, std::vector<Plant*> &plants) {
+  using Key = std::pair<uint32_t, Plant::ID>;
+  std::vector<std::pair<Key, Plant*>> keyed;
+  keyed.reserve(plants.size());
+  for (Plant *p: plants)
+    keyed.push_back({{counterDice(env, uint64_t(p->id()), CounterDice::STEP)(),
+                      p->id()}, p});
+  std::sort(keyed.begin(), keyed.end(),
+            [] (const auto &lhs, const auto &rhs) {
+    return lhs.first < rhs.first;
+  });
+  for (uint i=0; i<keyed.size(); i++)  plants[i] = keyed[i].second;
+}
+
+/// Throws if the strips schedule (see Simulation::stripPlantsStep) is enabled
+/// with an unusable width
+static void checkStripsSchedule (void) {
+  if (!Config::parallelStep() && !Config::counterRNG()) return;
+  const float W = Config::stepStripWidth();
+  if (!std::isfinite(W) || W <= 0)
+    utils::doThrow<std::invalid_argument>(
+      "Invalid strip width ", W, ": stepStripWidth must be strictly positive");
+}
+
+/// Shuffles \p v with either the environment's dice or, with counterRNG, the
+/// \p purpose stream
+template <typename T>
+static void shuffle (Environment &env, std::vector<T> &v,
+                     CounterDice::Purpose purpose) {
+  if (Config::counterRNG())
+    counterDice(env, 0, purpose).shuffle(v);
+  else
+    env.dice().shuffle(v);
+}
+
 #ifndef NDEBUG
 //#define CUSTOM_ENVIRONMENT
 //#define CUSTOM_PLANTS 5
@@ -378,6 +430,7 @@ Simulation::Simulation (Simulation &&that) : Simulation() {
 }
 
 bool Simulation::init (const EGenome &env, PGenome plant) {
+  checkStripsSchedule();
   _start = clock::now();
 
 #ifdef INSTRUMENTALISE
@@ -416,22 +469,23 @@ bool Simulation::init (const EGenome &env, PGenome plant) {
   }
 
   postInsertionCleanup(newborns);
-  updateGenStats();
 
   return true;
 }
 
 void Simulation::destroy (void) {
+  flushSaves();
+
   Plant::Seeds discardedSeeds;
   while (!_plants.empty())
-    delPlant(*_plants.begin()->second, discardedSeeds);
+    delPlant(**_plants.begin(), discardedSeeds);
   _env.destroy();
 }
 
 Plant* Simulation::addPlant(const PGenome &g, float x, float biomass) {
   bool insertionAborted = false;
   Plant *plant = nullptr;
-  Plants::iterator pit = _plants.end();
+  Population::Handle handle;
 
   _stats.newSeeds++;
 
@@ -447,13 +501,12 @@ Plant* Simulation::addPlant(const PGenome &g, float x, float biomass) {
 
   if (!insertionAborted) { // Is there room left in the main container? (should be)
     Point pos {x, _env.heightAt(x)};
-    auto pair = _plants.try_emplace(x, std::make_unique<Plant>(g, pos));
+    handle = _plants.insert(std::make_unique<Plant>(g, pos));
 
-    if (pair.second) {
-      pit = pair.first;
-      plant = pit->second.get();
+    if (handle.isValid())
+      plant = _plants.get(handle);
 
-    } else
+    else
       insertionAborted = true;
   }
 
@@ -464,6 +517,7 @@ Plant* Simulation::addPlant(const PGenome &g, float x, float biomass) {
       if (_ptreeActive) pd = _ptree.addGenome(plant->genome());
 
       plant->init(_env, biomass, pd);
+      _plants.refresh(plant);
 
       if (debugPlantManagement)
         std::cerr << PlantID(plant) << " Added at " << plant->pos() << " with "
@@ -473,7 +527,7 @@ Plant* Simulation::addPlant(const PGenome &g, float x, float biomass) {
 
     } else {
       insertionAborted = true;
-      _plants.erase(pit);
+      _plants.erase(handle);
     }
   }
 
@@ -493,11 +547,13 @@ void Simulation::delPlant(Plant &p, Plant::Seeds &seeds) {
 }
 
 void Simulation::postInsertionCleanup(std::vector<Plant*> newborns) {
+  profiler::Scope profile (profiler::Phase::CLEANUP);
+
   // Notify the physics engine
   _env.processNewObjects();
 
   // Shuffle the vector
-  _env.dice().shuffle(newborns);
+  shuffle(_env, newborns, CounterDice::CLEANUP);
 
   // Now test that there is enough space
   Plant::Seeds discardedSeeds;
@@ -508,13 +564,34 @@ void Simulation::postInsertionCleanup(std::vector<Plant*> newborns) {
 }
 
 void Simulation::performReproductions(void) {
+  profiler::Scope profile (profiler::Phase::REPRODUCTIONS);
+
   if (debugReproduction)
     std::cerr << "Performing reproduction(s)" << std::endl;
 
-  for (const auto &it: rng::randomIterator(_plants, _env.dice())) {
-    Plant *father = it.second.get();
+  static const bool &counterRNG = Config::counterRNG();
+
+  std::vector<Plant*> fathers = _plants.sorted();
+  shuffle(_env, fathers, CounterDice::REPRODUCTION);
+
+  // Query the pistils in range of all mature stamens in one go
+  std::vector<Organ*> stamens;
+  for (Plant *father: fathers) {
+    if (father->sex() == Plant::Sex::FEMALE) continue;
+    for (Organ *stamen: father->stamens())
+      if (stamen->requiredBiomass() <= 0) stamens.push_back(stamen);
+  }
+  _env.prepareGeneticMaterialCollection(stamens);
+
+  for (Plant *father: fathers) {
     if (father->sex() == Plant::Sex::FEMALE) continue;
 
+    // Father-local streams (only used with counterRNG)
+    CounterDice pollination = counterDice(_env, uint64_t(father->id()),
+                                          CounterDice::POLLINATION);
+    CounterDice crossover = counterDice(_env, uint64_t(father->id()),
+                                        CounterDice::CROSSOVER);
+
     bool fecundated = false;
     auto &stamens = father->stamens();
     for (auto it = stamens.begin(); it != stamens.end();
@@ -523,7 +600,9 @@ void Simulation::performReproductions(void) {
       Organ *stamen = *it;
 
       if (stamen->requiredBiomass() > 0)  continue;
-      physics::Pistil s = _env.collectGeneticMaterial(stamen);
+      physics::Pistil s = counterRNG ?
+            _env.collectGeneticMaterial(stamen, pollination)
+          : _env.collectGeneticMaterial(stamen);
 
       if (debugReproduction > 1) {
         if (s.isValid())
@@ -540,9 +619,16 @@ void Simulation::performReproductions(void) {
       float distance, compatibility;
       Plant *mother = s.organ->plant();
       std::vector<Plant::Genome> litter (mother->genome().seedsPerFruit);
-      bool fecundated =
-        genotype::bailOutCrossver(mother->genome(), father->genome(), litter,
-                                  _env.dice(), &distance, &compatibility);
+      bool fecundated;
+      if (counterRNG) {
+        rng::FastDice dice = crossover.fork();
+        fecundated =
+          genotype::bailOutCrossver(mother->genome(), father->genome(), litter,
+                                    dice, &distance, &compatibility);
+      } else
+        fecundated =
+          genotype::bailOutCrossver(mother->genome(), father->genome(), litter,
+                                    _env.dice(), &distance, &compatibility);
 
       if (debugReproduction) {
         std::cerr << "\tMating " << mother->id() << " with " << father->id()
@@ -572,6 +658,9 @@ void Simulation::performReproductions(void) {
 
         father->resetStamen(stamen);
 
+        _plants.refresh(mother);
+        _plants.refresh(father);
+
         _stats.reproductions++;
       }
     }
@@ -580,6 +669,7 @@ void Simulation::performReproductions(void) {
 
 void Simulation::plantSeeds(const Plant::Seeds &seeds) {
   using utils::gauss;
+  profiler::Scope profile (profiler::Phase::SEEDS);
 
   static constexpr int debug = debugReproduction | debugTopology;
 
@@ -594,7 +684,11 @@ void Simulation::plantSeeds(const Plant::Seeds &seeds) {
 
   uint pfails = 0;
 
-  for (const Plant::Seed &seed: rng::randomIterator(seeds, _env.dice())) {
+  std::vector<const Plant::Seed*> sowing;
+  for (const Plant::Seed &s: seeds) sowing.push_back(&s);
+  shuffle(_env, sowing, CounterDice::SOWING);
+  for (const Plant::Seed *s: sowing) {
+    const Plant::Seed &seed = *s;
     if (seed.biomass <= 0) {
       unplanted.push_back(seed);
       continue;
@@ -680,8 +774,18 @@ void Simulation::plantSeeds(const Plant::Seeds &seeds) {
     if (debugTopology)  std::cerr << std::endl;
 
     rng::rdist rdist (values.begin(), values.end());
-    uint voxel = _env.dice()(rdist);
-    float noise = _env.dice()(-.5f, .5f);
+    uint voxel;
+    float noise;
+    if (Config::counterRNG()) {
+      CounterDice dice = counterDice(_env, uint64_t(seed.genome.id()),
+                                     CounterDice::DISPERSAL);
+      voxel = dice(rdist);
+      noise = dice(-.5f, .5f);
+
+    } else {
+      voxel = _env.dice()(rdist);
+      noise = _env.dice()(-.5f, .5f);
+    }
     float x = seed.position.x
         + ((2 * voxel + noise) / samplings - 1) * dist;
 
@@ -724,70 +828,192 @@ void Simulation::step (void) {
 
   _stats = Stats{};
   _stats.start = clock::now();
+  if (_profiler)  _profiler->stepStart(_env.time().pretty());
 
   if (_ptreeActive) _ptree.resetStats();
   _env.stepStart();
 
   Plant::Seeds seeds;
   std::set<Plant*> corpses;
-  for (const auto &it: rng::randomIterator(_plants, _env.dice())) {
-    const Plant_ptr &p = it.second;
-    _stats.derivations += p->step(_env);
-    if (p->isDead()) {
-      if (debugDeath) p->autopsy();
-      corpses.insert(p.get());
+  if (Config::parallelStep() || Config::counterRNG())
+    stripPlantsStep(corpses);
+
+  else {
+    profiler::Scope profile (profiler::Phase::PLANTS);
+    std::vector<Plant*> order = _plants.sorted();
+    _env.dice().shuffle(order);
+    for (Plant *p: order) {
+      _stats.derivations += p->step(_env);
+      _plants.refresh(p);
+      if (p->isDead()) {
+        if (debugDeath) p->autopsy();
+        corpses.insert(p);
+      }
     }
   }
 
   _stats.deadPlants = corpses.size();
-  for (Plant *p: corpses)
-    delPlant(*p, seeds);
+  {
+    profiler::Scope profile (profiler::Phase::CORPSES);
+    for (Plant *p: corpses)
+      delPlant(*p, seeds);
+  }
 
 #if !CUSTOM_PLANTS
   performReproductions();
 
-  for (const auto &p: _plants)
-    if (p.second->hasUncollectedSeeds())
-      p.second->collectCurrentStepSeeds(seeds);
+  for (const auto &l: _plants.byPosition())
+    if (l.plant->hasUncollectedSeeds())
+      l.plant->collectCurrentStepSeeds(seeds);
   if (!seeds.empty()) plantSeeds(seeds);
 #endif
 
-  if (_ptreeActive)
-    _ptree.step(_env.time().toTimestamp(), _plants.begin(), _plants.end(),
-                [] (const Plants::value_type &pair) {
-      return pair.second->species();
+  if (_ptreeActive) {
+    profiler::Scope profile (profiler::Phase::PTREE);
+    const auto &plants = _plants.byPosition();
+    _ptree.step(_env.time().toTimestamp(), plants.begin(), plants.end(),
+                [] (const Population::Located &l) {
+      return l.plant->species();
     });
+  }
 
-  updateGenStats();
   logToFiles();
 
   if (_env.hasTopologyChanged()) {
-    for (const auto &it: _plants) {
-      const auto pos = it.second->pos();
+    profiler::Scope profile (profiler::Phase::ALTITUDE);
+    for (const auto &l: _plants.byPosition()) {
+      const auto pos = l.plant->pos();
       float h = _env.heightAt(pos.x);
       if (pos.y != h)
-        updatePlantAltitude(*it.second, h);
+        updatePlantAltitude(*l.plant, h);
     }
   }
 
   _env.stepEnd();
 
-//  if (_env.time().isStartOfYear()
-//    && (_env.time().year() % Config::saveEvery()) == 0)
-    save(periodicSaveName());
+  if (_env.time().isStartOfYear()
+    && (_env.time().year() % Config::saveEvery()) == 0)
+    periodicSave();
+
+  if (_profiler)  _profiler->stepEnd();
+}
+
+void Simulation::stripPlantsStep (std::set<Plant*> &corpses) {
+  static const auto &W = Config::stepStripWidth();
+
+  profiler::Scope profile (profiler::Phase::PLANTS);
+
+  const float x0 = -_env.xextent();
+  const int S = std::max(1, int(std::ceil(2 * _env.xextent() / W)));
+
+  // Dispatch plants (in x order, as the serial step)
+  std::vector<std::vector<Plant*>> strips (S);
+  std::vector<Plant*> boundary;
+  for (const auto &l: _plants.byPosition()) {
+    Plant *p = l.plant;
+    int s = std::floor((l.x - x0) / W);
+    utils::iclip(0, s, S-1);
+
+    const Rect r = p->translatedBoundingRect();
+    if (x0 + s * W <= r.l() && r.r() <= x0 + (s+1) * W)
+      strips[s].push_back(p);
+    else
+      boundary.push_back(p);
+  }
+
+  // Order every strip from the plants' own streams if counter-based or shuffle
+  // it with a dice seeded in a fixed order otherwise
+  for (int s=0; s<S; s++) {
+    if (Config::counterRNG())
+      counterOrder(_env, strips[s]);
+    else {
+      rng::FastDice dice (_env.dice()(0, std::numeric_limits<int>::max()));
+      dice.shuffle(strips[s]);
+    }
+  }
+
+#ifdef _OPENMP
+  static const auto &threads = Config::stepThreads();
+  const int nthreads = threads > 0 ? int(threads) : omp_get_max_threads();
+#endif
+
+  std::vector<std::vector<Plant*>> stripCorpses (S);
+  std::vector<PopulationAggregates::Contribution> stripDeltas (S);
+  uint derivations = 0;
+  for (int phase = 0; phase < 2; phase++) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:derivations) \
+  num_threads(nthreads) if(Config::parallelStep())
+#endif
+    for (int s = phase; s < S; s += 2) {
+      for (Plant *p: strips[s]) {
+        derivations += p->step(_env);
+        stripDeltas[s] += _plants.update(p);
+        if (p->isDead()) {
+          if (debugDeath) p->autopsy();
+          stripCorpses[s].push_back(p);
+        }
+      }
+    }
+  }
+
+  // Plants stepped concurrently are two strips apart: they could not have
+  // interacted if none grew by more than half a strip
+  if (Config::parallelStep()) {
+    for (int s=0; s<S; s++) {
+      for (const Plant *p: strips[s]) {
+        const Rect r = p->translatedBoundingRect();
+        if (r.l() < x0 + (s - .5f) * W || x0 + (s + 1.5f) * W < r.r())
+          utils::doThrow<std::logic_error>(
+            PlantID(p), " grew from strip ", s, " to [", r.l(), ", ", r.r(),
+            "] in a single parallel step. Increase stepStripWidth (", W, ")");
+      }
+    }
+  }
+
+  // Plants that may interact with more than one strip
+  if (Config::counterRNG())
+    counterOrder(_env, boundary);
+  else
+    _env.dice().shuffle(boundary);
+  for (const auto &d: stripDeltas) _plants.apply(d);
+
+  for (Plant *p: boundary) {
+    derivations += p->step(_env);
+    _plants.refresh(p);
+    if (p->isDead()) {
+      if (debugDeath) p->autopsy();
+      corpses.insert(p);
+    }
+  }
+
+  for (const auto &sc: stripCorpses)  corpses.insert(sc.begin(), sc.end());
+  _stats.derivations += derivations;
+
+  if (debugParallelStep)
+    std::cerr << "Stepped " << _plants.size() - boundary.size() << " plants in "
+              << S << " strips and " << boundary.size() << " serially"
+              << std::endl;
 }
 
 void Simulation::atEnd(void) {
+  // Make sure every checkpoint made it to the disk
+  flushSaves();
+
   // Update once more so that data goes from y0d0h0 to yLd0h0 with L = stopAtYear()
   if (_env.startTime() < _env.time()) {
     _stats.start = clock::now();
     logToFiles();
   }
 
+  if (_voxelLog)  _voxelLog->flush();
+  if (_profiler)  _profiler->flush();
+
   if (_ptreeActive) {
-    _ptree.step(_env.time().toTimestamp(), _plants.begin(), _plants.end(),
-                [] (const Plants::value_type &pair) {
-      return pair.second->species();
+    const auto &plants = _plants.byPosition();
+    _ptree.step(_env.time().toTimestamp(), plants.begin(), plants.end(),
+                [] (const Population::Located &l) {
+      return l.plant->species();
     });
 
     stdfs::path ptreePath = dataFolder() / "phylogeny.ptree.json";
@@ -858,6 +1084,19 @@ void Simulation::setDataFolder (const stdfs::path &path, Overwrite o) {
     utils::doThrow<std::invalid_argument>(
       "Unable to open stats file ", statsPath);
 
+  _profiler.reset();
+  if (Config::profileEvery() > 0)
+    _profiler = std::make_unique<profiler::Profiler>(
+                  path, Config::profileEvery(), Config::profileTrace(),
+                  openMode);
+
+  if (_voxelLog)  _voxelLog->flush();
+  _voxelLog.reset();
+  if (Config::binaryVoxelLogs())
+    _voxelLog = std::make_unique<voxellog::Writer>(
+                  path / "voxels.bin", Config::voxelLogBatch(),
+                  Config::daysPerYear(), Config::stepsPerDay());
+
   using O = genotype::cgp::Outputs;
   using U = EnumUtils<O>;
   for (O o: U::iterator()) {
@@ -866,7 +1105,7 @@ void Simulation::setDataFolder (const stdfs::path &path, Overwrite o) {
     std::ofstream &ofs = _envFiles[o_t];
 
     if (ofs.is_open()) ofs.close();
-    if (!config::CGP::isActiveOutput(o_t))  continue;
+    if (!config::CGP::isActiveOutput(o_t) || _voxelLog)  continue;
 
     ofs.open(envPath, openMode);
 
@@ -876,16 +1115,8 @@ void Simulation::setDataFolder (const stdfs::path &path, Overwrite o) {
   }
 }
 
-void Simulation::updateGenStats (void) {
-  for (const auto &p: _plants) {
-    const Plant &plant = *p.second;
-    auto gen = plant.genome().gdata.generation;
-    _stats.minGeneration = std::min(_stats.minGeneration, gen);
-    _stats.maxGeneration = std::max(_stats.maxGeneration, gen);
-  }
-}
-
 void Simulation::logToFiles (void) {
+  profiler::Scope profile (profiler::Phase::LOGGING);
   if (_statsFile.is_open())  logGlobalStats();
   logEnvState();
 }
@@ -893,46 +1124,38 @@ void Simulation::logToFiles (void) {
 void Simulation::logGlobalStats(void) {
   bool header = (_env.startTime() == _env.time());
 
-  if (header)
+  const bool envValidation = config::Simulation::envUpdateValidation();
+
+  if (header) {
     _statsFile << "Date Time MinGen MaxGen Plants Seeds Females Males Biomass"
                   " Derivations Organs Flowers Fruits Matings"
                   " Reproductions dSeeds Births Deaths AvgDist AvgCompat"
-                  " ASpecies CSpecies MinX MaxX"
+                  " ASpecies CSpecies MinX MaxX CMemoHits CMemoMisses";
+    if (envValidation) _statsFile << " EnvDevA EnvDevT EnvDevH EnvDevG";
+    _statsFile << physics::Counters::Header{}
                << PTree::StatsHeader{} << "\n";
+  }
 
-  using decimal = Plant::decimal;
-  decimal biomass = 0;
-  uint seeds = 0;
-  uint organs = 0, flowers = 0, fruits = 0;
-  uint females = 0, males = 0;
-  float minx = _env.xextent(), maxx = -_env.xextent();
-
-  for (const auto &p: _plants) {
-    const Plant &plant = *p.second;
-    seeds += plant.isInSeedState();
-    biomass += plant.biomass();
-
-    organs += plant.organs().size();
-    flowers += plant.flowers().size();
-    fruits += plant.fruits().size();
+  if (debugAggregates)  _plants.aggregates().check(_plants.rescan());
 
-    females += (plant.sex() == Plant::Sex::FEMALE);
-    males += (plant.sex() == Plant::Sex::MALE);
+  const PopulationAggregates &a = _plants.aggregates();
+  const auto &t = a.totals;
 
-    float x = plant.pos().x;
-    minx = std::min(minx, x);
-    maxx = std::max(maxx, x);
+  float minx = _env.xextent(), maxx = -_env.xextent();
+  if (!_plants.empty()) {
+    minx = _plants.byPosition().front().x;
+    maxx = _plants.byPosition().back().x;
   }
 
   _statsFile << _env.time().pretty()
              << " " << duration(_stats.start)
-             << " " << _stats.minGeneration << " " << _stats.maxGeneration
-             << " " << _plants.size() << " " << seeds
-             << " " << females << " " << males
-             << " " << biomass
+             << " " << a.minGeneration << " " << a.maxGeneration
+             << " " << _plants.size() << " " << t.seeds
+             << " " << t.females << " " << t.males
+             << " " << t.biomass
 
              << " " << _stats.derivations
-             << " " << organs << " " << flowers << " " << fruits
+             << " " << t.organs << " " << t.flowers << " " << t.fruits
 
              << " " << _stats.matings << " " << _stats.reproductions
              << " " << _stats.newSeeds << " " << _stats.newPlants
@@ -945,8 +1168,14 @@ void Simulation::logGlobalStats(void) {
 
              << " " << minx << " " << maxx
 
-             << _ptree.stats()
+             << " " << _env.collisionMemoStats().hits
+             << " " << _env.collisionMemoStats().misses;
 
+  if (envValidation)
+    for (float d: _env.lodDeviation())  _statsFile << " " << d;
+
+  _statsFile << _env.collisionData().counters()
+             << _ptree.stats()
              << std::endl;
 
 //  debugPrintAll();
@@ -963,6 +1192,31 @@ void Simulation::logEnvState(void) {
   using O = genotype::cgp::Outputs;
   using U = EnumUtils<O>;
 
+  static const auto &stride = Config::voxelLogStride();
+  uint timestamp = _env.time().toTimestamp();
+  if (stride > 1 && (timestamp % stride) != 0)  return;
+
+  const auto voxels = [this] (O o) -> const std::vector<float>& {
+    switch (o) {
+    case O::T: return _env.topology();
+    case O::H: return _env.temperature();
+    case O::W: return _env.hygrometry()[SHALLOW];
+    case O::G: default: return _env.grazing();
+    }
+  };
+
+  if (_voxelLog) {
+    std::vector<voxellog::Layer> layers;
+    for (O o: U::iterator()) {
+      auto o_t = U::toUnderlying(o);
+      if (!config::CGP::isActiveOutput(o_t))  continue;
+      layers.push_back({ uint32_t(o_t), envPaths.at(o).stem().string(),
+                        &voxels(o) });
+    }
+    _voxelLog->append(timestamp, layers);
+    return;
+  }
+
   for (O o: U::iterator()) {
     auto o_t = U::toUnderlying(o);
     if (!config::CGP::isActiveOutput(o_t))  continue;
@@ -970,62 +1224,11 @@ void Simulation::logEnvState(void) {
     std::ofstream &ofs = _envFiles[o_t];
     if (!ofs.is_open()) continue;
 
-    switch (o) {
-    case O::T: doLog(ofs, _env.time(), _env.topology());  break;
-    case O::H: doLog(ofs, _env.time(), _env.temperature());  break;
-    case O::W: doLog(ofs, _env.time(), _env.hygrometry()[SHALLOW]);  break;
-    case O::G: doLog(ofs, _env.time(), _env.grazing());  break;
-    }
+    doLog(ofs, _env.time(), voxels(o));
   }
 }
 
-// Low level writing of a bytes array
-bool save (const std::string &file, const std::vector<uint8_t> &bytes) {
-  std::fstream ofs (file, std::ios::out | std::ios::binary);
-  if (!ofs)
-    utils::doThrow<std::invalid_argument>(
-          "Unable to open '", file, "' for writing");
-
-  ofs.write((char*)bytes.data(), bytes.size());
-  ofs.close();
-
-  return true;
-}
-
-// Low level loading of a bytes array
-bool load (const std::string &file, std::vector<uint8_t> &bytes) {
-  std::ifstream ifs(file, std::ios::binary | std::ios::ate);
-  if (!ifs)
-    utils::doThrow<std::invalid_argument>(
-          "Unable to open '", file, "' for reading");
-
-  std::ifstream::pos_type pos = ifs.tellg();
-
-  bytes.resize(pos);
-  ifs.seekg(0, std::ios::beg);
-  ifs.read((char*)bytes.data(), pos);
-
-  return true;
-}
-
-
 using json = nlohmann::json;
-using CRC = utils::CRC32<json>;
-
-void insertCRC (CRC::type crc, std::vector<std::uint8_t> &bytes) {
-  for (int i=(CRC::bytes-1)*8; i>=0; i-=8)
-    bytes.push_back((crc >> i) & 0xFF);
-}
-
-CRC::type extractCRC (std::vector<std::uint8_t> &bytes) {
-  CRC::type crc = 0;
-  for (uint i=0; i<CRC::bytes; i++) {
-    CRC::type byte = bytes.back();
-    bytes.pop_back();
-    crc += byte << (i*8);
-  }
-  return crc;
-}
 
 using clock = std::chrono::high_resolution_clock;
 const auto duration = [] (const clock::time_point &start) {
@@ -1054,8 +1257,8 @@ void Simulation::debugPrintAll(void) const {
 //      << "\t\tTemperature: " << _env.temperature() << "\n"
       << "\tPlants:\n";
 
-  for (const auto &pair: _plants) {
-    Plant * p = pair.second.get();
+  for (const auto &l: _plants.byPosition()) {
+    Plant * p = l.plant;
     ofs << "\t\t" << PlantID(p) << "\n"
         << "\t\t\tGenome: " << p->genome() << "\n"
         << "\t\t\tPos: " << p->pos() << "\n"
@@ -1088,11 +1291,11 @@ void Simulation::clone(const Simulation &s) {
   std::map<const Plant*, Plant*> plookup;
   std::map<const Plant*, std::map<const Organ*, Organ*>> olookups;
   std::vector<Plant*> rsetPlants;
-  for (const auto &p: s._plants) {
-     Plant *clone = Plant::clone(*p.second, olookups);
-     _plants[clone->pos().x] = std::unique_ptr<Plant>(clone);
-     plookup[p.second.get()] = clone;
-     if (p.second->hasPStatsPointer())  rsetPlants.push_back(clone);
+  for (const Plant *p: s._plants) {
+     Plant *clone = Plant::clone(*p, olookups);
+     _plants.insert(Plant_ptr(clone));
+     plookup[p] = clone;
+     if (p->hasPStatsPointer())  rsetPlants.push_back(clone);
   }
 
   _env.clone(s._env, plookup, olookups);
@@ -1104,6 +1307,8 @@ void Simulation::clone(const Simulation &s) {
   _start = clock::now();
   _aborted = false;
 
+  _deltaSaves = DeltaSaves{}; // Next periodic save is a keyframe
+
   _dataFolder = s._dataFolder;
 }
 
@@ -1116,41 +1321,49 @@ std::string field (SimuFields f) {
 nlohmann::json Simulation::serializePopulation (void) const {
   nlohmann::json j;
 
-  for (const auto &p: _plants) {
+  for (const auto &l: _plants.byPosition()) {
     json jp;
-    Plant::save(jp, *p.second);
+    Plant::save(jp, *l.plant);
     j.push_back(jp);
   }
 
   return j;
 }
 
-void Simulation::deserializePopulation (const nlohmann::json &j,
-                                        bool updatePTree) {
-  for (const auto &jp: j) {
-    Plant *p = Plant::load(jp);
+void Simulation::registerLoadedPlant (Plant *p, bool updatePTree) {
+  _plants.insert(Plant_ptr(p));
 
-    _plants.insert({p->pos().x, Plant_ptr(p)});
+  _env.addCollisionData(p);
 
-    _env.addCollisionData(p);
+  if (updatePTree) {
+    PStats *pstats = _ptree.getUserData(p->genealogy().self);
+    p->setPStatsPointer(pstats);
+  }
 
-    if (updatePTree) {
-      PStats *pstats = _ptree.getUserData(p->genealogy().self);
-      p->setPStatsPointer(pstats);
-    }
+  _env.updateCollisionDataFinal(p); /// FIXME Update after all plants have been inserted
+  if (p->sex() == Plant::Sex::FEMALE)
+    for (Organ *o: p->pistils())
+      _env.disseminateGeneticMaterial(o);
+}
 
-    _env.updateCollisionDataFinal(p); /// FIXME Update after all plants have been inserted
-    if (p->sex() == Plant::Sex::FEMALE)
-      for (Organ *o: p->pistils())
-        _env.disseminateGeneticMaterial(o);
-  }
+void Simulation::deserializePopulation (const nlohmann::json &j,
+                                        bool updatePTree) {
+  for (const auto &jp: j)
+    registerLoadedPlant(Plant::load(jp), updatePTree);
 
   _env.postLoad();
-  updateGenStats();
 }
 
+void Simulation::deserializePopulation (const snapshot::Reader &r,
+                                        bool updatePTree) {
+  for (uint i=0; i<r.plants().size(); i++)
+    registerLoadedPlant(Plant::load(r, i), updatePTree);
 
-void Simulation::save (stdfs::path file) const {
+  _env.postLoad();
+}
+
+
+json Simulation::serialize (void) const {
   auto startTime = clock::now();
 
   json jc, je, jt;
@@ -1170,27 +1383,47 @@ void Simulation::save (stdfs::path file) const {
   if (debugSerialization)
     std::cerr << "Serializing took " << duration(startTime) << " ms" << std::endl;
 
-  startTime = clock::now();
+  return j;
+}
 
-  std::vector<std::uint8_t> v;
+void Simulation::serialize (snapshot::Writer &w) const {
+  using snapshot::Section;
+  auto startTime = clock::now();
 
-  const auto ext = file.extension();
-  if (ext == ".cbor")         v = json::to_cbor(j);
-  else if (ext == ".msgpack") v = json::to_msgpack(j);
-  else {
-    if (ext != ".ubjson") file += ".ubjson";
-    v = json::to_ubjson(j);
-  }
+  json jc, jt;
+  config::Simulation::serialize(jc);
+  w.addJson(Section::CONFIG, jc);
+
+  Environment::save(w, _env);
 
-  CRC crcGenerator;
-  auto crc = crcGenerator(v.begin(), v.end());
-  insertCRC(crc, v);
+  for (const auto &l: _plants.byPosition())  Plant::save(w, *l.plant);
+
+  if (_ptreeActive)
+    PTree::toJson(jt, _ptree);
+  w.addJson(Section::PTREE, jt);
 
-  simu::save(file, v);
+  w.meta.nextID = uint64_t(Plant::ID(_gidManager));
 
   if (debugSerialization)
-    std::cerr << "Saving " << file << " (" << v.size() << " bytes) took "
-              << duration(startTime) << " ms" << std::endl;
+    std::cerr << "Serializing (binary) took " << duration(startTime) << " ms"
+              << std::endl;
+}
+
+void Simulation::save (stdfs::path file) const {
+  profiler::Scope profile (profiler::Phase::SAVE);
+  auto startTime = clock::now();
+
+  if (snapshot::isSnapshot(file)) {
+    snapshot::Writer w;
+    serialize(w);
+    w.write(file);
+
+  } else
+    file = Checkpointer::write(file, serialize());
+
+  if (debugSerialization)
+    std::cerr << "Saving " << file << " took " << duration(startTime) << " ms"
+              << std::endl;
 
 #if !defined(NDEBUG) && 0
   std::cerr << "Reloading for round-trip test" << std::endl;
@@ -1200,14 +1433,226 @@ void Simulation::save (stdfs::path file) const {
 #endif
 }
 
+json Simulation::serializeDelta (void) {
+  auto startTime = clock::now();
+
+  json jc, je, jt;
+  config::Simulation::serialize(jc);
+  Environment::save(je, _env);
+
+  if (_ptreeActive)
+    PTree::toJson(jt, _ptree);
+
+  // Only store what changed since the previous periodic save
+  json jremoved = json::array(), jfull = json::array(), jstate = json::array();
+  std::set<GID> alive;
+  for (const auto &l: _plants.byPosition()) {
+    const Plant &plant = *l.plant;
+    GID gid = plant.id();
+    alive.insert(gid);
+
+    json jp;
+    if (plant.structureChanged()
+        || _deltaSaves.plants.find(gid) == _deltaSaves.plants.end()) {
+      Plant::save(jp, plant);
+      jfull.push_back({gid, jp});
+
+    } else {
+      Plant::saveState(jp, plant);
+      jstate.push_back({gid, jp});
+    }
+  }
+  for (GID gid: _deltaSaves.plants)
+    if (alive.find(gid) == alive.end())
+      jremoved.push_back(gid);
+
+  json j;
+  j["config"] = jc;
+  j[field(SimuFields::ENV)] = je;
+  j[field(SimuFields::PLANTS)] = {
+    { "removed", jremoved }, { "full", jfull }, { "state", jstate }
+  };
+  j[field(SimuFields::PTREE)] = jt;
+  j["nextID"] = Plant::ID(_gidManager);
+
+  if (debugSerialization)
+    std::cerr << "Serializing delta (" << jremoved.size() << " removed, "
+              << jfull.size() << " full, " << jstate.size() << " partial) took "
+              << duration(startTime) << " ms" << std::endl;
+
+  return j;
+}
+
+void Simulation::periodicSave (void) {
+  static const auto &K = Config::saveKeyframeEvery();
+
+  profiler::Scope profile (profiler::Phase::SAVE);
+
+  if (!_checkpointer)
+    _checkpointer = std::make_unique<Checkpointer>(Config::asyncSaves());
+
+  auto startTime = clock::now();
+
+  // Native snapshots are always keyframes
+  const bool binary = Config::binarySaves();
+
+  Checkpointer::Job job;
+  job.delta = (K > 1 && !binary && !_deltaSaves.keyframe.empty()
+               && _deltaSaves.deltas + 1 < K);
+  if (K > 1 && !binary)
+    job.incremental = { field(SimuFields::ENV), field(SimuFields::PTREE) };
+
+  if (binary) {
+    job.file = periodicSaveName();
+    job.file += snapshot::extension;
+    job.snapshot = std::make_unique<snapshot::Writer>();
+    serialize(*job.snapshot);
+
+  } else if (job.delta) {
+    job.file = Checkpointer::savePath(
+                 periodicDeltaName(_dataFolder, _env.time().year()));
+    job.data = serializeDelta();
+    job.data["keyframe"] = _deltaSaves.keyframe.filename().string();
+    job.data["previous"] = _deltaSaves.previous.filename().string();
+    _deltaSaves.deltas++;
+
+  } else {
+    job.file = Checkpointer::savePath(periodicSaveName());
+    job.data = serialize();
+    _deltaSaves.keyframe = job.file;
+    _deltaSaves.deltas = 0;
+  }
+  _deltaSaves.previous = job.file;
+
+  _deltaSaves.plants.clear();
+  for (Plant *p: _plants) {
+    _deltaSaves.plants.insert(p->id());
+    p->markSaved();
+  }
+
+  _checkpointer->submit(std::move(job));
+
+  if (debugSerialization)
+    std::cerr << "Checkpoint submission took " << duration(startTime) << " ms"
+              << std::endl;
+}
+
+void Simulation::flushSaves (void) {
+  if (_checkpointer)  _checkpointer->flush();
+}
+
+/// Reads, checks and decodes the contents of a single save file
+json readSaveFile (const stdfs::path &file) {
+  return savefile::Reader(file).all();
+}
+
+bool isDelta (const json &j) {
+  return j.find("keyframe") != j.end();
+}
+
+/// Brings \p j (and the plants index \p plants) up to date with \p delta
+void applyDelta (json &j, std::map<Plant::ID, json> &plants,
+                 const json &delta) {
+  using GID = Plant::ID;
+
+  j["config"] = delta["config"];
+  j["nextID"] = delta["nextID"];
+  for (SimuFields f: { SimuFields::ENV, SimuFields::PTREE })
+    j[field(f)] = j[field(f)].patch(delta[field(f)]);
+
+  const json &jplants = delta[field(SimuFields::PLANTS)];
+  for (const json &jgid: jplants["removed"])
+    plants.erase(jgid.get<GID>());
+
+  for (const json &jp: jplants["full"])
+    plants[jp[0].get<GID>()] = jp[1];
+
+  for (const json &jp: jplants["state"])
+    Plant::applyState(plants.at(jp[0].get<GID>()), jp[1]);
+}
+
+json Simulation::loadJson (const stdfs::path &file) {
+  json j = readSaveFile(file);
+  if (!isDelta(j))  return j;
+
+  // Walk back to the keyframe
+  std::vector<json> deltas;
+  const stdfs::path folder = file.parent_path();
+  while (isDelta(j)) {
+    stdfs::path previous = folder / j["previous"].get<std::string>();
+    deltas.push_back(std::move(j));
+    j = readSaveFile(previous);
+  }
+
+  auto startTime = clock::now();
+
+  std::map<GID, json> plants;
+  for (json &jp: j[field(SimuFields::PLANTS)])
+    plants[jp[0].get<Plant::Genome>().id()] = std::move(jp);
+
+  for (auto it = deltas.rbegin(); it != deltas.rend(); ++it)
+    applyDelta(j, plants, *it);
+
+  // Same (x) order as a regular save
+  std::vector<json> sorted;
+  sorted.reserve(plants.size());
+  for (auto &p: plants) sorted.push_back(std::move(p.second));
+  std::sort(sorted.begin(), sorted.end(), [] (const json &lhs, const json &rhs) {
+    return lhs[1][0].get<float>() < rhs[1][0].get<float>();
+  });
+  j[field(SimuFields::PLANTS)] = sorted;
+
+  if (debugSerialization)
+    std::cerr << "Rebuilt " << file << " from " << deltas.size()
+              << " delta(s) in " << duration(startTime) << " ms" << std::endl;
+
+  return j;
+}
+
 std::ostream& operator<< (std::ostream &os, const Simulation::LoadHelp&) {
   return os << "Not implemented yet\n";
 }
 
+void Simulation::loadConfig (const json &j, const std::string &constraints) {
+  auto dependencies = config::Dependencies::saveState();
+  config::Simulation::deserialize(j);
+  if (!config::Dependencies::compareStates(dependencies, constraints))
+    utils::doThrow<std::invalid_argument>(
+      "Provided save has different build parameters than this one.\n"
+      "See above for more details... (aborting)");
+}
+
+void Simulation::forEachGenome (const stdfs::path &file,
+                                const std::string &constraints,
+                                const std::function<void(const Plant::Genome&)> &f) {
+  if (snapshot::isSnapshot(file)) {
+    snapshot::Reader r (file);
+    loadConfig(r.json(snapshot::Section::CONFIG), constraints);
+    for (const snapshot::PlantRecord &p: r.plants())
+      f(r.genome(p.genome).get<Plant::Genome>());
+    return;
+  }
+
+  savefile::Reader r (file);
+  if (r.isDelta()) {  // Needs its whole history
+    json j = loadJson(file);
+    loadConfig(j["config"], constraints);
+    for (const json &jp: j[field(SimuFields::PLANTS)])
+      f(jp[0].get<Plant::Genome>());
+    return;
+  }
+
+  loadConfig(r.field("config"), constraints);
+  for (size_t i=0; i<r.plants(); i++)
+    f(r.plantGenome(i).get<Plant::Genome>());
+}
+
 void Simulation::load (const stdfs::path &file, Simulation &s,
                        const std::string &constraints,
                        const std::string &fields) {
 
+  checkStripsSchedule();
+
   std::set<std::string> requestedFields;  // Default to all
   for (auto f: EnumUtils<SimuFields>::iterator())
     requestedFields.insert(field(f));
@@ -1245,64 +1690,54 @@ void Simulation::load (const stdfs::path &file, Simulation &s,
 //              << std::endl;
 
   s._start = clock::now();
-  auto startTime = clock::now();
-
-  std::vector<uint8_t> v;
-  simu::load(file, v);
-
-  CRC crcGenerator;
-  auto crcStored = extractCRC(v);
-  auto crcRecomputed = crcGenerator(v.begin(), v.end());
-  if (crcStored != crcRecomputed)
-    utils::doThrow<std::invalid_argument>(
-      "CRC Check failed: ", std::hex, crcStored, " != ", crcRecomputed);
-
-  std::cout << "Expanding " << file << "...\r" << std::flush;
 
+  // Native snapshots are mapped in memory and decoded section by section.
+  // Indexed saves are also decoded field by field, except for incremental
+  // ones which need their whole history
+  std::unique_ptr<snapshot::Reader> snap;
+  std::unique_ptr<savefile::Reader> reader;
   json j;
-  const auto ext = file.extension();
-  if (ext == ".cbor")         j = json::from_cbor(v);
-  else if (ext == ".msgpack") j = json::from_msgpack(v);
-  else if (ext == ".ubjson")  j = json::from_ubjson(v);
-  else
-    utils::doThrow<std::invalid_argument>(
-      "Unkown save file type '", file, "' of extension '", ext, "'");
-
-  if (debugSerialization)
-    std::cerr << "Loading " << file << " (" << v.size() << " bytes) took "
-              << duration(startTime) << " ms" << std::endl;
-
-  startTime = clock::now();
-
-  // Cannot work if containing ANY nan
-//  assert(j_from_cbor == j_from_msgpack);
-//  assert(j_from_cbor == j_from_ubjson);
-//  assert(j_from_msgpack == j_from_ubjson);
+  if (snapshot::isSnapshot(file))
+    snap = std::make_unique<snapshot::Reader>(file);
+  else {
+    reader = std::make_unique<savefile::Reader>(file);
+    if (reader->isDelta()) {
+      reader.reset();
+      j = loadJson(file);
+    }
+  }
+  const auto jfield = [&reader, &j] (const std::string &name) {
+    return reader ? reader->field(name) : std::move(j[name]);
+  };
+  auto startTime = clock::now();
 
   std::cout << "Deserializing " << file << "...\r" << std::flush;
 
-  auto dependencies = config::Dependencies::saveState();
-  config::Simulation::deserialize(j["config"]);
-  if (!config::Dependencies::compareStates(dependencies, constraints))
-    utils::doThrow<std::invalid_argument>(
-      "Provided save has different build parameters than this one.\n"
-      "See above for more details... (aborting)");
+  loadConfig(snap ? snap->json(snapshot::Section::CONFIG) : jfield("config"),
+             constraints);
 
   auto loadf = [&requestedFields] (SimuFields f) {
     return requestedFields.find(field(f)) != requestedFields.end();
   };
 
   bool loadEnv = loadf(SimuFields::ENV);
-  if (loadEnv)  Environment::load(j[field(SimuFields::ENV)], s._env);
-
   bool loadTree = loadf(SimuFields::PTREE);
-  if (loadTree) PTree::fromJson(j[field(SimuFields::PTREE)], s._ptree);
-
   bool loadPlants = loadf(SimuFields::PLANTS);
-  if (loadPlants)
-    s.deserializePopulation(j[field(SimuFields::PLANTS)], loadTree);
 
-  s._gidManager.setNext(j["nextID"]);
+  if (snap) {
+    if (loadEnv)  Environment::load(*snap, s._env);
+    if (loadTree)
+      PTree::fromJson(snap->json(snapshot::Section::PTREE), s._ptree);
+    if (loadPlants) s.deserializePopulation(*snap, loadTree);
+    s._gidManager.setNext(GID(snap->meta().nextID));
+
+  } else {
+    if (loadEnv)  Environment::load(jfield(field(SimuFields::ENV)), s._env);
+    if (loadTree) PTree::fromJson(jfield(field(SimuFields::PTREE)), s._ptree);
+    if (loadPlants)
+      s.deserializePopulation(jfield(field(SimuFields::PLANTS)), loadTree);
+    s._gidManager.setNext(jfield("nextID"));
+  }
   s._ptreeActive = loadTree;
 
   if (debugSerialization)
@@ -6,7 +6,10 @@
 #include "../config/simuconfig.h"
 
 #include "environment.h"
-#include "plant.h"
+#include "population.h"
+#include "checkpointer.h"
+#include "voxellog.h"
+#include "profiler.h"
 
 DEFINE_PRETTY_ENUMERATION(SimuFields, ENV, PLANTS, PTREE)
 
@@ -120,13 +123,53 @@ public:
     return folder / oss.str();
   }
 
+  /// Name of the incremental save (see config::saveKeyframeEvery)
+  static stdfs::path periodicDeltaName(const stdfs::path &folder, uint year) {
+    std::ostringstream oss;
+    oss << "y" << year;
+    oss << ".delta";
+    return folder / oss.str();
+  }
+
   nlohmann::json serializePopulation (void) const;
   void deserializePopulation (const nlohmann::json &j, bool updatePTree);
+  void deserializePopulation (const snapshot::Reader &r, bool updatePTree);
 
+  /// \returns a self-contained snapshot of the whole simulation
+  nlohmann::json serialize (void) const;
+
+  /// Fills \p w with a self-contained snapshot of the whole simulation
+  void serialize (snapshot::Writer &w) const;
+
+  /// Synchronously saves the current state into \p file
+  /// \note Files with the snapshot::extension use the native binary format
   void save (stdfs::path file) const;
+
+  /// Saves the current state under periodicSaveName(). The actual encoding and
+  /// writing is delegated to a background thread (see config::asyncSaves)
+  /// \note Between keyframes only differences with the previous periodic save
+  /// are stored (see config::saveKeyframeEvery)
+  /// \note Native binary snapshots are used if config::binarySaves is set
+  /// (always as keyframes)
+  void periodicSave (void);
+
+  /// Blocks until all pending periodic saves are on disk
+  void flushSaves (void);
   static void load (const stdfs::path &file, Simulation &s,
                     const std::string &constraints, const std::string &fields);
 
+  /// Reads (and checks) the contents of \p file. Delta saves are expanded
+  /// from their keyframe so that the result is always a complete snapshot
+  static nlohmann::json loadJson (const stdfs::path &file);
+
+  /// Calls \p f on the genome of every plant stored in \p file, in population
+  /// order, without building the plants themselves
+  /// \note Only the configuration and the genomes are decoded (except for
+  /// incremental saves which are fully expanded)
+  static void forEachGenome (const stdfs::path &file,
+                             const std::string &constraints,
+                             const std::function<void(const Plant::Genome&)> &f);
+
   struct LoadHelp {
     friend std::ostream& operator<< (std::ostream &os, const LoadHelp&);
   };
@@ -148,18 +191,14 @@ protected:
     uint newPlants = 0;
     uint deadPlants = 0;
 
-    uint minGeneration = std::numeric_limits<decltype(minGeneration)>::max();
-    uint maxGeneration = 0;
-
   } _stats;
 
   Environment _env;
 
   phylogeny::GIDManager _gidManager;
 
-  using Plant_ptr = std::unique_ptr<Plant>;
-  using Plants = std::map<float, Plant_ptr>;
-  Plants _plants;
+  using Plant_ptr = Population::Plant_ptr;
+  Population _plants;
 
   PTree _ptree;
   bool _ptreeActive;
@@ -167,10 +206,31 @@ protected:
   clock::time_point _start;
   bool _aborted;
 
+  std::unique_ptr<Checkpointer> _checkpointer;
+
+  /// Bookkeeping for incremental periodic saves
+  struct DeltaSaves {
+    uint deltas = 0;  ///< Number of deltas since the last keyframe
+    stdfs::path keyframe, previous; ///< Last keyframe and periodic saves
+    std::set<GID> plants; ///< Plants present in the previous periodic save
+  } _deltaSaves;
+
+  nlohmann::json serializeDelta (void);
+
+  /// Deserializes the configuration and checks its dependencies against
+  /// \p constraints
+  static void loadConfig (const nlohmann::json &j,
+                          const std::string &constraints);
+
+  /// Inserts a freshly loaded plant in the population
+  void registerLoadedPlant (Plant *p, bool updatePTree);
+
   stdfs::path _dataFolder;
   std::ofstream _statsFile;
   std::array<std::ofstream,
              EnumUtils<genotype::cgp::Outputs>::size()> _envFiles;
+  std::unique_ptr<voxellog::Writer> _voxelLog;  ///< See config::binaryVoxelLogs
+  std::unique_ptr<profiler::Profiler> _profiler; ///< See config::profileEvery
 
   virtual Plant* addPlant(const PGenome &g, float x, float biomass);
   virtual void delPlant (Plant &p, Plant::Seeds &seeds);
@@ -180,6 +240,26 @@ protected:
   /// \note Traversal order is randomized
   void postInsertionCleanup (std::vector<Plant*> newborns);
 
+  /// Steps every plant according to the strips schedule (see
+  /// config::parallelStep and config::counterRNG)
+  ///
+  /// The world is split into x-strips of config::stepStripWidth. Plants whose
+  /// bounding box lies inside a single strip are stepped in two phases (even
+  /// strips, then odd ones), concurrently with config::parallelStep, so that
+  /// two plants stepped at the same time are at least a strip apart. Remaining
+  /// plants are stepped serially afterwards. The order inside each strip is
+  /// drawn from a dedicated dice seeded from the environment's or, with
+  /// config::counterRNG, from each plant's (GID, step) stream. Either way the
+  /// schedule does not depend on the number of threads.
+  ///
+  /// With config::counterRNG, the serial step also follows this schedule so
+  /// that serial and parallel runs are bit-identical. Runs with a different
+  /// config::stepStripWidth are not.
+  ///
+  /// \note Assumes that a plant cannot grow by more than half a strip in a
+  /// single step. Checked after the concurrent phases (throws otherwise)
+  void stripPlantsStep (std::set<Plant*> &corpses);
+
   virtual void performReproductions (void);
   virtual void plantSeeds (const Plant::Seeds &seeds);
   virtual void newSeed (const Plant */*mother*/, const Plant */*father*/,
@@ -188,8 +268,6 @@ protected:
 
   virtual void updatePlantAltitude (Plant &p, float h);
 
-  void updateGenStats (void);
-
   void logToFiles (void);
   void logGlobalStats (void);
   void logEnvState (void);
@@ -205,8 +283,12 @@ protected:
     swap(lhs._ptree, rhs._ptree);
     swap(lhs._start, rhs._start);
     swap(lhs._aborted, rhs._aborted);
+    swap(lhs._checkpointer, rhs._checkpointer);
+    swap(lhs._deltaSaves, rhs._deltaSaves);
     swap(lhs._dataFolder, rhs._dataFolder);
     swap(lhs._statsFile, rhs._statsFile);
+    swap(lhs._voxelLog, rhs._voxelLog);
+    swap(lhs._profiler, rhs._profiler);
   }
 };
 
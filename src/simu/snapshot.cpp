@@ -0,0 +1,230 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "snapshot.h"
+
+namespace simu {
+namespace snapshot {
+
+static constexpr bool debugSnapshot = false;
+
+static_assert(std::is_trivially_copyable<PlantRecord>::value
+              && std::is_trivially_copyable<OrganRecord>::value
+              && std::is_trivially_copyable<FruitRecord>::value,
+              "Snapshot records must be trivially copyable");
+
+uint32_t crc32 (const uint8_t *data, size_t size) {
+  static const auto table = [] {
+    std::array<uint32_t, 256> t;
+    for (uint32_t i=0; i<256; i++) {
+      uint32_t c = i;
+      for (uint k=0; k<8; k++)  c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i=0; i<size; i++)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
+bool isSnapshot (const stdfs::path &file) {
+  return file.extension() == extension;
+}
+
+// =============================================================================
+// Writer
+
+Writer::Writer (void) : meta{}, _genomeOffsets{0} {}
+
+void Writer::addJson (Section s, const nlohmann::json &j) {
+  _blobs[s] = nlohmann::json::to_ubjson(j);
+}
+
+uint32_t Writer::addGenome (const nlohmann::json &g) {
+  auto bytes = nlohmann::json::to_ubjson(g);
+  _genomes.insert(_genomes.end(), bytes.begin(), bytes.end());
+  _genomeOffsets.push_back(_genomes.size());
+  return genomes() - 1;
+}
+
+void Writer::write (const stdfs::path &file) const {
+  struct Chunk {
+    Section type;
+    const uint8_t *data;
+    uint64_t size, count;
+  };
+  std::vector<Chunk> chunks;
+
+  const auto addChunk = [&chunks] (Section s, const auto &v) {
+    using T = typename std::decay_t<decltype(v)>::value_type;
+    chunks.push_back({s, reinterpret_cast<const uint8_t*>(v.data()),
+                      v.size() * sizeof(T), v.size()});
+  };
+
+  chunks.push_back({Section::META, reinterpret_cast<const uint8_t*>(&meta),
+                    sizeof(Meta), 1});
+  for (const auto &p: _blobs) addChunk(p.first, p.second);
+  addChunk(Section::VOXELS, voxels);
+  addChunk(Section::GENOMES, _genomes);
+  addChunk(Section::GENOME_OFFSETS, _genomeOffsets);
+  addChunk(Section::PLANTS, plants);
+  addChunk(Section::ORGANS, organs);
+  addChunk(Section::FRUITS, fruits);
+
+  const auto align = [] (uint64_t offset) {
+    static constexpr auto A = Header::alignment;
+    return (offset + A - 1) / A * A;
+  };
+
+  Header header {};
+  std::memcpy(header.magic, Header::magicValue, sizeof(header.magic));
+  header.version = Header::currentVersion;
+  header.byteOrder = Header::byteOrderMark;
+  header.sections = chunks.size();
+
+  std::vector<SectionEntry> table (chunks.size());
+  uint64_t offset = align(sizeof(Header) + table.size() * sizeof(SectionEntry));
+  for (uint i=0; i<chunks.size(); i++) {
+    const Chunk &c = chunks[i];
+    SectionEntry &e = table[i];
+    e.type = uint32_t(c.type);
+    e.crc = crc32(c.data, c.size);
+    e.offset = offset;
+    e.size = c.size;
+    e.count = c.count;
+    offset = align(offset + c.size);
+  }
+
+  std::ofstream ofs (file, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!ofs)
+    utils::doThrow<std::invalid_argument>(
+          "Unable to open '", file, "' for writing");
+
+  static const std::array<char, Header::alignment> zeros {};
+  const auto pad = [&ofs] {
+    auto p = uint64_t(ofs.tellp());
+    ofs.write(zeros.data(), (Header::alignment - p % Header::alignment)
+                                % Header::alignment);
+  };
+
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  ofs.write(reinterpret_cast<const char*>(table.data()),
+            table.size() * sizeof(SectionEntry));
+  for (const Chunk &c: chunks) {
+    pad();
+    assert(uint64_t(ofs.tellp()) == table[&c - chunks.data()].offset);
+    ofs.write(reinterpret_cast<const char*>(c.data), c.size);
+  }
+  ofs.close();
+
+  if (debugSnapshot)
+    std::cerr << "Wrote " << chunks.size() << " sections (" << offset
+              << " bytes) into " << file << std::endl;
+}
+
+// =============================================================================
+// Reader
+
+Reader::Reader (const stdfs::path &file)
+  : _file(file), _fd(-1), _data(nullptr), _size(0) {
+
+  _fd = open(file.c_str(), O_RDONLY);
+  if (_fd < 0)
+    utils::doThrow<std::invalid_argument>(
+          "Unable to open '", file, "' for reading");
+
+  struct stat st;
+  if (fstat(_fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+    close(_fd);
+    utils::doThrow<std::invalid_argument>(file, " is not a snapshot");
+  }
+  _size = st.st_size;
+
+  void *ptr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+  if (ptr == MAP_FAILED) {
+    close(_fd);
+    utils::doThrow<std::invalid_argument>("Unable to map ", file);
+  }
+  _data = static_cast<const uint8_t*>(ptr);
+
+  const Header &h = *reinterpret_cast<const Header*>(_data);
+  std::string error;
+  if (std::memcmp(h.magic, Header::magicValue, sizeof(h.magic)) != 0)
+    error = "invalid magic number";
+  else if (h.version != Header::currentVersion)
+    error = "unsupported version " + std::to_string(h.version);
+  else if (h.byteOrder != Header::byteOrderMark)
+    error = "incompatible byte order";
+  else if (sizeof(Header) + h.sections * sizeof(SectionEntry) > _size)
+    error = "truncated section table";
+
+  const SectionEntry *table =
+    reinterpret_cast<const SectionEntry*>(_data + sizeof(Header));
+  for (uint i=0; i<h.sections && error.empty(); i++) {
+    const SectionEntry &e = table[i];
+    if (e.offset + e.size > _size)
+      error = "truncated section " + std::to_string(e.type);
+    else
+      _sections[Section(e.type)] = e;
+  }
+
+  if (!error.empty()) {
+    munmap(const_cast<uint8_t*>(_data), _size);
+    close(_fd);
+    utils::doThrow<std::invalid_argument>("Corrupted snapshot ", file, ": ",
+                                          error);
+  }
+}
+
+Reader::~Reader (void) {
+  munmap(const_cast<uint8_t*>(_data), _size);
+  close(_fd);
+}
+
+bool Reader::has (Section s) const {
+  return _sections.find(s) != _sections.end();
+}
+
+const SectionEntry& Reader::entry (Section s) const {
+  auto it = _sections.find(s);
+  if (it == _sections.end())
+    utils::doThrow<std::invalid_argument>(
+      "No section ", s, " in snapshot ", _file);
+
+  // Sections are only checked when first accessed
+  const SectionEntry &e = it->second;
+  if (_checked.find(s) == _checked.end()) {
+    if (crc32(bytes(e), e.size) != e.crc)
+      utils::doThrow<std::invalid_argument>(
+        "Corrupted snapshot ", _file, ": CRC check failed for section ", s);
+    _checked.insert(s);
+  }
+
+  return e;
+}
+
+nlohmann::json Reader::json (Section s) const {
+  auto r = records<uint8_t>(s);
+  return nlohmann::json::from_ubjson(r.begin(), r.end());
+}
+
+nlohmann::json Reader::genome (uint32_t i) const {
+  auto offsets = records<uint64_t>(Section::GENOME_OFFSETS);
+  if (i+1 >= offsets.size())
+    utils::doThrow<std::out_of_range>(
+      "Genome ", i, " out of range in snapshot ", _file);
+
+  auto g = records<uint8_t>(Section::GENOMES);
+  return nlohmann::json::from_ubjson(g.begin() + offsets[i],
+                                     g.begin() + offsets[i+1]);
+}
+
+} // end of namespace snapshot
+} // end of namespace simu
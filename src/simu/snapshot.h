@@ -0,0 +1,206 @@
+#ifndef SIMU_SNAPSHOT_H
+#define SIMU_SNAPSHOT_H
+
+/// Native binary save format
+///
+/// A snapshot is made of a header, a section table and a set of sections,
+/// each aligned on \p Header::alignment bytes and protected by its own CRC
+/// (checked when the section is first accessed).
+/// Bulk data (plants, organs, fruits, voxels) is stored as flat arrays of
+/// trivially copyable records with index-based links so that a memory-mapped
+/// file can be used as is. Only small or externally defined structures
+/// (configuration, genomes, phylogeny, environment's metadata) are stored as
+/// ubjson blobs.
+
+#include "kgd/settings/configfile.h"
+
+DEFINE_PRETTY_ENUMERATION(SnapshotSection,
+                          META, CONFIG, ENVIRONMENT, VOXELS, GENOMES,
+                          GENOME_OFFSETS, PLANTS, ORGANS, FRUITS, PTREE)
+
+namespace simu {
+namespace snapshot {
+
+using Section = SnapshotSection;
+
+/// File extension of native snapshots
+static const stdfs::path extension = ".snap";
+
+struct Header {
+  static constexpr char magicValue[8] = { 'R','E','U','S','S','N','A','P' };
+  static constexpr uint32_t currentVersion = 1;
+  static constexpr uint32_t byteOrderMark = 0x01020304;
+  static constexpr uint32_t alignment = 16;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t sections;
+  uint32_t padding;
+};
+
+struct SectionEntry {
+  uint32_t type;    ///< SnapshotSection
+  uint32_t crc;     ///< CRC32 of the section's bytes
+  uint64_t offset;  ///< From the start of the file
+  uint64_t size;    ///< In bytes
+  uint64_t count;   ///< Number of records
+};
+
+struct Meta {
+  uint64_t nextID;  ///< Next genome identifier
+  uint32_t voxels;  ///< Values per voxel layer
+  uint32_t padding;
+};
+
+struct PlantRecord {
+  uint32_t genome;              ///< Index in the genomes section
+  uint32_t firstOrgan, organs;  ///< Range in the organs section
+  uint32_t firstFruit, fruits;  ///< Range in the fruits section
+  uint32_t age, derived, nextOrganID;
+  float pos[2];
+  uint32_t padding[2];
+  double reserves[2][2];        ///< [layer][element]
+};
+
+/// \note Organs of a plant are stored in depth-first order so that a parent
+/// always comes before its children
+struct OrganRecord {
+  uint32_t id;
+  int32_t parent;   ///< Index in the plant's range (-1 for bases)
+  float rotation;   ///< Relative to the parent
+  float width, length;
+  float surface, baseBiomass, accumulatedBiomass, requiredBiomass;
+  float origin[2], end[2], center[2], plantRotation;  ///< In plant coordinates
+  char symbol;
+  uint8_t layer;
+  uint8_t padding[2];
+};
+
+struct FruitRecord {
+  uint32_t organ;                 ///< Id of the fruit organ
+  uint32_t firstGenome, genomes;  ///< Range in the genomes section
+  uint32_t padding;
+};
+
+/// Read-only view on contiguous records
+template <typename T>
+struct Span {
+  const T *data;
+  size_t count;
+
+  const T* begin (void) const { return data;  }
+  const T* end (void) const {   return data + count;  }
+  size_t size (void) const {    return count; }
+  const T& operator[] (size_t i) const {  return data[i]; }
+};
+
+/// Accumulates the contents of a snapshot before writing it in one go
+class Writer {
+public:
+  Meta meta;
+  std::vector<PlantRecord> plants;
+  std::vector<OrganRecord> organs;
+  std::vector<FruitRecord> fruits;
+  std::vector<float> voxels;  ///< Layers stored contiguously (see Meta::voxels)
+
+  Writer (void);
+
+  /// Stores \p j (ubjson encoded) as section \p s
+  void addJson (Section s, const nlohmann::json &j);
+
+  /// Stores \p g (ubjson encoded) as a new genome
+  /// \returns its index in the genomes section
+  uint32_t addGenome (const nlohmann::json &g);
+
+  uint32_t genomes (void) const {
+    return _genomeOffsets.size() - 1;
+  }
+
+  /// Computes every section's CRC and writes the whole snapshot to \p file
+  void write (const stdfs::path &file) const;
+
+private:
+  std::map<Section, std::vector<uint8_t>> _blobs;
+  std::vector<uint8_t> _genomes;
+  std::vector<uint64_t> _genomeOffsets;
+};
+
+/// Memory-mapped view on a snapshot
+/// \note Not thread-safe (sections are lazily checked)
+class Reader {
+public:
+  Reader (const stdfs::path &file);
+  ~Reader (void);
+
+  Reader (const Reader&) = delete;
+  Reader& operator= (const Reader&) = delete;
+
+  const stdfs::path& file (void) const {
+    return _file;
+  }
+
+  bool has (Section s) const;
+
+  template <typename T>
+  Span<T> records (Section s) const {
+    const SectionEntry &e = entry(s);
+    if (e.count * sizeof(T) != e.size)
+      utils::doThrow<std::invalid_argument>(
+        "Section ", s, " of ", _file, " has an invalid size: ", e.size,
+        " != ", e.count, " x ", sizeof(T));
+    return Span<T>{ reinterpret_cast<const T*>(bytes(e)), e.count };
+  }
+
+  const Meta& meta (void) const {
+    return records<Meta>(Section::META)[0];
+  }
+
+  Span<PlantRecord> plants (void) const {
+    return records<PlantRecord>(Section::PLANTS);
+  }
+
+  Span<OrganRecord> organs (void) const {
+    return records<OrganRecord>(Section::ORGANS);
+  }
+
+  Span<FruitRecord> fruits (void) const {
+    return records<FruitRecord>(Section::FRUITS);
+  }
+
+  /// Voxel layers stored contiguously. Each contains meta().voxels values
+  Span<float> voxels (void) const {
+    return records<float>(Section::VOXELS);
+  }
+
+  /// Decodes the ubjson blob stored in section \p s
+  nlohmann::json json (Section s) const;
+
+  /// Decodes the \p i-th genome
+  nlohmann::json genome (uint32_t i) const;
+
+private:
+  stdfs::path _file;
+  int _fd;
+  const uint8_t *_data;
+  size_t _size;
+
+  std::map<Section, SectionEntry> _sections;
+  mutable std::set<Section> _checked;  ///< Sections whose CRC was verified
+
+  const SectionEntry& entry (Section s) const;
+  const uint8_t* bytes (const SectionEntry &e) const {
+    return _data + e.offset;
+  }
+};
+
+/// CRC32 (IEEE 802.3) of \p size bytes starting at \p data
+uint32_t crc32 (const uint8_t *data, size_t size);
+
+/// Whether \p file is to be handled as a native snapshot
+bool isSnapshot (const stdfs::path &file);
+
+} // end of namespace snapshot
+} // end of namespace simu
+
+#endif // SIMU_SNAPSHOT_H
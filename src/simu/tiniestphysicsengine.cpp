@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <stack>
+#include <tuple>
 
 #include "kgd/utils/indentingostream.h"
 
 #include "tiniestphysicsengine.h"
 #include "environment.h"
+#include "satkernel.h"
+#include "../config/simuconfig.h"
 
 /// FIXME Pistils yet again bugging out
 
@@ -17,6 +21,9 @@ static constexpr bool debugNarrowphase = false;
 static constexpr bool debugCollision = false || debugBroadphase || debugNarrowphase;
 static constexpr bool debugUpperLayer = false;
 static constexpr bool debugReproduction = false;
+static constexpr bool debugSATKernel = false;
+static constexpr bool debugCanopySweep = false;
+static constexpr bool debugContainment = false;
 
 static constexpr float floatPrecision = 1e6;
 bool fuzzyEqual (float lhs, float rhs) {
@@ -191,17 +198,13 @@ bool include_mine (const Plant *plant, const UpperLayer::Item &item) {
   return plant == item.organ->plant();
 }
 
-void doLineSweep (const Plant *plant,
-                  const std::set<canopy::XEvent> &xevents,
-                  UpperLayer::Items &items,
-                  include_f include) {
-
+/// Extracts the upper envelope of \p xevents, calling \p emit(item, right)
+/// for every finished segment
+template <typename F>
+void doLineSweep (const std::set<canopy::XEvent> &xevents, F &&emit) {
   canopy::SortedStack<Organ*> stack;
   UpperLayer::Item current;
 
-  if (debugUpperLayer)
-    std::cerr << PlantID(plant) << " Performing linesweep for upper layer" << std::endl;
-
   for (canopy::XEvent e: xevents) {
     if (debugUpperLayer)  std::cerr << "\t" << e << std::endl;
 
@@ -209,10 +212,7 @@ void doLineSweep (const Plant *plant,
     case IN:
       stack.push(e.organ, e.top());
       if (current.y < e.top()) {
-        if (current.organ && include(plant, current)) {
-          emplaceItem(items, current, e.left());
-          if (debugUpperLayer)  std::cerr << "\t\tEmplaced " << current << std::endl;
-        }
+        if (current.organ)  emit(current, e.left());
         resetItem(current, e.left(), e.top(), e.organ);
         if (debugUpperLayer)  std::cerr << "\t\tNew top " << current << std::endl;
       }
@@ -225,10 +225,7 @@ void doLineSweep (const Plant *plant,
       stack.erase(e.organ, e.top());
 
       if (inTop) {
-        if (include(plant, current)) {
-          emplaceItem(items, current, e.right());
-          if (debugUpperLayer)  std::cerr << "\t\tEmplaced " << current << std::endl;
-        }
+        emit(current, e.right());
 
         if (!stack.empty()) {
           Organ *newTop = stack.top();
@@ -245,6 +242,22 @@ void doLineSweep (const Plant *plant,
   assert(stack.empty());
 }
 
+void doLineSweep (const Plant *plant,
+                  const std::set<canopy::XEvent> &xevents,
+                  UpperLayer::Items &items,
+                  include_f include) {
+
+  if (debugUpperLayer)
+    std::cerr << PlantID(plant) << " Performing linesweep for upper layer" << std::endl;
+
+  doLineSweep(xevents, [plant, &items, include] (UpperLayer::Item &i,
+                                                 float right) {
+    if (!include(plant, i)) return;
+    emplaceItem(items, i, right);
+    if (debugUpperLayer)  std::cerr << "\t\tEmplaced " << i << std::endl;
+  });
+}
+
 } // end of namespace canopy
 
 void UpperLayer::updateInIsolation (const simu::Environment &env, const Plant *p) {
@@ -327,10 +340,52 @@ void freeContainer (std::set<T, C> &container) {
   }
 }
 
+void Counters::reset (void) {
+  for (Counter &c: collisionTests)  c = 0;
+  for (Counter &c: initialCollisionTests) c = 0;
+  broadphaseQueries = broadphaseCandidates = 0;
+  memoQueries = memoCandidates = 0;
+  narrowphaseSweeps = narrowphasePruned = 0;
+  narrowphaseEvents = narrowphaseEarlyOuts = 0;
+  satTests = satBatches = satSeparated = 0;
+  pistilQueries = pistilCandidates = 0;
+}
+
+uint Counters::index (CollisionResult r) {
+  return __builtin_ctz(r);
+}
+
+std::ostream& operator<< (std::ostream &os, const Counters::Header&) {
+  static constexpr const char* classes [] {
+    "Auto", "Branch", "Intra", "Inter", "None"
+  };
+  for (const char *c: classes)  os << " CT" << c;
+  for (const char *c: classes)  os << " ICT" << c;
+  return os << " BPQueries BPCandidates MQueries MCandidates"
+               " NPSweeps NPPruned NPEvents NPEarlyOuts"
+               " SATTests SATBatches SATSeparated"
+               " PQueries PCandidates";
+}
+
+std::ostream& operator<< (std::ostream &os, const Counters &c) {
+  for (const auto &n: c.collisionTests) os << " " << n;
+  for (const auto &n: c.initialCollisionTests)  os << " " << n;
+  return os << " " << c.broadphaseQueries << " " << c.broadphaseCandidates
+            << " " << c.memoQueries << " " << c.memoCandidates
+            << " " << c.narrowphaseSweeps << " " << c.narrowphasePruned
+            << " " << c.narrowphaseEvents << " " << c.narrowphaseEarlyOuts
+            << " " << c.satTests << " " << c.satBatches
+            << " " << c.satSeparated
+            << " " << c.pistilQueries << " " << c.pistilCandidates;
+}
+
 void TinyPhysicsEngine::reset(void) {
   freeContainer(_data);
   freeContainer(_leftEdges);
   freeContainer(_rightEdges);
+  _grid.reset();
+  _intervals.clear();
+  _unprocessed.clear();
   _pistils.clear();
 }
 
@@ -382,38 +437,58 @@ void noLongerEnglobes (CollisionObject *lhs, CollisionObject *rhs) {
 } // end of namespace broadphase
 
 void TinyPhysicsEngine::processNewObjects(void) {
-  // Linesweep to detect englobing plants (i-e completely containing another)
+  // Only pairs involving a new (or resized) object can start englobing one
+  // another: query the interval tree for those instead of sweeping everyone
   using namespace broadphase;
-  std::set<XEvent> xevents;
-  for (auto *obj: _data) {
-    xevents.insert(XEvent{obj->boundingRect.l(), IN, obj});
-    xevents.insert(XEvent{obj->boundingRect.r(), OUT, obj});
-//    obj->englobingObjects.clear();
-  }
+
+  // Same tie-breaking as the original linesweep (by address on equal left
+  // edges) so that identical intervals englobe only one way
+  const auto precedes = [] (const CollisionObject *lhs, float lhsL,
+                            const CollisionObject *rhs, float rhsL) {
+    return lhsL < rhsL || (lhsL == rhsL && lhs < rhs);
+  };
 
   if (debugBroadphase)
-    std::cerr << "Registering broadphase collision for newly created objects"
-              << std::endl;
+    std::cerr << "Registering broadphase collision for " << _unprocessed.size()
+              << " new/updated objects" << std::endl;
+
+  for (CollisionObject *obj: _unprocessed) {
+    const float l = obj->boundingRect.l(), r = obj->boundingRect.r();
+    _intervals.forEachContaining(l, r,
+                                 [&] (CollisionObject *that, float thatL, float) {
+      if (that != obj && precedes(that, thatL, obj, l)) englobes(that, obj);
+    });
+    _intervals.forEachContainedIn(l, r,
+                                  [&] (CollisionObject *that, float thatL, float) {
+      if (that != obj && precedes(obj, l, that, thatL)) englobes(obj, that);
+    });
+  }
+  _unprocessed.clear();
 
-  std::set<CollisionObject*> inside;
-  for (const XEvent &e: xevents) {
-    if (debugBroadphase)  std::cerr << "\t" << e << std::endl;
-    switch (e.type) {
-    case IN:
-      for (CollisionObject *lhs: inside)
-        if (includes(lhs, e.object))
-          englobes(lhs, e.object);
-      inside.insert(e.object);
-      break;
-    case OUT:
-      inside.erase(e.object);
-      break;
+  // Also merge this step's pistils modifications
+  _pistils.commit();
+
+  if (debugContainment) {
+    // Full linesweep: every detected inclusion must already be known
+    std::set<XEvent> xevents;
+    for (auto *obj: _data) {
+      xevents.insert(XEvent{obj->boundingRect.l(), IN, obj});
+      xevents.insert(XEvent{obj->boundingRect.r(), OUT, obj});
     }
-    if (debugBroadphase) {
-      std::cerr << "\t\tInside [";
-      for (CollisionObject *object: inside)
-        std::cerr << " " << object->plant->id();
-      std::cerr << " ]" << std::endl;
+
+    std::set<CollisionObject*> inside;
+    for (const XEvent &e: xevents) {
+      if (e.type == IN) {
+        for (CollisionObject *lhs: inside)
+          if (includes(lhs, e.object)
+              && lhs->englobedObjects.find(e.object)
+                  == lhs->englobedObjects.end())
+            utils::doThrow<std::logic_error>(
+              "Missed inclusion of ", PlantID(e.object->plant), " in ",
+              PlantID(lhs->plant));
+        inside.insert(e.object);
+      } else
+        inside.erase(e.object);
     }
   }
 }
@@ -427,83 +502,37 @@ void checkType (const Organ *o) {
 #pragma GCC push_options
 #pragma GCC optimize ("O0")
 void TinyPhysicsEngine::debug (void) const {
+  std::map<const Organ*, Disk> pistils;
+  _pistils.forEach([&pistils] (const Organ *o, const Disk &d) {
+    pistils.emplace(o, d);
+  });
+
 #if 1
   // Check that no pistil outlive its plant
-  for (const Pistil &ps: _pistils) {
-    checkType(ps.organ);
-    if (find(ps.organ->plant()) == _data.end())
+  for (const auto &pair: pistils) {
+    checkType(pair.first);
+    if (find(pair.first->plant()) == _data.end())
       utils::doThrow<std::logic_error>("Leftover pistil!");
   }
 #endif
 #if 1
   // Check that every pistil is correctly placed
-  for (const CollisionObject *co: _data) {
-    const Plant *p = co->plant;
-    for (const Pistil &ps: _pistils) {
-      if (ps.organ->plant() != p)  continue;
-
-      std::map<float, std::vector<Organ*>> pistils;
-      for (Organ *o: p->flowers())
-        pistils[int(o->globalCoordinates().center.x * floatPrecision) / floatPrecision].push_back(o);
-
-      for (auto &pair: pistils) {
-        bool found = false, matched = false;
-        for (Organ *o: pair.second) {
-          auto it = _pistils.find(o->globalCoordinates().center);
-          if (it != _pistils.end()) {
-            found = true;
-
-            if(it->organ == o) {
-              matched = true;
-              break;
-            }
-          }
-        }
-        if (!(found && matched)) {
-          std::cerr << "Something went wrong... (" << found << matched << ")\n";
-          std::cerr << "Here is the replay:\n";
-          found = false, matched = false;
-          uint i = 1;
-          for (Organ *o: pair.second) {
-            std::cerr << "Attempt " << i++ << " / " << pair.second.size() << "\n";
-            std::cerr << "\tLooking for " << OrganID(o) << " at "
-                      << o->globalCoordinates().center << "\n";
-            auto it = _pistils.find(o->globalCoordinates().center);
-            if (it != _pistils.end()) {
-              found = true;
-
-              std::cerr << "\t\tFound something: " << *it << "\n";
-
-              Disk bd = it->boundingDisk;
-              std::cerr << "\t\t" << bd.center << " ~= "
-                        << o->globalCoordinates().center << "? ";
-              if(it->organ == o) {
-                std::cerr << "Match!\n";
-                matched = true;
-                break;
-              } else
-                std::cerr << "Mismatch...\n";
-
-            } else
-              std::cerr << "\t\tNot found...\n";
-          }
-          std::cerr << "Here are the flowers contained in "
-                    << PlantID(p) << ":" << std::endl;
-          for (const Organ *o: p->flowers())
-            std::cerr << "\t" << OrganID(o, true) << "@"
-                      << o->globalCoordinates().center << "\n";
-          std::cerr << "Here are the pistils registered for "
-                    << PlantID(p) << ":" << std::endl;
-          for (const Pistil &ps: _pistils)
-            if (ps.organ->plant() == p)
-              std::cerr << "\t" << OrganID(ps.organ, true) << "@"
-                        << ps.boundingDisk.center << "\n";
-        }
-        if(!(found && matched))
-          utils::doThrow<std::logic_error>("Something went wrong...");
-      }
-    }
+  std::set<const Plant*> plants;
+  for (const auto &pair: pistils) {
+    const Organ *o = pair.first;
+    plants.insert(o->plant());
+    if (pair.second.center != o->globalCoordinates().center)
+      utils::doThrow<std::logic_error>(
+        "Pistil for ", OrganID(o), " registered at ", pair.second.center,
+        " instead of ", o->globalCoordinates().center);
   }
+
+  // and that no flower was forgotten
+  for (const Plant *p: plants)
+    for (const Organ *o: p->flowers())
+      if (pistils.find(o) == pistils.end())
+        utils::doThrow<std::logic_error>(
+          "Flower ", OrganID(o), " is not registered as a pistil");
 #endif
   std::cerr << __PRETTY_FUNCTION__
             << " No errors found in physics engine" << std::endl;
@@ -524,20 +553,25 @@ Collisions::const_iterator TinyPhysicsEngine::find (const Plant *p) const {
   return it;
 }
 
-const UpperLayer::Items& TinyPhysicsEngine::canopy(const Plant *p) const {
+UpperLayer::Items TinyPhysicsEngine::canopy(const Plant *p) const {
+  Lock lock (_mutex);
   return (*find(p))->layer.itemsInWorld;
 }
 
 bool TinyPhysicsEngine::addCollisionData (const Environment &env, Plant *p) {
   CollisionObject *object = new CollisionObject (env, p);
 
+  Lock lock (_mutex);
+  if (_data.empty())  selectBroadphase();
+
   auto res = _data.insert(object);
   if (res.second) {
     const auto &aabb = object->boundingRect;
     object->leftEdge->edge = aabb.l();
-    _leftEdges.insert(object->leftEdge.get());
     object->rightEdge->edge = aabb.r();
-    _rightEdges.insert(object->rightEdge.get());
+    insertEdges(object);
+    _intervals.insert(object, aabb.l(), aabb.r());
+    _unprocessed.insert(object);
 
     if (debugCollision)
       std::cerr << "Inserted collision data " << aabb << " for "
@@ -553,22 +587,24 @@ bool TinyPhysicsEngine::addCollisionData (const Environment &env, Plant *p) {
 }
 
 void TinyPhysicsEngine::removeCollisionData (Plant *p) {
+  Lock lock (_mutex);
   auto it = find(p);
   CollisionObject *object = *it;
 
   /// Update colliding objects canopies
   const_Collisions thisCollisions;
   broadphaseCollision(object, thisCollisions);
-  for (const CollisionObject *that: thisCollisions) {
-    const_Collisions thatCollisions;
-    broadphaseCollision(that, thatCollisions);
-    thatCollisions.erase(object);
-    that->layer.updateInWorld(that->plant, thatCollisions);
-  }
+  updateCanopies(thisCollisions, object);
 
   // Delete edges
-  _leftEdges.erase(object->leftEdge.get());
-  _rightEdges.erase(object->rightEdge.get());
+  if (_grid)
+    _grid->erase(object, object->leftEdge->edge, object->rightEdge->edge);
+  else {
+    _leftEdges.erase(object->leftEdge.get());
+    _rightEdges.erase(object->rightEdge.get());
+  }
+  _intervals.erase(object, object->boundingRect.l());
+  _unprocessed.erase(object);
 
   // Delete references in (potentially) englobed/englobing objects
   while (!object->englobedObjects.empty())
@@ -577,12 +613,7 @@ void TinyPhysicsEngine::removeCollisionData (Plant *p) {
     broadphase::noLongerEnglobes(*object->englobingObjects.begin(), object);
 
   // Also delete any remaining pistils
-  /// NOTE This stinks to high heavens: O(n) but with reasons...
-  for (auto itP = _pistils.begin(); itP != _pistils.end();) {
-    if (itP->organ->plant() == p)
-      itP = _pistils.erase(itP);
-    else  ++itP;
-  }
+  _pistils.erase(p);
 
 /// NOTE This is not working as expected... Why?
 //  for (const Organ *p: object->plant->flowers())  delPistil(p);
@@ -592,14 +623,17 @@ void TinyPhysicsEngine::removeCollisionData (Plant *p) {
 }
 
 void TinyPhysicsEngine::updateCollisions (Plant *p) {
+  Lock lock (_mutex);
   auto it = find(p);
   CollisionObject *object = *it;
   _data.erase(it);
   if (debugCollision) std::cerr << "\nUpdated collision data for " << p->id()
                                 << " from " << object->boundingRect;
+  const Rect old = object->boundingRect;
   object->updateCollisions();
   if (debugCollision) std::cerr << " to " << object->boundingRect << std::endl;
   it = _data.insert(object).first;
+  updateInterval(object, old);
 
   if (object->leftEdge->edge != object->boundingRect.l())
     updateEdge(object->leftEdge.get(), object->boundingRect.l());
@@ -608,12 +642,15 @@ void TinyPhysicsEngine::updateCollisions (Plant *p) {
 }
 
 void TinyPhysicsEngine::updateFinal (const Environment &env, Plant *p) {
+  Lock lock (_mutex);
   auto it = find(p);
   CollisionObject *object = *it;
   _data.erase(it);
 
+  const Rect old = object->boundingRect;
   object->updateFinal(env); // Update bounding box and canopy
   it = _data.insert(object).first;
+  updateInterval(object, old);
 
   const auto aabb = object->boundingRect;
   if (object->leftEdge->edge != aabb.l())  updateEdge(object->leftEdge.get(), aabb.l());
@@ -659,12 +696,85 @@ void TinyPhysicsEngine::updateFinal (const Environment &env, Plant *p) {
   // Update this' and neighbors' (world) canopies
   const_Collisions thisCollisions;
   broadphaseCollision(object, thisCollisions);
-  object->layer.updateInWorld(object->plant, thisCollisions);
+  thisCollisions.insert(object);
+  updateCanopies(thisCollisions);
+}
+
+void TinyPhysicsEngine::updateCanopies (const const_Collisions &objects,
+                                        const CollisionObject *removed) {
+  // Objects whose canopy is shaded by others (and the range they cover)
+  std::map<const Plant*, const CollisionObject*> targets;
+  Rect range = Rect::invalid();
+
+  // Objects whose items contribute to the envelope
+  const_Collisions sources;
+
+  for (const CollisionObject *object: objects) {
+    const_Collisions neighbors;
+    broadphaseCollision(object, neighbors);
+    if (removed)  neighbors.erase(removed);
 
-  for (const CollisionObject *neighbor: thisCollisions) {
-    const_Collisions thatCollisions;
-    broadphaseCollision(neighbor, thatCollisions);
-    neighbor->layer.updateInWorld(neighbor->plant, thatCollisions);
+    UpperLayer &layer = object->layer;
+    if (neighbors.empty()) {
+      layer.itemsInWorld = layer.itemsInIsolation;
+      continue;
+    }
+
+    layer.itemsInWorld.clear();
+    targets.emplace(object->plant, object);
+    range.uniteWith(object->boundingRect);
+    sources.insert(object);
+    sources.insert(neighbors.begin(), neighbors.end());
+  }
+
+  if (targets.empty())  return;
+
+  if (debugUpperLayer)
+    std::cerr << "Performing canopy linesweep for " << targets.size()
+              << " plant(s) over " << sources.size() << " plant(s)"
+              << std::endl;
+
+  // Items outside of the targets' range cannot shade them
+  std::set<canopy::XEvent> xevents;
+  for (const CollisionObject *object: sources) {
+    for (const UpperLayer::Item &i: object->layer.itemsInIsolation) {
+      if (i.r >= range.l() && range.r() >= i.l) {
+        xevents.emplace(IN, i);
+        xevents.emplace(OUT, i);
+      }
+    }
+  }
+
+  // The envelope is the same for all: dispatch its segments to their owners
+  canopy::doLineSweep(xevents, [&targets] (UpperLayer::Item &i, float right) {
+    auto it = targets.find(i.organ->plant());
+    if (it == targets.end())  return;
+    canopy::emplaceItem(it->second->layer.itemsInWorld, i, right);
+    if (debugUpperLayer)  std::cerr << "\t\tEmplaced " << i << std::endl;
+  });
+
+  if (debugCanopySweep) {
+    // Compare with the per-plant linesweep
+    for (const auto &p: targets) {
+      const CollisionObject *object = p.second;
+      const UpperLayer::Items items = object->layer.itemsInWorld;
+
+      const_Collisions neighbors;
+      broadphaseCollision(object, neighbors);
+      if (removed)  neighbors.erase(removed);
+      object->layer.updateInWorld(object->plant, neighbors);
+
+      const UpperLayer::Items &expected = object->layer.itemsInWorld;
+      bool same = (items.size() == expected.size());
+      for (uint i=0; same && i<items.size(); i++)
+        same = items[i].l == expected[i].l && items[i].r == expected[i].r
+            && items[i].y == expected[i].y
+            && items[i].organ == expected[i].organ;
+      if (!same)
+        utils::doThrow<std::logic_error>(
+          "Shared canopy linesweep differs from the per-plant version for ",
+          object->plant->id());
+    }
   }
 }
 
@@ -681,19 +791,29 @@ using const_Organs = Organ::const_Collection;
 template <EventDir D>
 struct Event {
   EventType type;
-  Organ const * const organ;
-  const int flag;
+  const Organ *organ;
+  int flag;
+  float key;  ///< Cached coordinate (see coordOf)
 
-  Event (EventType t, const Organ *o, int f = 0) : type(t), organ(o), flag(f) {}
+  Event (EventType t, const Organ *o, int f = 0)
+    : type(t), organ(o), flag(f), key(coordOf(t, o)) {}
 
-  auto coord (void) const;
+  static float coordOf (EventType t, const Organ *o);
+
+  float coord (void) const {
+    return key;
+  }
 
   friend bool operator< (const Event &lhs, const Event &rhs) {
-    if (lhs.coord() != rhs.coord()) return lhs.coord() < rhs.coord();
+    if (lhs.key != rhs.key) return lhs.key < rhs.key;
     // Do not care at this point just make them different
     return lhs.organ < rhs.organ;
   }
 
+  friend bool equivalent (const Event &lhs, const Event &rhs) {
+    return lhs.key == rhs.key && lhs.organ == rhs.organ;
+  }
+
   friend std::ostream& operator<< (std::ostream &os, const Event &e) {
     return os << (D == X ? "X" : "Y")
               << (e.type == IN ? "I" : "O" )
@@ -702,22 +822,44 @@ struct Event {
 };
 
 template <>
-auto Event<X>::coord (void) const {
-  const auto &aabb = organ->globalCoordinates().boundingRect;
-  return (type == IN) ? aabb.l() : aabb.r();
+float Event<X>::coordOf (EventType t, const Organ *o) {
+  const auto &aabb = o->globalCoordinates().boundingRect;
+  return (t == IN) ? aabb.l() : aabb.r();
 }
 
 template <>
-auto Event<Y>::coord (void) const {
-  const auto &aabb = organ->globalCoordinates().boundingRect;
-  return (type == IN) ? aabb.b() : aabb.t();
+float Event<Y>::coordOf (EventType t, const Organ *o) {
+  const auto &aabb = o->globalCoordinates().boundingRect;
+  return (t == IN) ? aabb.b() : aabb.t();
 }
 
 using XEvent = Event<X>;
 using YEvent = Event<Y>;
-template<typename E> using Events = std::set<E>;
-using XEvents = Events<XEvent>;
-using YEvents = Events<YEvent>;
+
+/// Events filled in by the functors (in any order)
+/// \see sortEvents
+using XEvents = std::vector<XEvent>;
+
+/// Sorted set of events on y, stored contiguously
+///
+/// \note Equivalent events (same organ and coordinate) are only stored once,
+/// as would a std::set
+struct YEvents {
+  std::vector<YEvent> events;
+
+  void insert (const YEvent &e) {
+    auto it = std::lower_bound(events.begin(), events.end(), e);
+    if (it == events.end() || !equivalent(*it, e)) events.insert(it, e);
+  }
+
+  void erase (const YEvent &e) {
+    auto it = std::lower_bound(events.begin(), events.end(), e);
+    if (it != events.end() && equivalent(*it, e)) events.erase(it);
+  }
+
+  auto begin (void) const { return events.begin(); }
+  auto end (void) const {   return events.end();   }
+};
 
 enum PreSAT {
   SKIP,   ///< No need to check for separating axis
@@ -726,16 +868,47 @@ enum PreSAT {
 };
 
 struct Item {
-  Organ const * const organ;
-  const int flag;
+  const Organ *organ;
+  int flag;
 
   Item (const YEvent yevent) : organ(yevent.organ), flag(yevent.flag) {}
 
-  friend bool operator< (const Item &lhs, const Item &rhs) {
-    return lhs.organ < rhs.organ;
+  friend bool operator== (const Item &lhs, const Item &rhs) {
+    return lhs.organ == rhs.organ;
   }
 };
 
+/// Organs currently crossed by the y sweep (unique organs, unordered)
+struct Items {
+  std::vector<Item> items;
+
+  void insert (const Item &i) {
+    if (std::find(items.begin(), items.end(), i) == items.end())
+      items.push_back(i);
+  }
+
+  void erase (const Item &i) {
+    auto it = std::find(items.begin(), items.end(), i);
+    if (it != items.end()) {
+      *it = items.back();
+      items.pop_back();
+    }
+  }
+
+  auto begin (void) const { return items.begin(); }
+  auto end (void) const {   return items.end();   }
+};
+
+/// Sorts \p xevents and removes duplicates (keeping the first inserted), as
+/// if they had been inserted in a std::set
+void sortEvents (XEvents &xevents) {
+  std::stable_sort(xevents.begin(), xevents.end());
+  xevents.erase(std::unique(xevents.begin(), xevents.end(),
+                            [] (const XEvent &lhs, const XEvent &rhs) {
+                  return equivalent(lhs, rhs);
+                }), xevents.end());
+}
+
 Point mainNormal (const Organ *o) {
   const Organ::GlobalCoordinates &coords = o->globalCoordinates();
   return {
@@ -744,8 +917,9 @@ Point mainNormal (const Organ *o) {
   };
 }
 
-float dotProduct (const Point &lhs, const Point &rhs) {
-  return lhs.x * rhs.x + lhs.y * rhs.y;
+sat::Box satBox (const Organ *o) {
+  const Organ::GlobalCoordinates &coords = o->globalCoordinates();
+  return { coords.corners, mainNormal(o), o->inPlantCoordinates().rotation };
 }
 
 /*!
@@ -758,6 +932,8 @@ float dotProduct (const Point &lhs, const Point &rhs) {
  * \param lhs Left hand side organ for the collision check
  * \param rhs Right hand side organ for the collision check
  * \return Whether or not a collision was detected
+ *
+ * \see sat::collides for the actual (reference) implementation
  */
 bool collisionSAT (const Organ *lhs, const Organ *rhs) {
   if (debugNarrowphase)
@@ -770,74 +946,141 @@ bool collisionSAT (const Organ *lhs, const Organ *rhs) {
   assert(intersects(lhs->globalCoordinates().boundingRect,
                     rhs->globalCoordinates().boundingRect));
 
-  // Compute normals
-  std::vector<Point> normals;
-  normals.push_back(mainNormal(lhs));
-  normals.push_back({-normals[0].y, normals[0].x});
-  if (lhs->inPlantCoordinates().rotation != rhs->inPlantCoordinates().rotation) {
-    normals.push_back(mainNormal(rhs));
-    normals.push_back({-normals[2].y, normals[2].x});
-  }
-
-  // Project onto normal
-  for (const Point &n: normals) {
-    const Organ::Corners &lhsCorners = lhs->globalCoordinates().corners,
-                         &rhsCorners = rhs->globalCoordinates().corners;
-
-    float min_proj_lhs = dotProduct(lhsCorners[0], n),
-          max_proj_lhs = min_proj_lhs,
-          min_proj_rhs = dotProduct(rhsCorners[0], n),
-          max_proj_rhs = min_proj_rhs;
-
-    // Comptude min & max projections
-    for (uint i=1; i<4; i++) {
-      float proj_lhs = dotProduct(lhsCorners[i], n);
-      if (proj_lhs < min_proj_lhs)  min_proj_lhs = proj_lhs;
-      if (max_proj_lhs < proj_lhs)  max_proj_lhs = proj_lhs;
-
-      float proj_rhs = dotProduct(rhsCorners[i], n);
-      if (proj_rhs < min_proj_rhs)  min_proj_rhs = proj_rhs;
-      if (max_proj_rhs < proj_rhs)  max_proj_rhs = proj_rhs;
-    }
+  bool collision = sat::collides(satBox(lhs), satBox(rhs));
+  if (debugNarrowphase)
+    std::cerr << "\t\t" << (collision ? "Found none" : "Found one")
+              << std::endl;
 
-    if (max_proj_lhs <= min_proj_rhs || max_proj_rhs <= min_proj_lhs) {
-      if (debugNarrowphase) std::cerr << "\t\tFound " << n << std::endl;
-      return false; // No collision
-    }
+  return collision;
+}
 
-    // Maybe collision: keep searching
+/// Organs to test against the same lhs, evaluated by blocks
+struct SATBatch {
+  const Organ *lhs;
+  sat::Box lhsBox;
+  sat::Batch batch;
+  std::array<const Organ*, sat::Batch::capacity> organs;
+
+  /// Activity since the start of the current sweep (see Tally)
+  uint64_t tests, batches, separated;
+
+  void reset (const Organ *o) {
+    lhs = o;
+    lhsBox = satBox(o);
+    batch.clear();
   }
 
-  if (debugNarrowphase) std::cerr << "\t\tFound none" << std::endl;
+  /// \returns whether a collision was detected (if the batch was full)
+  bool push (const Organ *rhs) {
+    assert(intersects(lhs->globalCoordinates().boundingRect,
+                      rhs->globalCoordinates().boundingRect));
+    organs[batch.size] = rhs;
+    batch.push(satBox(rhs));
+    return batch.full() && flush();
+  }
 
-  return true;  // No separating axis found: there must be a collision
-}
+  /// Tests pending candidates
+  /// \returns whether any collides with lhs
+  bool flush (void) {
+    if (batch.empty())  return false;
+    uint32_t mask = sat::collides(lhsBox, batch);
+    tests += batch.size;
+    batches++;
+    separated += batch.size - __builtin_popcount(mask);
+
+    if (debugSATKernel)
+      for (uint i=0; i<batch.size; i++)
+        if (bool(mask & (1u << i)) != collisionSAT(lhs, organs[i]))
+          utils::doThrow<std::logic_error>(
+            "SAT kernel (", sat::name(sat::selected()), ") disagrees with the"
+            " reference for ", OrganID(lhs), " and ", OrganID(organs[i]));
+
+    if (debugNarrowphase && mask)
+      std::cerr << "\t\tCollision in batch of " << batch.size << std::endl;
+
+    batch.clear();
+    return mask != 0;
+  }
+};
+
+/// Per-thread buffers reused across calls to avoid allocations
+struct Scratch {
+  XEvents xevents;
+  YEvents yevents;
+  Items inside;
+  SATBatch batch;
+
+  static Scratch& local (void) {
+    static thread_local Scratch scratch;
+    scratch.xevents.clear();
+    scratch.yevents.events.clear();
+    scratch.inside.items.clear();
+    return scratch;
+  }
+};
+
+/// Accumulates the activity of a sweep locally and publishes it to the
+/// (shared) counters when done
+struct Tally {
+  Counters &counters;
+  SATBatch &batch;
+  uint64_t events;
+  enum { COMPLETE, PRUNED, EARLY_OUT } end;
+
+  Tally (Counters &c, SATBatch &b)
+    : counters(c), batch(b), events(0), end(COMPLETE) {
+    batch.tests = batch.batches = batch.separated = 0;
+  }
+
+  ~Tally (void) {
+    static constexpr auto relaxed = std::memory_order_relaxed;
+    counters.narrowphaseSweeps.fetch_add(1, relaxed);
+    if (end == PRUNED)  counters.narrowphasePruned.fetch_add(1, relaxed);
+    if (end == EARLY_OUT) counters.narrowphaseEarlyOuts.fetch_add(1, relaxed);
+    counters.narrowphaseEvents.fetch_add(events, relaxed);
+    counters.satTests.fetch_add(batch.tests, relaxed);
+    counters.satBatches.fetch_add(batch.batches, relaxed);
+    counters.satSeparated.fetch_add(batch.separated, relaxed);
+  }
+};
 
 template <typename FUNCTOR>
-bool narrowPhaseCollision (FUNCTOR &functor) {
+bool narrowPhaseCollision (FUNCTOR &functor, Counters &counters) {
 
   // == Debug ==
   auto indent = utils::make_if<debugNarrowphase,
                                utils::IndentingOStreambuf>(std::cerr);
   // ===========
 
-  XEvents xevents;
-  if (!functor.prepare(xevents))  return false;
+  Scratch &scratch = Scratch::local();
+  Tally tally (counters, scratch.batch);
+
+  XEvents &xevents = scratch.xevents;
+  if (!functor.prepare(xevents)) {
+    tally.end = Tally::PRUNED;
+    return false;
+  }
+  sortEvents(xevents);
 
   // Linesweep to find lhs-rhs organ collision pair
-  std::set<Item> inside;
-  YEvents yevents;
+  Items &inside = scratch.inside;
+  YEvents &yevents = scratch.yevents;
+  SATBatch &batch = scratch.batch;
   for (const XEvent &xevent: xevents) {
-    std::initializer_list<YEvent> new_yevents {
-      Event<Y> (IN, xevent.organ, xevent.flag),
-      Event<Y> (OUT, xevent.organ, xevent.flag)
+    const YEvent new_yevents [] {
+      YEvent (IN, xevent.organ, xevent.flag),
+      YEvent (OUT, xevent.organ, xevent.flag)
     };
 
     if (debugNarrowphase) std::cerr << xevent << std::endl;
+    tally.events++;
     if (xevent.type == IN)
-          yevents.insert(new_yevents);
+          for (auto &e: new_yevents)  yevents.insert(e);
     else  for (auto &e: new_yevents)  yevents.erase(e);
-    if (!functor.processXEvent(xevent)) return false;
+    if (!functor.processXEvent(xevent)) {
+      if (&xevent != &xevents.back()) tally.end = Tally::EARLY_OUT;
+      return false;
+    }
 
     for (const YEvent &yevent: yevents) {
       // == Debug ==
@@ -847,7 +1090,10 @@ bool narrowPhaseCollision (FUNCTOR &functor) {
       // ===========
 
       if (yevent.type == IN) {
+        // Pairs requiring a separating axis test are evaluated by blocks
+        // (the outcome does not depend on the order of the tests)
         const Organ *lhs = yevent.organ;
+        batch.reset(lhs);
         for (const Item &i: inside) {
           // == Debug ==
           auto indent = utils::make_if<debugNarrowphase,
@@ -863,8 +1109,9 @@ bool narrowPhaseCollision (FUNCTOR &functor) {
           case TEST:  break;
           }
 
-          if (collisionSAT(lhs, i.organ)) return true;
+          if (batch.push(i.organ)) return true;
         }
+        if (batch.flush())  return true;
 
         inside.insert(Item(yevent));
 
@@ -909,8 +1156,8 @@ struct AutocollisionFunctor {
   bool prepare (XEvents &xevents) {
     for (const Organ *o: organs) {
       if (o->isNonTerminal()) continue;
-      xevents.emplace(IN, o);
-      xevents.emplace(OUT, o);
+      xevents.emplace_back(IN, o);
+      xevents.emplace_back(OUT, o);
     }
 
     return true;  // Good to go
@@ -938,19 +1185,23 @@ struct BranchcollisionFunctor {
     if (organs.empty()) return false;
 
     counts[0] = 0;
+    Rect bounds = Rect::invalid();
     for (const Organ *o: organs) {
       if (o->isNonTerminal()) continue;
-      xevents.emplace(IN, o, 1);
-      xevents.emplace(OUT, o, 1);
+      xevents.emplace_back(IN, o, 1);
+      xevents.emplace_back(OUT, o, 1);
+      bounds.uniteWith(o->globalCoordinates().boundingRect);
       counts[0]++;
     }
 
+    // Organs not touching the new ones cannot collide with them
     counts[1] = 0;
     for (Organ *o: branch.organs) {
       if (o->isNonTerminal()) continue;
+      if (!intersects(bounds, o->globalCoordinates().boundingRect))  continue;
       if (organs.find(o) == organs.end()) {
-        xevents.emplace(IN, o, 2);
-        xevents.emplace(OUT, o, 2);
+        xevents.emplace_back(IN, o, 2);
+        xevents.emplace_back(OUT, o, 2);
         counts[1]++;
       }
     }
@@ -981,39 +1232,41 @@ struct BranchcollisionFunctor {
 };
 
 struct IntracollisionFunctor {
-  const Branch &self, branch;
-  const Rect inter;
+  const Plant *plant;
+  const Organ *apex;
+  const Branch &branch;
 
   uint counts [2];
 
-  IntracollisionFunctor (const Branch &s, const Branch &b)
-    : self(s), branch(b), inter(intersection(s.bounds, b.bounds)), counts{0} {}
+  IntracollisionFunctor (const Plant *p, const Organ *a, const Branch &b)
+    : plant(p), apex(a), branch(b), counts{0} {}
 
   bool prepare (XEvents &xevents) {
-    // Collect organs at least touching the plant-plant intersection
+    // Collect organs of the plant (except the apex' subtree, which is being
+    // replaced by the branch) at least touching the branch
+    Rect bounds = Rect::invalid();
+    counts[1] = 0;
+    plant->terminalOrgansIn(branch.bounds, [&] (const Organ *o) {
+      if (o == apex || o->isUncommitted())  return;
+      xevents.emplace_back(IN, o, 2);
+      xevents.emplace_back(OUT, o, 2);
+      bounds.uniteWith(o->globalCoordinates().boundingRect);
+      counts[1]++;
+    });
+    if (!counts[1])  return false;
 
+    // Collect organs of the branch at least touching those
     counts[0] = 0;
     for (const Organ *o: branch.organs) {
       if (o->isNonTerminal()) continue;
-      if (intersects(inter, o->globalCoordinates().boundingRect)) {
-        xevents.emplace(IN, o, 1);
-        xevents.emplace(OUT, o, 1);
+      if (intersects(bounds, o->globalCoordinates().boundingRect)) {
+        xevents.emplace_back(IN, o, 1);
+        xevents.emplace_back(OUT, o, 1);
         counts[0]++;
       }
     }
     if (!counts[0])  return false;
 
-    counts[1] = 0;
-    for (const Organ *o: self.organs) {
-      if (o->isNonTerminal()) continue;
-      if (intersects(inter, o->globalCoordinates().boundingRect)) {
-        xevents.emplace(IN, o, 2);
-        xevents.emplace(OUT, o, 2);
-        counts[1]++;
-      }
-    }
-    if (!counts[1])  return false;
-
     return true;  // Good to go
   }
 
@@ -1055,22 +1308,19 @@ struct IntercollisionFunctor {
     for (const Organ *o: branch.organs) {
       if (o->isNonTerminal()) continue;
       if (intersects(intersection, o->globalCoordinates().boundingRect)) {
-        xevents.emplace(IN, o, 1);
-        xevents.emplace(OUT, o, 1);
+        xevents.emplace_back(IN, o, 1);
+        xevents.emplace_back(OUT, o, 1);
         counts[0]++;
       }
     }
     if (!counts[0])  return false;
 
     counts[1] = 0;
-    for (const Organ *o: other->organs()) {
-      if (o->isNonTerminal()) continue;
-      if (intersects(intersection, o->globalCoordinates().boundingRect)) {
-        xevents.emplace(IN, o, 2);
-        xevents.emplace(OUT, o, 2);
-        counts[1]++;
-      }
-    }
+    other->terminalOrgansIn(intersection, [&] (const Organ *o) {
+      xevents.emplace_back(IN, o, 2);
+      xevents.emplace_back(OUT, o, 2);
+      counts[1]++;
+    });
     if (!counts[1])  return false;
 
     return true;  // Good to go
@@ -1120,14 +1370,50 @@ TinyPhysicsEngine::getEdges<EdgeSide::RIGHT> (void) {
 
 template <EdgeSide S>
 void TinyPhysicsEngine::updateEdge (Edge<S> *edge, float val) {
-  auto &edges = getEdges<S>();
-  if (edge->edge != val) {
+  if (edge->edge == val)  return;
+
+  if (_grid) {
+    const CollisionObject *object = edge->object;
+    const float l = object->leftEdge->edge, r = object->rightEdge->edge;
+    edge->edge = val;
+    _grid->move(object, l, r,
+                object->leftEdge->edge, object->rightEdge->edge);
+
+  } else {
+    auto &edges = getEdges<S>();
     edges.erase(edge);
     edge->edge = val;
     edges.insert(edge);
   }
 }
 
+void TinyPhysicsEngine::selectBroadphase (void) {
+  assert(_data.empty());
+  if (config::Simulation::gridBroadphase())
+    _grid = std::make_unique<BroadphaseGrid>(
+              config::Simulation::broadphaseCellWidth());
+  else
+    _grid.reset();
+}
+
+void TinyPhysicsEngine::insertEdges (CollisionObject *object) {
+  if (_grid)
+    _grid->insert(object, object->leftEdge->edge, object->rightEdge->edge);
+  else {
+    _leftEdges.insert(object->leftEdge.get());
+    _rightEdges.insert(object->rightEdge.get());
+  }
+}
+
+void TinyPhysicsEngine::updateInterval (CollisionObject *object,
+                                        const Rect &old) {
+  const Rect &aabb = object->boundingRect;
+  if (old.l() == aabb.l() && old.r() == aabb.r()) return;
+  _intervals.erase(object, old.l());
+  _intervals.insert(object, aabb.l(), aabb.r());
+  _unprocessed.insert(object);
+}
+
 void TinyPhysicsEngine::broadphaseCollision(const CollisionObject *object,
                                             const_Collisions &objects,
                                             const Rect otherBounds) {
@@ -1136,6 +1422,35 @@ void TinyPhysicsEngine::broadphaseCollision(const CollisionObject *object,
   Rect unitedBounds = object->boundingRect;
   const float lEdge = object->leftEdge->edge,   // Keep backups
               rEdge = object->rightEdge->edge;  //
+
+  if (_grid) {
+    // Same selection as the edge scans below (ties included) without having
+    // to move the object's edges around
+    float L = lEdge, R = rEdge;
+    if (otherBounds.isValid()) {
+      unitedBounds.uniteWith(otherBounds);
+      L = std::min(L, unitedBounds.l());
+      R = std::max(R, unitedBounds.r());
+    }
+
+    _grid->forEach(L, R, [object, L, R, &objects] (const CollisionObject *that,
+                                                   float l, float r) {
+      if (that == object) return;
+      bool rightOf = L < r && (r < R || (r == R && that < object)),
+           leftOf = l < R && (L < l || (l == L && object < that));
+      if (rightOf || leftOf)  objects.insert(that);
+    });
+
+    if (debugBroadphase)
+      std::cerr << "\tGrid candidates in [" << L << ":" << R << "]: "
+                << objects.size() << std::endl;
+
+    objects.insert(object->englobingObjects.begin(),
+                   object->englobingObjects.end());
+    objects.erase(object);
+    return;
+  }
+
   if (otherBounds.isValid()) {
     unitedBounds.uniteWith(otherBounds);
     if (unitedBounds.l() < object->leftEdge->edge)
@@ -1197,13 +1512,22 @@ TinyPhysicsEngine::initialCollisionTest(const Plant *plant) {
   // ===========
 
   CollisionResult res = NO_COLLISION;
-  if (plant->isInSeedState()) return res;
+  if (plant->isInSeedState()) {
+    _counters.initialCollisionTests[Counters::index(res)]++;
+    return res;
+  }
 
   Rect bounds = plant->boundingRect();
 
-  CollisionObject *object = *find(plant);
+  CollisionObject *object;
   const_Collisions aabbCandidates;
-  broadphaseCollision(object, aabbCandidates, bounds);
+  {
+    Lock lock (_mutex);
+    object = *find(plant);
+    broadphaseCollision(object, aabbCandidates, bounds);
+  }
+  _counters.broadphaseQueries++;
+  _counters.broadphaseCandidates += aabbCandidates.size();
 
   if (debugCollision) {
     std::cerr << "Possible collisions for " << plant->id() << " ("
@@ -1222,13 +1546,15 @@ TinyPhysicsEngine::initialCollisionTest(const Plant *plant) {
     if (!i.isValid()) continue;
 
     narrowphase::IntercollisionFunctor iterFunctor (branch, that->plant, i);
-    if(narrowPhaseCollision(iterFunctor))
+    if(narrowPhaseCollision(iterFunctor, _counters))
       res = CollisionResult::INTER_COLLISION;
   }
 
   if (debugCollision) std::cerr << "Plant does not collide with other plants"
                                 << std::endl;
 
+  _counters.initialCollisionTests[Counters::index(res)]++;
+
 #ifdef DEBUG_COLLISIONS
   if (res != NO_COLLISION) {
     auto &v = collisionsDebugData[plant];
@@ -1252,8 +1578,8 @@ TinyPhysicsEngine::initialCollisionTest(const Plant *plant) {
 }
 
 CollisionResult
-TinyPhysicsEngine::collisionTest(const Plant *plant,
-                                 const Branch &self, const Branch &branch,
+TinyPhysicsEngine::collisionTest(const Plant *plant, const Organ *apex,
+                                 const Branch &branch,
                                  const Organ::Collection &newOrgans) {
 
   // == Debug ==
@@ -1268,7 +1594,7 @@ TinyPhysicsEngine::collisionTest(const Plant *plant,
   if (debugCollision) std::cerr << "Testing for rule validity" << std::endl;
 
   narrowphase::AutocollisionFunctor autoFunctor (newOrgans);
-  if (narrowPhaseCollision(autoFunctor))
+  if (narrowPhaseCollision(autoFunctor, _counters))
     res = CollisionResult::AUTO_COLLISION;
 
   if (debugCollision) std::cerr << "Rule is valid" << std::endl;
@@ -1280,7 +1606,7 @@ TinyPhysicsEngine::collisionTest(const Plant *plant,
                                   << std::endl;
 
     narrowphase::BranchcollisionFunctor branchFunctor (newOrgans, branch);
-    if (narrowPhaseCollision(branchFunctor))
+    if (narrowPhaseCollision(branchFunctor, _counters))
       res = CollisionResult::BRANCH_COLLISION;
 
     if (debugCollision) std::cerr << "Rule does not collide with branch"
@@ -1293,8 +1619,8 @@ TinyPhysicsEngine::collisionTest(const Plant *plant,
     if (debugCollision) std::cerr << "Testing for rule collision with plant"
                                   << std::endl;
 
-    narrowphase::IntracollisionFunctor intraFunctor (self, branch);
-    if (narrowPhaseCollision(intraFunctor))
+    narrowphase::IntracollisionFunctor intraFunctor (plant, apex, branch);
+    if (narrowPhaseCollision(intraFunctor, _counters))
       res = CollisionResult::INTRA_COLLISION;
 
     if (debugCollision) std::cerr << "Branch does not collide with plant"
@@ -1308,9 +1634,17 @@ TinyPhysicsEngine::collisionTest(const Plant *plant,
     if (!broadphase::includes(plant->boundingRect(), branch.bounds))
       otherBounds = branch.bounds;
 
-    CollisionObject *object = *find(plant);
+    // Only the broadphase touches shared data. The narrowphase reads plants
+    // that are not being modified concurrently
+    CollisionObject *object;
     const_Collisions aabbCandidates;
-    broadphaseCollision(object, aabbCandidates, otherBounds);
+    {
+      Lock lock (_mutex);
+      object = *find(plant);
+      broadphaseCollision(object, aabbCandidates, otherBounds);
+    }
+    _counters.broadphaseQueries++;
+    _counters.broadphaseCandidates += aabbCandidates.size();
 
     if (debugCollision) {
       std::cerr << "Possible collisions for " << plant->id() << " ("
@@ -1328,7 +1662,7 @@ TinyPhysicsEngine::collisionTest(const Plant *plant,
       if (!i.isValid()) continue;
 
       narrowphase::IntercollisionFunctor iterFunctor (branch, that->plant, i);
-      if(narrowPhaseCollision(iterFunctor))
+      if(narrowPhaseCollision(iterFunctor, _counters))
         res = CollisionResult::INTER_COLLISION;
     }
 
@@ -1336,6 +1670,8 @@ TinyPhysicsEngine::collisionTest(const Plant *plant,
                                   << std::endl;
   }
 
+  _counters.collisionTests[Counters::index(res)]++;
+
 #ifdef DEBUG_COLLISIONS
   if (res != NO_COLLISION) {
     auto &v = collisionsDebugData[plant];
@@ -1358,6 +1694,30 @@ TinyPhysicsEngine::collisionTest(const Plant *plant,
   return res;
 }
 
+void TinyPhysicsEngine::neighbourhood (const Plant *plant, const Rect &bounds,
+                                       Neighbourhood &n) {
+  // Same selection as the inter-plant part of collisionTest
+  Rect otherBounds = Rect::invalid();
+  if (!broadphase::includes(plant->boundingRect(), bounds))
+    otherBounds = bounds;
+
+  const_Collisions aabbCandidates;
+  {
+    Lock lock (_mutex);
+    broadphaseCollision(*find(plant), aabbCandidates, otherBounds);
+  }
+  _counters.memoQueries++;
+  _counters.memoCandidates += aabbCandidates.size();
+
+  n.clear();
+  for (const CollisionObject *that: aabbCandidates) {
+    if (that->plant->isInSeedState()) continue;
+    if (!intersection(that->boundingRect, bounds).isValid()) continue;
+    n.push_back({ uint64_t(that->plant->id()), that->plant->geometryEpoch(),
+                  that->boundingRect });
+  }
+}
+
 
 // =============================================================================
 
@@ -1381,96 +1741,43 @@ Disk boundingDiskFor (const Organ *o) {
 }
 
 void TinyPhysicsEngine::addPistil(Organ *p) {
-  if constexpr (debugReproduction) {
-    auto res = _pistils.emplace(p, boundingDiskFor(p));
-    assert(p->globalCoordinates().center == boundingDiskFor(p).center);
-    if (debugReproduction) {
-      if (res.second)
-        std::cerr << "Added " << *res.first << std::endl;
-      else
-        std::cerr << "Unable to insert pistil " << Pistil(p, boundingDiskFor(p))
-                  << " (equal to " << *res.first << ")" << std::endl;
-    }
-  } else
-    _pistils.emplace(p, boundingDiskFor(p));
+  Lock lock (_mutex);
+  _pistils.insert(p, boundingDiskFor(p));
+  if (debugReproduction)
+    std::cerr << "Added " << Pistil(p, boundingDiskFor(p)) << std::endl;
 }
 
 void TinyPhysicsEngine::delPistil(const Organ *p) {
-  auto it = _pistils.find(p->globalCoordinates().center);
-  if (it != _pistils.end() && it->organ == p) {
-    if (debugReproduction)  std::cerr << "Deleting " << *it << std::endl;
-
-    _pistils.erase(it);
-  } else {
-#if !defined(NDEBUG) && 1
-
-#endif
-    if (debugReproduction)  std::cerr << "Could not delete pistil for " << OrganID(p)
-                                      << " at " << p->globalCoordinates().center
-                                      << ": not found" << std::endl;
-  }
+  Lock lock (_mutex);
+  if (debugReproduction)  std::cerr << "Deleting pistil for " << OrganID(p)
+                                    << std::endl;
+  _pistils.erase(p);
 }
 
 void TinyPhysicsEngine::updatePistil (Organ *p, const Point &oldPos) {
   if (p->globalCoordinates().center == oldPos)
     return;
 
-  auto it = _pistils.find(oldPos);
-  if (it == _pistils.end()) {
-    if (debugReproduction)
-      std::cerr << "Could not find pistil for " << OrganID(p) << " at pos "
-                << oldPos << " thus ";
-    addPistil(p);
-
-  } else if (it->organ == p) {
-    Pistil s = *it;
-    _pistils.erase(it);
-
-    if (debugReproduction)
-      std::cerr << "Updating " << s;
-
-    s.boundingDisk = boundingDiskFor(p);
-
-    if (debugReproduction)
-      std::cerr << " >> " << s.boundingDisk << std::endl;
-
-    auto res = _pistils.insert(s);
-    if (!res.second && debugReproduction)
-      utils::doThrow<std::logic_error>(
-        "Cannot move pistil for ", OrganID(p), " to ",
-        p->globalCoordinates().center, ". Spot is already taken by ", *res.first);
-
-  } else if (debugReproduction)
-    utils::doThrow<std::logic_error>(
-      "Cannot access pistil ", OrganID(p), " for update at ",
-      p->globalCoordinates().center, ". Spot is already taken by ", *it);
+  Lock lock (_mutex);
+  if (debugReproduction)
+    std::cerr << "Updating pistil for " << OrganID(p) << ": " << oldPos
+              << " >> " << boundingDiskFor(p) << std::endl;
+  _pistils.insert(p, boundingDiskFor(p));
 }
 
-struct LowerBound {
-  Disk boundingDisk;
-
-  static bool leftOf (const Disk &lhs, const Disk &rhs) {
-    return fuzzyLower(lhs.center.x + lhs.radius, rhs.center.x - rhs.radius);
-  }
-
-  friend bool operator< (const LowerBound &lhs, const Pistil &rhs) {
-    return leftOf(lhs.boundingDisk, rhs.boundingDisk);
-  }
-
-  friend bool operator< (const Pistil &lhs, const LowerBound &rhs) {
-    return leftOf(lhs.boundingDisk, rhs.boundingDisk);
-  }
-};
-TinyPhysicsEngine::Pistils_range TinyPhysicsEngine::sporesInRange(Organ *s) {
-  Disk boundingDisk = boundingDiskFor(s);
-  auto itL = _pistils.lower_bound(LowerBound{boundingDisk});
-  if (itL == _pistils.end())  return { itL, itL };
-
-  auto itR = itL;
-  while (itR != _pistils.end() && intersects(itR->boundingDisk, boundingDisk))
-    itR = std::next(itR);
+void TinyPhysicsEngine::prepareSporesQueries (
+    const std::vector<Organ*> &stamens) {
+  std::vector<std::pair<const Organ*, Disk>> queries;
+  queries.reserve(stamens.size());
+  for (const Organ *s: stamens) queries.emplace_back(s, boundingDiskFor(s));
+  _pistils.prepare(queries);
+}
 
-  return { itL, itR };
+const std::vector<Pistil>& TinyPhysicsEngine::sporesInRange(Organ *s) {
+  _pistils.query(s, boundingDiskFor(s), _spores);
+  _counters.pistilQueries++;
+  _counters.pistilCandidates += _spores.size();
+  return _spores;
 }
 
 // =============================================================================
@@ -1478,11 +1785,7 @@ TinyPhysicsEngine::Pistils_range TinyPhysicsEngine::sporesInRange(Organ *s) {
 void TinyPhysicsEngine::postLoad(void) {
   processNewObjects();
 
-  for (CollisionObject *obj: _data) {
-    const_Collisions thisCollisions;
-    broadphaseCollision(obj, thisCollisions);
-    obj->layer.updateInWorld(obj->plant, thisCollisions);
-  }
+  updateCanopies(const_Collisions(_data.begin(), _data.end()));
 }
 
 /// FIXME Not sure (at all) that this works. Or is safe. Or anything
@@ -1525,6 +1828,7 @@ void TinyPhysicsEngine::clone (const TinyPhysicsEngine &e,
                                               std::map<const Organ*,
                                                        Organ*>> &olookups) {
   reset();
+  selectBroadphase();
 
   std::map<const CollisionObject*, CollisionObject*> colookup;
   for (const CollisionObject *that_obj: e._data) {
@@ -1543,12 +1847,17 @@ void TinyPhysicsEngine::clone (const TinyPhysicsEngine &e,
       updatedEnglobing.insert(colookup.at(englobing));
     co->englobedObjects = updatedEnglobed;
     co->englobingObjects = updatedEnglobing;
-    _leftEdges.insert(co->leftEdge.get());
-    _rightEdges.insert(co->rightEdge.get());
+    insertEdges(co);
+    _intervals.insert(co, co->boundingRect.l(), co->boundingRect.r());
   }
 
-  for (const Pistil &p: e._pistils)
-    _pistils.emplace(olookups.at(p.organ->plant()).at(p.organ), p.boundingDisk);
+  for (CollisionObject *co: e._unprocessed)
+    _unprocessed.insert(colookup.at(co));
+
+  e._pistils.forEach([this, &olookups] (const Organ *o, const Disk &d) {
+    _pistils.insert(olookups.at(o->plant()).at(o), d);
+  });
+  _pistils.commit();
 }
 
 // =============================================================================
@@ -1579,6 +1888,52 @@ void assertEqual(const Pistil &lhs, const Pistil &rhs, bool deepcopy) {
   assertEqual(lhs.boundingDisk, rhs.boundingDisk, deepcopy);
 }
 
+void assertEqual(const PistilIndex &lhs, const PistilIndex &rhs,
+                 bool deepcopy) {
+  // Compare contents (independently of pending modifications)
+  using Contents = std::map<PistilIndex::Tag, Pistil>;
+  const auto contents = [] (const PistilIndex &index) {
+    Contents c;
+    index.forEach([&c] (Organ *o, const Disk &d) {
+      c.emplace(PistilIndex::Tag(o->plant()->id(), o->id()), Pistil(o, d));
+    });
+    return c;
+  };
+
+  const Contents lhsC = contents(lhs), rhsC = contents(rhs);
+  utils::assertEqual(lhsC.size(), rhsC.size(), deepcopy);
+  for (auto lhsIt = lhsC.begin(), rhsIt = rhsC.begin();
+       lhsIt != lhsC.end(); ++lhsIt, ++rhsIt)
+    assertEqual(lhsIt->second, rhsIt->second, deepcopy);
+}
+
+void assertEqual (const BroadphaseGrid &lhs, const BroadphaseGrid &rhs,
+                  bool deepcopy) {
+  utils::assertEqual(lhs.cellWidth(), rhs.cellWidth(), deepcopy);
+
+  // Compare registrations (independently of the grids' extents and of the
+  // order inside the cells)
+  using Registration = std::tuple<int, Plant::ID, float, float>;
+  const auto contents = [] (const BroadphaseGrid &grid) {
+    std::vector<Registration> c;
+    grid.forEachEntry([&c] (int cell, const CollisionObject *o,
+                            float l, float r) {
+      c.emplace_back(cell, o->plant->id(), l, r);
+    });
+    std::sort(c.begin(), c.end());
+    return c;
+  };
+
+  const auto lhsC = contents(lhs), rhsC = contents(rhs);
+  utils::assertEqual(lhsC.size(), rhsC.size(), deepcopy);
+  for (uint i=0; i<lhsC.size(); i++) {
+    utils::assertEqual(std::get<0>(lhsC[i]), std::get<0>(rhsC[i]), deepcopy);
+    utils::assertEqual(std::get<1>(lhsC[i]), std::get<1>(rhsC[i]), deepcopy);
+    utils::assertEqual(std::get<2>(lhsC[i]), std::get<2>(rhsC[i]), deepcopy);
+    utils::assertEqual(std::get<3>(lhsC[i]), std::get<3>(rhsC[i]), deepcopy);
+  }
+}
+
 void assertEqualShallow (const Collisions &lhs, const Collisions &rhs,
                          bool deepcopy) {
 
@@ -1607,6 +1962,8 @@ void assertEqual (const TinyPhysicsEngine &lhs, const TinyPhysicsEngine &rhs,
   assertEqual(lhs._data, rhs._data, deepcopy);
   assertEqual(lhs._leftEdges, rhs._leftEdges, deepcopy);
   assertEqual(lhs._rightEdges, rhs._rightEdges, deepcopy);
+  assertEqual(bool(lhs._grid), bool(rhs._grid), deepcopy);
+  if (lhs._grid)  assertEqual(*lhs._grid, *rhs._grid, deepcopy);
   assertEqual(lhs._pistils, rhs._pistils, deepcopy);
 }
 
@@ -1,7 +1,13 @@
 #ifndef TINIEST_PHYSICS_ENGINE_H
 #define TINIEST_PHYSICS_ENGINE_H
 
+#include <atomic>
+#include <mutex>
+
 #include "physicstypes.hpp"
+#include "broadphasegrid.h"
+#include "intervaltree.h"
+#include "pistilindex.h"
 #include "plant.h"
 
 namespace simu {
@@ -52,6 +58,49 @@ private:
   CollisionObject (const Plant *p) : plant(p) {}
 };
 
+/// Activity of the engine since the last reset (i.e. over a step)
+/// Safe to update from concurrently stepped plants (see config::parallelStep)
+struct Counters {
+  using Counter = std::atomic<uint64_t>;
+
+  /// Indexed by result class (see index())
+  std::array<Counter, 5> collisionTests;
+  std::array<Counter, 5> initialCollisionTests;
+
+  Counter broadphaseQueries;
+  Counter broadphaseCandidates;
+
+  /// Broadphase lookups from the collision memo (see neighbourhood)
+  Counter memoQueries;
+  Counter memoCandidates;
+
+  Counter narrowphaseSweeps;    ///< Calls to the narrowphase
+  Counter narrowphasePruned;    ///< Sweeps skipped (one side has no organ)
+  Counter narrowphaseEvents;    ///< Events processed by the sweeps
+  Counter narrowphaseEarlyOuts; ///< Sweeps interrupted before the last event
+
+  Counter satTests;     ///< Organ pairs submitted to the separating axis test
+  Counter satBatches;   ///< Invocations of the (batched) SAT kernel
+  Counter satSeparated; ///< Pairs for which a separating axis was found
+
+  Counter pistilQueries;
+  Counter pistilCandidates;
+
+  Counters (void) { reset(); }
+
+  void reset (void);
+
+  static uint index (CollisionResult r);
+
+  /// Column names matching operator<<
+  struct Header {
+    friend std::ostream& operator<< (std::ostream &os, const Header&);
+  };
+
+  /// Writes all counters, space-separated and with a leading space
+  friend std::ostream& operator<< (std::ostream &os, const Counters &c);
+};
+
 class TinyPhysicsEngine {
   Collisions _data;
 
@@ -67,10 +116,27 @@ class TinyPhysicsEngine {
   Edges<LEFT> _leftEdges;
   Edges<RIGHT> _rightEdges;
 
-  using Pistils = std::set<Pistil, std::less<>>;
-  Pistils _pistils;
+  /// Replaces the edges when using a grid broadphase (see
+  /// config::gridBroadphase). Selected when the engine is empty
+  std::unique_ptr<BroadphaseGrid> _grid;
+
+  /// Horizontal extents of all objects, for containment queries
+  IntervalTree _intervals;
+
+  /// Objects added or resized since the last call to processNewObjects
+  std::set<CollisionObject*> _unprocessed;
+
+  PistilIndex _pistils;
 
-  using Pistils_range = std::pair<Pistils::iterator, Pistils::iterator>;
+  /// Buffer for the results of sporesInRange
+  std::vector<Pistil> _spores;
+
+  Counters _counters;
+
+  /// Serializes modifications of the shared containers when plants are
+  /// stepped concurrently (see config::parallelStep)
+  mutable std::mutex _mutex;
+  using Lock = std::lock_guard<std::mutex>;
 
 public:
   void init (void) {}
@@ -79,26 +145,46 @@ public:
   const auto& data (void) const {     return _data;     }
   const auto& pistils (void) const {  return _pistils;  }
 
-  const UpperLayer::Items& canopy (const Plant *p) const;
+  const auto& counters (void) const { return _counters; }
+  void resetCounters (void) { _counters.reset(); }
+
+  /// \returns a copy of \p p's canopy, as other plants may be concurrently
+  /// updating it (see config::parallelStep)
+  UpperLayer::Items canopy (const Plant *p) const;
 
   bool addCollisionData (const Environment &env, Plant *p);
   void removeCollisionData (Plant *p);
 
   CollisionResult initialCollisionTest (const Plant *plant);
 
-  CollisionResult collisionTest(const Plant *plant,
-                                const Branch &self, const Branch &branch,
+  /// Tests whether \p branch (replacing \p apex) can be added to \p plant
+  CollisionResult collisionTest(const Plant *plant, const Organ *apex,
+                                const Branch &branch,
                                 const Organ::Collection &newOrgans);
 
+  /// Fills \p n with the plants a branch of \p plant with bounds \p bounds
+  /// would be tested against by collisionTest (and their current state)
+  void neighbourhood (const Plant *plant, const Rect &bounds,
+                      Neighbourhood &n);
+
   void updateCollisions (Plant *p);
   void updateFinal (const Environment &env, Plant *p);
 
   void addPistil (Organ *p);
   void updatePistil (Organ *p, const Point &oldPos);
   void delPistil (const Organ *p);
-  Pistils_range sporesInRange (Organ *s);
 
-  // Call at the end of a simulation step to register new seeds
+  /// Answers the pollination queries of all \p stamens in a single sweep
+  /// (subsequent calls to sporesInRange still account for modifications)
+  void prepareSporesQueries (const std::vector<Organ*> &stamens);
+
+  /// \returns the pistils in range of \p s
+  /// \warning Not thread-safe: the returned range is only valid until the
+  /// next call
+  const std::vector<Pistil>& sporesInRange (Organ *s);
+
+  // Call at the end of a simulation step to register new seeds (and plants
+  // whose extent changed) as englobing/englobed
   void processNewObjects (void);
 
   // Call after loading a save file to ensure everything is fine
@@ -135,10 +221,25 @@ private:
   template <EdgeSide S>
   Edges<S>& getEdges (void);
 
+  /// Sets up the broadphase backend according to the configuration
+  void selectBroadphase (void);
+
+  /// Registers \p object's edges in the broadphase
+  void insertEdges (CollisionObject *object);
+
+  /// Moves \p object in the interval tree if its extent changed from \p old
+  void updateInterval (CollisionObject *object, const Rect &old);
+
   void broadphaseCollision (const CollisionObject *object,
                             const_Collisions &objects,
                             const Rect otherBounds = Rect::invalid());
 
+  /// Recomputes the world canopies of \p objects with a single linesweep
+  /// over the envelope of their (and their neighbors') items
+  /// \p removed (if any) is about to be deleted and ignored
+  void updateCanopies (const const_Collisions &objects,
+                       const CollisionObject *removed = nullptr);
+
   bool valid (const Pistil &p);
   bool checkAll (void);
 };
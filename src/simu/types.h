@@ -161,6 +161,15 @@ struct Position {
   float rotation;
 };
 
+/// Precomputed location of a point in the environment's voxels (see
+/// Environment::sampleAt)
+struct VoxelSample {
+  Point pos;
+  uint voxel;     ///< Left voxel
+  float weight;   ///< Of the right voxel
+  bool insideX, insideY;
+};
+
 struct Time {
   Time (void);
 
@@ -0,0 +1,163 @@
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include "voxellog.h"
+
+namespace simu {
+namespace voxellog {
+
+static constexpr bool debugVoxelLog = false;
+
+template <typename T>
+void append (std::vector<uint8_t> &buffer, const T *data, size_t n) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+  buffer.insert(buffer.end(), bytes, bytes + n * sizeof(T));
+}
+
+// =============================================================================
+// Writer
+
+Writer::Writer (const stdfs::path &file, uint batch,
+                uint32_t daysPerYear, uint32_t stepsPerDay)
+  : _file(file), _ofs(file, std::ios::out | std::ios::binary | std::ios::trunc),
+    _batch(std::max(1u, batch)), _header{}, _pending(0) {
+
+  if (!_ofs)
+    utils::doThrow<std::invalid_argument>(
+      "Unable to open voxel log ", file, " for writing");
+
+  std::memcpy(_header.magic, Header::magicValue, sizeof(_header.magic));
+  _header.version = Header::currentVersion;
+  _header.daysPerYear = daysPerYear;
+  _header.stepsPerDay = stepsPerDay;
+}
+
+Writer::~Writer (void) {
+  // Must not throw: call flush() beforehand to handle write errors
+  try {
+    flush();
+  } catch (std::exception &e) {
+    std::cerr << "Discarded voxel log error: " << e.what() << std::endl;
+  }
+}
+
+void Writer::append (uint32_t timestamp, const std::vector<Layer> &layers) {
+  if (_layers.empty()) {
+    for (const Layer &l: layers) {
+      LayerInfo li {};
+      li.id = l.id;
+      li.count = l.values->size();
+      std::strncpy(li.name, l.name.c_str(), sizeof(li.name) - 1);
+      _layers.push_back(li);
+    }
+    _header.layers = _layers.size();
+
+    voxellog::append(_buffer, &_header, 1);
+    voxellog::append(_buffer, _layers.data(), _layers.size());
+
+    size_t rowSize = sizeof(timestamp);
+    for (const LayerInfo &li: _layers)  rowSize += li.count * sizeof(float);
+    _buffer.reserve(_buffer.size() + _batch * rowSize);
+
+  } else if (layers.size() != _layers.size())
+    utils::doThrow<std::logic_error>(
+      "Voxel log ", _file, " expects ", _layers.size(), " layers, got ",
+      layers.size());
+
+  voxellog::append(_buffer, &timestamp, 1);
+  for (uint i=0; i<layers.size(); i++) {
+    const std::vector<float> &v = *layers[i].values;
+    if (layers[i].id != _layers[i].id || v.size() != _layers[i].count)
+      utils::doThrow<std::logic_error>(
+        "Layer ", i, " of voxel log ", _file, " changed shape");
+    voxellog::append(_buffer, v.data(), v.size());
+  }
+
+  if (++_pending >= _batch) flush();
+}
+
+void Writer::flush (void) {
+  if (_buffer.empty()) return;
+
+  _ofs.write(reinterpret_cast<const char*>(_buffer.data()), _buffer.size());
+  _ofs.flush();
+  if (!_ofs)
+    utils::doThrow<std::invalid_argument>(
+      "Failed to write ", _buffer.size(), " bytes to voxel log ", _file);
+
+  if (debugVoxelLog)
+    std::cerr << "Flushed " << _pending << " rows (" << _buffer.size()
+              << " bytes) to " << _file << std::endl;
+
+  _buffer.clear();
+  _pending = 0;
+}
+
+// =============================================================================
+// Reader
+
+Reader::Reader (const stdfs::path &file)
+  : _file(file), _ifs(file, std::ios::binary), _header{} {
+
+  if (!_ifs)
+    utils::doThrow<std::invalid_argument>(
+      "Unable to open voxel log ", file, " for reading");
+
+  _ifs.read(reinterpret_cast<char*>(&_header), sizeof(Header));
+  if (!_ifs || std::memcmp(_header.magic, Header::magicValue,
+                           sizeof(_header.magic)) != 0)
+    utils::doThrow<std::invalid_argument>(file, " is not a voxel log");
+
+  if (_header.version != Header::currentVersion)
+    utils::doThrow<std::invalid_argument>(
+      "Unsupported voxel log version ", _header.version, " for ", file);
+
+  _layers.resize(_header.layers);
+  _ifs.read(reinterpret_cast<char*>(_layers.data()),
+            _layers.size() * sizeof(LayerInfo));
+  if (!_ifs)
+    utils::doThrow<std::invalid_argument>(
+      "Truncated layer descriptions in ", file);
+}
+
+bool Reader::next (uint32_t &timestamp,
+                   std::vector<std::vector<float>> &values) {
+  if (!_ifs.read(reinterpret_cast<char*>(&timestamp), sizeof(timestamp)))
+    return false;
+
+  values.resize(_layers.size());
+  for (uint i=0; i<_layers.size(); i++) {
+    values[i].resize(_layers[i].count);
+    _ifs.read(reinterpret_cast<char*>(values[i].data()),
+              values[i].size() * sizeof(float));
+  }
+
+  if (!_ifs)
+    utils::doThrow<std::invalid_argument>(
+      "Truncated row at timestamp ", timestamp, " in ", _file);
+  return true;
+}
+
+std::string Reader::pretty (uint32_t timestamp) const {
+  const uint H = _header.stepsPerDay, D = _header.daysPerYear;
+  static const auto digits = [] (uint n) { return int(std::ceil(log10(n))); };
+
+  std::ostringstream oss;
+  oss << std::setfill('0')
+      << "y" << timestamp / (H * D)
+      << "d" << std::setw(digits(D)) << (timestamp / H) % D
+      << "h" << std::setw(digits(H)) << timestamp % H;
+  return oss.str();
+}
+
+bool isVoxelLog (const stdfs::path &file) {
+  std::ifstream ifs (file, std::ios::binary);
+  char magic [sizeof(Header::magicValue)];
+  return ifs.read(magic, sizeof(magic))
+      && std::memcmp(magic, Header::magicValue, sizeof(magic)) == 0;
+}
+
+} // end of namespace voxellog
+} // end of namespace simu
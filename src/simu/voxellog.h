@@ -0,0 +1,112 @@
+#ifndef SIMU_VOXELLOG_H
+#define SIMU_VOXELLOG_H
+
+/// Binary log of the environment's voxel layers
+///
+/// A file starts with a fixed header (see Header) followed by one LayerInfo
+/// per logged layer. Then come the rows: the step's timestamp (uint32) and,
+/// for every layer in header order, its raw float32 values.
+/// Rows are accumulated in memory and written by batches.
+///
+/// Use the voxels2dat tool to convert to the text format expected by the
+/// plotting scripts (one file per layer, one line per row).
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "kgd/settings/configfile.h"
+
+namespace simu {
+namespace voxellog {
+
+struct Header {
+  static constexpr char magicValue[8] = { 'R','E','U','S','V','O','X','1' };
+  static constexpr uint32_t currentVersion = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t layers;
+  uint32_t daysPerYear, stepsPerDay;  ///< To format timestamps
+};
+
+struct LayerInfo {
+  uint32_t id;      ///< genotype::cgp::Outputs
+  uint32_t count;   ///< Number of values per row
+  char name[16];    ///< Zero-padded
+};
+
+/// A layer to log: its description and the current values
+struct Layer {
+  uint32_t id;
+  std::string name;
+  const std::vector<float> *values;
+};
+
+class Writer {
+public:
+  /// Rows will be written to \p file every \p batch rows
+  Writer (const stdfs::path &file, uint batch,
+          uint32_t daysPerYear, uint32_t stepsPerDay);
+  ~Writer (void);
+
+  Writer (const Writer&) = delete;
+  Writer& operator= (const Writer&) = delete;
+
+  /// Appends the current values of \p layers
+  /// \note The header is written on the first call, after which \p layers
+  /// must keep the same order and sizes
+  void append (uint32_t timestamp, const std::vector<Layer> &layers);
+
+  /// Writes all pending rows
+  /// \note Also done (with errors only reported) on destruction
+  void flush (void);
+
+private:
+  stdfs::path _file;
+  std::ofstream _ofs;
+
+  uint _batch;
+  Header _header;
+  std::vector<LayerInfo> _layers;
+
+  std::vector<uint8_t> _buffer;
+  uint _pending;  ///< Rows in the buffer
+};
+
+class Reader {
+public:
+  Reader (const stdfs::path &file);
+
+  const Header& header (void) const {
+    return _header;
+  }
+
+  const std::vector<LayerInfo>& layers (void) const {
+    return _layers;
+  }
+
+  /// Reads the next row into \p timestamp and \p values (one vector per
+  /// layer)
+  /// \returns false at the end of the file
+  bool next (uint32_t &timestamp, std::vector<std::vector<float>> &values);
+
+  /// Formats \p timestamp as Time::pretty() would
+  std::string pretty (uint32_t timestamp) const;
+
+private:
+  stdfs::path _file;
+  std::ifstream _ifs;
+
+  Header _header;
+  std::vector<LayerInfo> _layers;
+};
+
+/// Whether \p file starts with a voxel log header
+bool isVoxelLog (const stdfs::path &file);
+
+} // end of namespace voxellog
+} // end of namespace simu
+
+#endif // SIMU_VOXELLOG_H
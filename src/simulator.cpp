@@ -19,7 +19,8 @@
 std::atomic<bool> aborted = false;
 void sigint_manager (int) {
   std::cerr << "Gracefully exiting simulation "
-               "(please wait for end of current step)" << std::endl;
+               "(please wait for end of current step and pending saves)"
+            << std::endl;
   aborted = true;
 }
 
@@ -215,7 +216,7 @@ int main(int argc, char *argv[]) {
     s.step();
     step++;
   }
-  s.atEnd();
+  s.atEnd();  // Also waits for the checkpoint writer (even when interrupted)
 
   s.destroy();
   return 0;
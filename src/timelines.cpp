@@ -223,12 +223,12 @@ using ParetoFront = std::vector<uint>;
 double interspeciesCompatibility (const Simulation &s) {
   float compat = 0;
   float ccount = 0;
-  for (const auto &lhs_p: s.plants()) {
-    const Plant &lhs = *lhs_p.second;
+  for (const Plant *lhs_p: s.plants()) {
+    const Plant &lhs = *lhs_p;
     if (lhs.sex() != Plant::Sex::FEMALE)  continue;
 
-    for (const auto &rhs_p: s.plants()) {
-      const Plant &rhs = *rhs_p.second;
+    for (const Plant *rhs_p: s.plants()) {
+      const Plant &rhs = *rhs_p;
       if (rhs.sex() != Plant::Sex::MALE)  continue;
       if (lhs.genealogy().self.sid == rhs.genealogy().self.sid) continue;
 
@@ -246,12 +246,12 @@ double interspeciesCompatibilitySTD(const Simulation &s) {
   std::vector<float> compats;
   float avgCompat = 0, stdCompat = 0;
 
-  for (const auto &lhs_p: s.plants()) {
-    const Plant &lhs = *lhs_p.second;
+  for (const Plant *lhs_p: s.plants()) {
+    const Plant &lhs = *lhs_p;
     if (lhs.sex() != Plant::Sex::FEMALE)  continue;
 
-    for (const auto &rhs_p: s.plants()) {
-      const Plant &rhs = *rhs_p.second;
+    for (const Plant *rhs_p: s.plants()) {
+      const Plant &rhs = *rhs_p;
       if (rhs.sex() != Plant::Sex::MALE)  continue;
       if (lhs.genealogy().self.sid == rhs.genealogy().self.sid) continue;
 
@@ -278,11 +278,11 @@ double interspeciesGeneticDistanceStd (const Simulation &s) {
   const auto &p = s.plants();
 
   for (auto lhs_it = p.begin(); lhs_it != p.end(); ++lhs_it) {
-    const Plant &lhs = *(*lhs_it).second;
+    const Plant &lhs = **lhs_it;
     if (lhs.sex() != Plant::Sex::FEMALE)  continue;
 
     for (auto rhs_it = std::next(lhs_it); rhs_it != p.end(); ++rhs_it) {
-      const Plant &rhs = *(*rhs_it).second;
+      const Plant &rhs = **rhs_it;
       if (rhs.sex() != Plant::Sex::MALE)  continue;
 
       if (lhs.genealogy().self.sid == rhs.genealogy().self.sid) continue;
@@ -309,10 +309,10 @@ double geneticDistanceStd (const Simulation &s) {
   const auto &p = s.plants();
 
   for (auto lhs_it = p.begin(); lhs_it != p.end(); ++lhs_it) {
-    const Plant &lhs = *(*lhs_it).second;
+    const Plant &lhs = **lhs_it;
 
     for (auto rhs_it = std::next(lhs_it); rhs_it != p.end(); ++rhs_it) {
-      const Plant &rhs = *(*rhs_it).second;
+      const Plant &rhs = **rhs_it;
 
       float d = distance(lhs.genome(), rhs.genome());
       distAvg += d;
@@ -285,8 +285,8 @@ void Controller::updateDisplays(void) {
   if (plants.size() > 0) {
     qss << plants.size();
     uint minGen = std::numeric_limits<uint>::max(), maxGen = 0;
-    for (const auto &p: plants) {
-      uint g = p.second->genealogy().generation;
+    for (const simu::Plant *p: plants) {
+      uint g = p->genealogy().generation;
       if (g < minGen) minGen = g;
       if (maxGen < g) maxGen = g;
     }
@@ -94,9 +94,8 @@ void GraphicSimulation::load (const std::string &file, GraphicSimulation &s,
 
   Simulation::load(file, s, constraints, fields);
   s._controller->view()->updateEnvironment();
-  for (const auto &p: s._plants)
-    s._controller->view()->addPlantItem(*p.second,
-                                        p.second->species());
+  for (Plant *p: s._plants)
+    s._controller->view()->addPlantItem(*p, p->species());
 
   s._pviewer.build();
 